@@ -0,0 +1,375 @@
+/*
+ * bench.c -- Microbenchmarks of the response decoders.
+ *
+ * Usage: ssq_bench [-t MILLIS] [-n COUNT] [-f FILTER] [RESPONSE...]
+ *
+ * Each benchmark runs for about MILLIS milliseconds (1000 by default), COUNT times (1 by default).
+ * Only the benchmarks whose name contains FILTER are run. Captured responses given as RESPONSE
+ * files are benchmarked with the decoder matching their header, after the built-in corpus.
+ *
+ * The output follows the Go benchmark format, so that runs of two versions can be compared with
+ * `benchstat' directly. Lines starting with '#' are comments; every other line reads:
+ *
+ *     Benchmark<Decoder>/<Response> <iterations> <x> ns/op <y> MB/s [<z> B/op <w> allocs/op]
+ *
+ * where MB/s is the throughput over the response bytes and the allocation columns are only
+ * reported when the allocations of the library can be counted (static GNU/ELF builds).
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssq/a2s.h"
+#include "ssq/parser.h"
+
+#include "a2s.h"
+#include "arena.h"
+#include "clock.h"
+#include "corpus.h"
+#include "packet.h"
+#include "response.h"
+#include "stream.h"
+
+#define SSQ_BENCH_TIME_DEFAULT 1000 // ms
+
+#ifdef SSQ_BENCH_COUNT_ALLOCS
+static size_t ssq_bench_allocs;
+static size_t ssq_bench_alloc_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    ++ssq_bench_allocs;
+    ssq_bench_alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    ++ssq_bench_allocs;
+    ssq_bench_alloc_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    ++ssq_bench_allocs;
+    ssq_bench_alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+#endif /* SSQ_BENCH_COUNT_ALLOCS */
+
+typedef struct ssq_bench_case SSQ_BENCH_CASE;
+
+/* Runs one operation of the benchmark; returns false if the decoder failed. */
+typedef bool (*SSQ_BENCH_FN)(const SSQ_BENCH_CASE *bench_case);
+
+struct ssq_bench_case {
+    char                       name[96];  /* Name of the benchmark.                   */
+    SSQ_BENCH_FN               fn;        /* The operation being measured.            */
+    const SSQ_BENCH_RESPONSE  *response;  /* The response the operation works on.     */
+    const SSQ_BENCH_DATAGRAMS *datagrams; /* Its datagrams, for the reassembly cases. */
+    bool                       reverse;   /* Whether the datagrams arrive reversed.   */
+};
+
+/* Keeps the compiler from optimizing the results away. */
+static volatile uintptr_t ssq_bench_sink;
+
+static bool ssq_bench_info(const SSQ_BENCH_CASE *bench_case) {
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    A2S_INFO *info = ssq_info_deserialize(bench_case->response->data, bench_case->response->len, &error);
+    ssq_bench_sink = (uintptr_t)info;
+    ssq_info_free(info);
+    return error.code == SSQE_OK;
+}
+
+static bool ssq_bench_player(const SSQ_BENCH_CASE *bench_case) {
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    uint8_t player_count;
+    A2S_PLAYER *players = ssq_player_deserialize(bench_case->response->data, bench_case->response->len, &player_count, &error);
+    ssq_bench_sink = (uintptr_t)players;
+    ssq_player_free(players, player_count);
+    return error.code == SSQE_OK;
+}
+
+static bool ssq_bench_rules(const SSQ_BENCH_CASE *bench_case) {
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    uint16_t rule_count;
+    A2S_RULES *rules = ssq_rules_deserialize(bench_case->response->data, bench_case->response->len, &rule_count, &error);
+    ssq_bench_sink = (uintptr_t)rules;
+    ssq_rules_free(rules, rule_count);
+    return error.code == SSQE_OK;
+}
+
+/* What `ssq_rules_indexed' costs on top of the query. */
+static bool ssq_bench_rules_index(const SSQ_BENCH_CASE *bench_case) {
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    uint16_t rule_count;
+    A2S_RULES *rules = ssq_rules_deserialize(bench_case->response->data, bench_case->response->len, &rule_count, &error);
+    A2S_RULES_INDEX *index = ssq_rules_index_new(rules, (rules != NULL) ? rule_count : 0);
+    ssq_bench_sink = (uintptr_t)index;
+    ssq_rules_index_free(index);
+    ssq_rules_free(rules, rule_count);
+    return error.code == SSQE_OK && index != NULL;
+}
+
+/* What `ssq_info_if_changed' and the like cost instead of decoding, when the response is unchanged. */
+static bool ssq_bench_fingerprint(const SSQ_BENCH_CASE *bench_case) {
+    ssq_bench_sink = (uintptr_t)ssq_response_fingerprint(bench_case->response->data, bench_case->response->len);
+    return true;
+}
+
+static bool ssq_bench_push_on_player(const A2S_PLAYER *player, void *data) {
+    (void)data;
+    ssq_bench_sink = (uintptr_t)player->name;
+    return true;
+}
+
+static bool ssq_bench_push_on_rule(const A2S_RULES *rule, void *data) {
+    (void)data;
+    ssq_bench_sink = (uintptr_t)rule->value;
+    return true;
+}
+
+/* Feeds the response to the push parser in pieces the size of the packets of a split response. */
+static bool ssq_bench_push(const SSQ_BENCH_CASE *bench_case) {
+    bool player = (bench_case->response->data[0] == S2A_HEADER_PLAYER);
+    SSQ_PARSER *parser = player ? ssq_parser_new_player(ssq_bench_push_on_player, NULL) : ssq_parser_new_rules(ssq_bench_push_on_rule, NULL);
+    if (parser == NULL)
+        return false;
+    for (size_t pos = 0; pos < bench_case->response->len; pos += SSQ_BENCH_SPLIT_SIZE) {
+        size_t len = bench_case->response->len - pos;
+        ssq_parser_feed(parser, bench_case->response->data + pos, (len < SSQ_BENCH_SPLIT_SIZE) ? len : SSQ_BENCH_SPLIT_SIZE);
+    }
+    bool ok = ssq_parser_done(parser);
+    ssq_parser_free(parser);
+    return ok;
+}
+
+static bool ssq_bench_stream_read_string(const SSQ_BENCH_CASE *bench_case) {
+    static char buf[64 * 256];
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, buf, sizeof (buf));
+    SSQ_STREAM stream;
+    ssq_stream_wrap(&stream, bench_case->response->data, bench_case->response->len);
+    for (size_t i = 0; i < bench_case->response->strs; ++i) {
+        size_t len;
+        ssq_bench_sink = (uintptr_t)ssq_stream_read_string(&stream, &arena, &len);
+    }
+    return arena.used <= arena.size;
+}
+
+static bool ssq_bench_reassembly(const SSQ_BENCH_CASE *bench_case) {
+    const SSQ_BENCH_DATAGRAMS *datagrams = bench_case->datagrams;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_REASSEMBLY reassembly;
+    ssq_reassembly_init(&reassembly);
+    for (size_t i = 0; i < datagrams->count && error.code == SSQE_OK; ++i) {
+        size_t n = bench_case->reverse ? datagrams->count - 1 - i : i;
+        ssq_reassembly_add(&reassembly, datagrams->data[n], datagrams->lens[n], &error);
+    }
+    bool ok = (error.code == SSQE_OK && ssq_reassembly_done(&reassembly));
+    if (ok) {
+        size_t response_len;
+        uint8_t *response = ssq_reassembly_to_response(&reassembly, &response_len, &error);
+        // Only split responses keep the header of their payload.
+        size_t expected_len = bench_case->response->len + ((datagrams->count > 1) ? SSQ_PACKET_HEADER_LEN : 0);
+        ok = (response != NULL && response_len == expected_len);
+        ssq_bench_sink = (uintptr_t)response;
+        free(response);
+    }
+    ssq_reassembly_clear(&reassembly);
+    return ok;
+}
+
+/* Runs the benchmark in rounds of growing size until a round lasts long enough. */
+static bool ssq_bench_run(const SSQ_BENCH_CASE *bench_case, uint64_t time_ns) {
+    if (!bench_case->fn(bench_case)) {
+        fprintf(stderr, "%s: the decoder failed on its response\n", bench_case->name);
+        return false;
+    }
+    uint64_t iterations = 1;
+    uint64_t elapsed = 0;
+#ifdef SSQ_BENCH_COUNT_ALLOCS
+    size_t allocs = 0, alloc_bytes = 0;
+#endif /* SSQ_BENCH_COUNT_ALLOCS */
+    for (;;) {
+#ifdef SSQ_BENCH_COUNT_ALLOCS
+        ssq_bench_allocs = ssq_bench_alloc_bytes = 0;
+#endif /* SSQ_BENCH_COUNT_ALLOCS */
+        uint64_t start = ssq_bench_clock_ns();
+        for (uint64_t i = 0; i < iterations; ++i)
+            bench_case->fn(bench_case);
+        elapsed = ssq_bench_clock_ns() - start;
+#ifdef SSQ_BENCH_COUNT_ALLOCS
+        allocs = ssq_bench_allocs;
+        alloc_bytes = ssq_bench_alloc_bytes;
+#endif /* SSQ_BENCH_COUNT_ALLOCS */
+        if (elapsed >= time_ns || iterations >= 1000000000)
+            break;
+        // Aim past the target, without growing more than a hundredfold at once.
+        uint64_t next = (elapsed != 0) ? (uint64_t)((double)iterations * 1.2 * (double)time_ns / (double)elapsed) : iterations * 100;
+        if (next > iterations * 100)
+            next = iterations * 100;
+        iterations = (next > iterations) ? next : iterations + 1;
+    }
+    double ns_per_op = (double)elapsed / (double)iterations;
+    double mb_per_s  = (double)bench_case->response->len * 1e3 / ns_per_op;
+    printf("Benchmark%s\t%10" PRIu64 "\t%12.1f ns/op\t%10.2f MB/s", bench_case->name, iterations, ns_per_op, mb_per_s);
+#ifdef SSQ_BENCH_COUNT_ALLOCS
+    printf("\t%10.0f B/op\t%6.0f allocs/op", (double)alloc_bytes / (double)iterations, (double)allocs / (double)iterations);
+#endif /* SSQ_BENCH_COUNT_ALLOCS */
+    printf("\n");
+    fflush(stdout);
+    return true;
+}
+
+static void ssq_bench_case_init(SSQ_BENCH_CASE *bench_case, const char decoder[], SSQ_BENCH_FN fn, const SSQ_BENCH_RESPONSE *response) {
+    memset(bench_case, 0, sizeof (*bench_case));
+    snprintf(bench_case->name, sizeof (bench_case->name), "%s/%s", decoder, response->name);
+    bench_case->fn       = fn;
+    bench_case->response = response;
+}
+
+/* Runs a benchmark unless filtered out; returns false on failure. */
+static bool ssq_bench_maybe_run(const SSQ_BENCH_CASE *bench_case, const char filter[], uint64_t time_ns, unsigned count) {
+    if (filter != NULL && strstr(bench_case->name, filter) == NULL)
+        return true;
+    for (unsigned i = 0; i < count; ++i) {
+        if (!ssq_bench_run(bench_case, time_ns))
+            return false;
+    }
+    return true;
+}
+
+static bool ssq_bench_reassembly_cases(const char kind[], const SSQ_BENCH_RESPONSE *response, bool compress, const char filter[], uint64_t time_ns, unsigned count) {
+    SSQ_BENCH_DATAGRAMS datagrams;
+    if (!ssq_bench_corpus_split(response, SSQ_BENCH_SPLIT_SIZE, compress, &datagrams)) {
+        fprintf(stderr, "Could not split the %s response\n", response->name);
+        return false;
+    }
+    bool ok = true;
+    for (int reverse = 0; reverse < (datagrams.count > 1 ? 2 : 1) && ok; ++reverse) {
+        SSQ_BENCH_CASE bench_case;
+        ssq_bench_case_init(&bench_case, "Reassembly", ssq_bench_reassembly, response);
+        snprintf(bench_case.name, sizeof (bench_case.name), "Reassembly/%s_%s%s%s", kind, response->name, compress ? "_bzip2" : "", reverse ? "_reversed" : "");
+        bench_case.datagrams = &datagrams;
+        bench_case.reverse   = reverse;
+        ok = ssq_bench_maybe_run(&bench_case, filter, time_ns, count);
+    }
+    ssq_bench_corpus_free_datagrams(&datagrams);
+    return ok;
+}
+
+static bool ssq_bench_captured(const SSQ_BENCH_RESPONSE *response, const char filter[], uint64_t time_ns, unsigned count) {
+    SSQ_BENCH_CASE bench_case;
+    switch (ssq_response_get_header(response->data, response->len)) {
+        case S2A_HEADER_INFO:
+            ssq_bench_case_init(&bench_case, "InfoDeserialize", ssq_bench_info, response);
+            break;
+        case S2A_HEADER_PLAYER:
+            ssq_bench_case_init(&bench_case, "PlayerDeserialize", ssq_bench_player, response);
+            break;
+        case S2A_HEADER_RULES:
+            ssq_bench_case_init(&bench_case, "RulesDeserialize", ssq_bench_rules, response);
+            break;
+        default:
+            fprintf(stderr, "%s: not an A2S_INFO, A2S_PLAYER or A2S_RULES response\n", response->name);
+            return false;
+    }
+    return ssq_bench_maybe_run(&bench_case, filter, time_ns, count);
+}
+
+static void ssq_bench_usage(const char program[]) {
+    fprintf(stderr, "Usage: %s [-t MILLIS] [-n COUNT] [-f FILTER] [RESPONSE...]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t time_ms = SSQ_BENCH_TIME_DEFAULT;
+    unsigned count = 1;
+    const char *filter = NULL;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi += 2) {
+        if (argi + 1 >= argc || argv[argi][1] == '\0' || argv[argi][2] != '\0') {
+            ssq_bench_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        switch (argv[argi][1]) {
+            case 't': time_ms = strtoull(argv[argi + 1], NULL, 10); break;
+            case 'n': count = (unsigned)strtoul(argv[argi + 1], NULL, 10); break;
+            case 'f': filter = argv[argi + 1]; break;
+            default:
+                ssq_bench_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    uint64_t time_ns = time_ms * 1000000;
+
+    SSQ_BENCH_RESPONSE corpus[SSQ_BENCH_CORPUS_COUNT];
+    if (!ssq_bench_corpus_build(corpus)) {
+        fprintf(stderr, "Could not build the corpus\n");
+        return EXIT_FAILURE;
+    }
+    printf("# ssq_bench %s\n", SSQ_BENCH_VERSION);
+#ifndef SSQ_BENCH_COUNT_ALLOCS
+    printf("# allocations are not counted in this build\n");
+#endif /* !SSQ_BENCH_COUNT_ALLOCS */
+
+    static const struct {
+        const char         *decoder;
+        SSQ_BENCH_FN        fn;
+        SSQ_BENCH_CORPUS_ID id;
+    } cases[] = {
+        { "StreamReadString",  ssq_bench_stream_read_string, SSQ_BENCH_STRINGS_SHORT          },
+        { "StreamReadString",  ssq_bench_stream_read_string, SSQ_BENCH_STRINGS_LONG           },
+        { "InfoDeserialize",   ssq_bench_info,               SSQ_BENCH_INFO_MINIMAL           },
+        { "InfoDeserialize",   ssq_bench_info,               SSQ_BENCH_INFO_EDF_PORT_KEYWORDS },
+        { "InfoDeserialize",   ssq_bench_info,               SSQ_BENCH_INFO_EDF_ALL           },
+        { "PlayerDeserialize", ssq_bench_player,             SSQ_BENCH_PLAYER_64              },
+        { "PlayerDeserialize", ssq_bench_player,             SSQ_BENCH_PLAYER_255             },
+        { "RulesDeserialize",  ssq_bench_rules,              SSQ_BENCH_RULES_SMALL            },
+        { "RulesDeserialize",  ssq_bench_rules,              SSQ_BENCH_RULES_HUGE             },
+        { "PlayerPush",        ssq_bench_push,               SSQ_BENCH_PLAYER_64              },
+        { "PlayerPush",        ssq_bench_push,               SSQ_BENCH_PLAYER_255             },
+        { "RulesPush",         ssq_bench_push,               SSQ_BENCH_RULES_SMALL            },
+        { "RulesPush",         ssq_bench_push,               SSQ_BENCH_RULES_HUGE             },
+        { "RulesIndex",        ssq_bench_rules_index,        SSQ_BENCH_RULES_SMALL            },
+        { "RulesIndex",        ssq_bench_rules_index,        SSQ_BENCH_RULES_HUGE             },
+        { "Fingerprint",       ssq_bench_fingerprint,        SSQ_BENCH_INFO_EDF_ALL           },
+        { "Fingerprint",       ssq_bench_fingerprint,        SSQ_BENCH_PLAYER_255             },
+        { "Fingerprint",       ssq_bench_fingerprint,        SSQ_BENCH_RULES_SMALL            },
+        { "Fingerprint",       ssq_bench_fingerprint,        SSQ_BENCH_RULES_HUGE             },
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof (cases) / sizeof (*cases) && ok; ++i) {
+        SSQ_BENCH_CASE bench_case;
+        ssq_bench_case_init(&bench_case, cases[i].decoder, cases[i].fn, &corpus[cases[i].id]);
+        ok = ssq_bench_maybe_run(&bench_case, filter, time_ns, count);
+    }
+    ok = ok && ssq_bench_reassembly_cases("info", &corpus[SSQ_BENCH_INFO_EDF_ALL], false, filter, time_ns, count);
+    ok = ok && ssq_bench_reassembly_cases("player", &corpus[SSQ_BENCH_PLAYER_255], false, filter, time_ns, count);
+    ok = ok && ssq_bench_reassembly_cases("rules", &corpus[SSQ_BENCH_RULES_HUGE], false, filter, time_ns, count);
+#ifdef SSQ_HAVE_BZIP2
+    ok = ok && ssq_bench_reassembly_cases("rules", &corpus[SSQ_BENCH_RULES_HUGE], true, filter, time_ns, count);
+#endif /* SSQ_HAVE_BZIP2 */
+    ssq_bench_corpus_free(corpus);
+
+    for (; argi < argc && ok; ++argi) {
+        SSQ_BENCH_RESPONSE captured;
+        if (!ssq_bench_corpus_load(&captured, argv[argi])) {
+            fprintf(stderr, "%s: could not load the response\n", argv[argi]);
+            ok = false;
+            break;
+        }
+        ok = ssq_bench_captured(&captured, filter, time_ns, count);
+        free(captured.data);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
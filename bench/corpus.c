@@ -0,0 +1,365 @@
+#include "corpus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef SSQ_HAVE_BZIP2
+# include <bzlib.h>
+#endif /* SSQ_HAVE_BZIP2 */
+
+#include "ssq/a2s/info.h"
+
+#include "packet.h"
+#include "response.h"
+
+/* Growable buffer the responses are written into, in the byte order of the wire. */
+typedef struct ssq_bench_buffer {
+    uint8_t *data;   /* The bytes written so far.                   */
+    size_t   len;    /* Number of bytes written.                    */
+    size_t   size;   /* Number of bytes allocated for `data'.       */
+    bool     failed; /* Whether an allocation failed along the way. */
+} SSQ_BENCH_BUFFER;
+
+static void ssq_bench_put(SSQ_BENCH_BUFFER *buf, const void *src, size_t n) {
+    if (buf->failed)
+        return;
+    if (buf->len + n + 1 > buf->size) {
+        size_t size = (buf->size != 0) ? buf->size : 256;
+        while (buf->len + n + 1 > size)
+            size *= 2;
+        uint8_t *data = realloc(buf->data, size);
+        if (data == NULL) {
+            buf->failed = true;
+            return;
+        }
+        buf->data = data;
+        buf->size = size;
+    }
+    memcpy(buf->data + buf->len, src, n);
+    buf->len += n;
+    buf->data[buf->len] = '\0'; // Real responses are terminated too (see ssq_reassembly_to_response).
+}
+
+static void ssq_bench_put_uint8(SSQ_BENCH_BUFFER *buf, uint8_t value) {
+    ssq_bench_put(buf, &value, sizeof (value));
+}
+
+static void ssq_bench_put_le(SSQ_BENCH_BUFFER *buf, uint64_t value, size_t n) {
+    uint8_t bytes[8];
+    for (size_t i = 0; i < n; ++i)
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    ssq_bench_put(buf, bytes, n);
+}
+
+static void ssq_bench_put_float(SSQ_BENCH_BUFFER *buf, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof (bits));
+    ssq_bench_put_le(buf, bits, sizeof (bits));
+}
+
+static void ssq_bench_put_string(SSQ_BENCH_BUFFER *buf, const char str[]) {
+    ssq_bench_put(buf, str, strlen(str) + 1);
+}
+
+/* Deterministic generator, so that the corpus is the same on every run. */
+static uint32_t ssq_bench_rand(uint32_t *state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+static void ssq_bench_put_random_string(SSQ_BENCH_BUFFER *buf, uint32_t *state, size_t len) {
+    static const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-.[]|";
+    char str[256];
+    for (size_t i = 0; i < len; ++i)
+        str[i] = charset[ssq_bench_rand(state) % (sizeof (charset) - 1)];
+    str[len] = '\0';
+    ssq_bench_put_string(buf, str);
+}
+
+static void ssq_bench_build_info(SSQ_BENCH_BUFFER *buf, uint8_t edf) {
+    ssq_bench_put_uint8(buf, S2A_HEADER_INFO);
+    ssq_bench_put_uint8(buf, 17);
+    if (edf == 0) {
+        ssq_bench_put_string(buf, "Team Fortress");
+        ssq_bench_put_string(buf, "ctf_2fort");
+        ssq_bench_put_string(buf, "tf");
+        ssq_bench_put_string(buf, "Team Fortress");
+        ssq_bench_put_le(buf, 440, 2);
+        ssq_bench_put_uint8(buf, 12);
+        ssq_bench_put_uint8(buf, 24);
+        ssq_bench_put_uint8(buf, 0);
+    } else {
+        ssq_bench_put_string(buf, "Valve Counter-Strike 2 eu_west Server (srcds1032-fra2.123.45)");
+        ssq_bench_put_string(buf, "de_dust2");
+        ssq_bench_put_string(buf, "csgo");
+        ssq_bench_put_string(buf, "Counter-Strike 2");
+        ssq_bench_put_le(buf, 730, 2);
+        ssq_bench_put_uint8(buf, 9);
+        ssq_bench_put_uint8(buf, 10);
+        ssq_bench_put_uint8(buf, 0);
+    }
+    ssq_bench_put_uint8(buf, A2S_SERVER_TYPE_DEDICATED);
+    ssq_bench_put_uint8(buf, A2S_ENVIRONMENT_LINUX);
+    ssq_bench_put_uint8(buf, 0);
+    ssq_bench_put_uint8(buf, 1);
+    ssq_bench_put_string(buf, (edf == 0) ? "8604597" : "1.40.2.4");
+    if (edf == 0)
+        return;
+    ssq_bench_put_uint8(buf, edf);
+    if (edf & A2S_INFO_FLAG_PORT)
+        ssq_bench_put_le(buf, 27015, 2);
+    if (edf & A2S_INFO_FLAG_STEAMID)
+        ssq_bench_put_le(buf, UINT64_C(90203495727235073), 8);
+    if (edf & A2S_INFO_FLAG_STV) {
+        ssq_bench_put_le(buf, 27020, 2);
+        ssq_bench_put_string(buf, "Counter-Strike 2 SourceTV");
+    }
+    if (edf & A2S_INFO_FLAG_KEYWORDS)
+        ssq_bench_put_string(buf, "valve_ds,competitive,secure,region:eu_west,cluster:fra");
+    if (edf & A2S_INFO_FLAG_GAMEID)
+        ssq_bench_put_le(buf, 730, 8);
+}
+
+static void ssq_bench_build_player(SSQ_BENCH_BUFFER *buf, uint8_t player_count) {
+    uint32_t state = player_count;
+    ssq_bench_put_uint8(buf, S2A_HEADER_PLAYER);
+    ssq_bench_put_uint8(buf, player_count);
+    for (uint8_t i = 0; i < player_count; ++i) {
+        ssq_bench_put_uint8(buf, 0);
+        ssq_bench_put_random_string(buf, &state, 3 + ssq_bench_rand(&state) % 29);
+        ssq_bench_put_le(buf, ssq_bench_rand(&state) % 100, 4);
+        ssq_bench_put_float(buf, (float)(ssq_bench_rand(&state) % 36000) / 10.0f);
+    }
+}
+
+static void ssq_bench_build_rules_small(SSQ_BENCH_BUFFER *buf) {
+    static const char *const rules[][2] = {
+        { "bot_quota",            "0"     }, { "coop",                 "0"     },
+        { "deathmatch",           "1"     }, { "mp_autoteambalance",   "1"     },
+        { "mp_c4timer",           "40"    }, { "mp_freezetime",        "15"    },
+        { "mp_friendlyfire",      "1"     }, { "mp_maxrounds",         "24"    },
+        { "mp_roundtime",         "1.92"  }, { "mp_startmoney",        "800"   },
+        { "mp_timelimit",         "0"     }, { "mp_winlimit",          "0"     },
+        { "nextlevel",            ""      }, { "sv_allow_votes",       "0"     },
+        { "sv_gravity",           "800"   }, { "sv_password",          "0"     },
+    };
+    ssq_bench_put_uint8(buf, S2A_HEADER_RULES);
+    ssq_bench_put_le(buf, sizeof (rules) / sizeof (*rules), 2);
+    for (size_t i = 0; i < sizeof (rules) / sizeof (*rules); ++i) {
+        ssq_bench_put_string(buf, rules[i][0]);
+        ssq_bench_put_string(buf, rules[i][1]);
+    }
+}
+
+/* Heavily modded servers list every plugin's console variables. */
+static void ssq_bench_build_rules_huge(SSQ_BENCH_BUFFER *buf, uint16_t rule_count) {
+    static const char *const plugins[] = { "sm", "mani", "es", "oxide", "amx", "zr", "surf", "kz" };
+    uint32_t state = rule_count;
+    ssq_bench_put_uint8(buf, S2A_HEADER_RULES);
+    ssq_bench_put_le(buf, rule_count, 2);
+    for (uint16_t i = 0; i < rule_count; ++i) {
+        char name[64];
+        snprintf(name, sizeof (name), "%s_plugin%03u_setting%02u", plugins[i % 8], (unsigned)(i / 16), (unsigned)(i % 16));
+        ssq_bench_put_string(buf, name);
+        ssq_bench_put_random_string(buf, &state, ssq_bench_rand(&state) % 24);
+    }
+}
+
+static void ssq_bench_build_strings(SSQ_BENCH_BUFFER *buf, size_t count, size_t len) {
+    uint32_t state = (uint32_t)len;
+    for (size_t i = 0; i < count; ++i)
+        ssq_bench_put_random_string(buf, &state, len);
+}
+
+bool ssq_bench_corpus_build(SSQ_BENCH_RESPONSE corpus[SSQ_BENCH_CORPUS_COUNT]) {
+    static const char *const names[SSQ_BENCH_CORPUS_COUNT] = {
+        [SSQ_BENCH_INFO_MINIMAL]           = "minimal",
+        [SSQ_BENCH_INFO_EDF_PORT_KEYWORDS] = "edf_port_keywords",
+        [SSQ_BENCH_INFO_EDF_ALL]           = "edf_all",
+        [SSQ_BENCH_PLAYER_64]              = "64",
+        [SSQ_BENCH_PLAYER_255]             = "255",
+        [SSQ_BENCH_RULES_SMALL]            = "small",
+        [SSQ_BENCH_RULES_HUGE]             = "huge",
+        [SSQ_BENCH_STRINGS_SHORT]          = "short",
+        [SSQ_BENCH_STRINGS_LONG]           = "long",
+    };
+    bool ok = true;
+    for (int id = 0; id < SSQ_BENCH_CORPUS_COUNT; ++id) {
+        SSQ_BENCH_BUFFER buf = { NULL, 0, 0, false };
+        size_t strs = 0;
+        switch (id) {
+            case SSQ_BENCH_INFO_MINIMAL:
+                ssq_bench_build_info(&buf, 0);
+                break;
+            case SSQ_BENCH_INFO_EDF_PORT_KEYWORDS:
+                ssq_bench_build_info(&buf, A2S_INFO_FLAG_PORT | A2S_INFO_FLAG_STEAMID | A2S_INFO_FLAG_KEYWORDS | A2S_INFO_FLAG_GAMEID);
+                break;
+            case SSQ_BENCH_INFO_EDF_ALL:
+                ssq_bench_build_info(&buf, A2S_INFO_FLAG_PORT | A2S_INFO_FLAG_STEAMID | A2S_INFO_FLAG_STV | A2S_INFO_FLAG_KEYWORDS | A2S_INFO_FLAG_GAMEID);
+                break;
+            case SSQ_BENCH_PLAYER_64:
+                ssq_bench_build_player(&buf, 64);
+                break;
+            case SSQ_BENCH_PLAYER_255:
+                ssq_bench_build_player(&buf, 255);
+                break;
+            case SSQ_BENCH_RULES_SMALL:
+                ssq_bench_build_rules_small(&buf);
+                break;
+            case SSQ_BENCH_RULES_HUGE:
+                ssq_bench_build_rules_huge(&buf, 2000);
+                break;
+            case SSQ_BENCH_STRINGS_SHORT:
+                ssq_bench_build_strings(&buf, strs = 64, 16);
+                break;
+            case SSQ_BENCH_STRINGS_LONG:
+                ssq_bench_build_strings(&buf, strs = 64, 255);
+                break;
+        }
+        corpus[id].name = names[id];
+        corpus[id].data = buf.data;
+        corpus[id].len  = buf.len;
+        corpus[id].strs = strs;
+        ok = ok && !buf.failed;
+    }
+    if (!ok)
+        ssq_bench_corpus_free(corpus);
+    return ok;
+}
+
+void ssq_bench_corpus_free(SSQ_BENCH_RESPONSE corpus[SSQ_BENCH_CORPUS_COUNT]) {
+    for (int id = 0; id < SSQ_BENCH_CORPUS_COUNT; ++id) {
+        free(corpus[id].data);
+        corpus[id].data = NULL;
+    }
+}
+
+bool ssq_bench_corpus_load(SSQ_BENCH_RESPONSE *response, const char path[]) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    SSQ_BENCH_BUFFER buf = { NULL, 0, 0, false };
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof (chunk), file)) != 0)
+        ssq_bench_put(&buf, chunk, n);
+    bool ok = !ferror(file) && !buf.failed && buf.len != 0;
+    fclose(file);
+    if (!ok) {
+        free(buf.data);
+        return false;
+    }
+    const char *name = path;
+    for (const char *c = path; *c != '\0'; ++c) {
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+    }
+    response->name = name;
+    response->data = buf.data;
+    response->len  = buf.len;
+    response->strs = 0;
+    return true;
+}
+
+#ifdef SSQ_HAVE_BZIP2
+static uint32_t ssq_bench_crc32(const uint8_t data[], size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+/* Replaces the payload by its decompressed size, its CRC32 and its bzip2 stream. */
+static bool ssq_bench_compress(SSQ_BENCH_BUFFER *payload) {
+    unsigned int bz_len = (unsigned int)(payload->len + payload->len / 100 + 600);
+    SSQ_BENCH_BUFFER compressed = { NULL, 0, 0, false };
+    ssq_bench_put_le(&compressed, payload->len, 4);
+    ssq_bench_put_le(&compressed, ssq_bench_crc32(payload->data, payload->len), 4);
+    uint8_t *bz = malloc(bz_len);
+    bool ok = !compressed.failed && bz != NULL
+        && BZ2_bzBuffToBuffCompress((char *)bz, &bz_len, (char *)payload->data, (unsigned int)payload->len, 9, 0, 0) == BZ_OK;
+    if (ok)
+        ssq_bench_put(&compressed, bz, bz_len);
+    free(bz);
+    free(payload->data);
+    *payload = compressed;
+    return ok && !compressed.failed;
+}
+#endif /* SSQ_HAVE_BZIP2 */
+
+bool ssq_bench_corpus_split(const SSQ_BENCH_RESPONSE *response, uint16_t split_size, bool compress, SSQ_BENCH_DATAGRAMS *datagrams) {
+    memset(datagrams, 0, sizeof (*datagrams));
+    SSQ_BENCH_BUFFER payload = { NULL, 0, 0, false };
+    ssq_bench_put_le(&payload, SSQ_PACKET_HEADER_SINGLE, 4);
+    ssq_bench_put(&payload, response->data, response->len);
+    if (payload.failed)
+        return false;
+    if (payload.len <= SSQ_PACKET_SIZE) {
+        datagrams->data  = malloc(sizeof (*datagrams->data));
+        datagrams->lens  = malloc(sizeof (*datagrams->lens));
+        if (datagrams->data == NULL || datagrams->lens == NULL) {
+            free(payload.data);
+            ssq_bench_corpus_free_datagrams(datagrams);
+            return false;
+        }
+        datagrams->data[0] = payload.data;
+        datagrams->lens[0] = payload.len;
+        datagrams->count   = 1;
+        return true;
+    }
+    int32_t id = 0x2A;
+    if (compress) {
+#ifdef SSQ_HAVE_BZIP2
+        if (!ssq_bench_compress(&payload)) {
+            free(payload.data);
+            return false;
+        }
+        id |= (int32_t)SSQ_PACKET_FLAG_COMPRESSION;
+#else /* !SSQ_HAVE_BZIP2 */
+        free(payload.data);
+        return false;
+#endif /* SSQ_HAVE_BZIP2 */
+    }
+    size_t count = (payload.len + split_size - 1) / split_size;
+    if (count > UINT8_MAX) {
+        free(payload.data);
+        return false;
+    }
+    datagrams->data = calloc(count, sizeof (*datagrams->data));
+    datagrams->lens = calloc(count, sizeof (*datagrams->lens));
+    bool ok = datagrams->data != NULL && datagrams->lens != NULL;
+    for (size_t i = 0; ok && i < count; ++i) {
+        size_t offset = i * split_size;
+        size_t len = payload.len - offset;
+        if (len > split_size)
+            len = split_size;
+        SSQ_BENCH_BUFFER datagram = { NULL, 0, 0, false };
+        ssq_bench_put_le(&datagram, SSQ_PACKET_HEADER_MULTI, 4);
+        ssq_bench_put_le(&datagram, (uint32_t)id, 4);
+        ssq_bench_put_uint8(&datagram, (uint8_t)count);
+        ssq_bench_put_uint8(&datagram, (uint8_t)i);
+        ssq_bench_put_le(&datagram, split_size, 2);
+        ssq_bench_put(&datagram, payload.data + offset, len);
+        datagrams->data[i] = datagram.data;
+        datagrams->lens[i] = datagram.len;
+        datagrams->count   = i + 1;
+        ok = !datagram.failed;
+    }
+    free(payload.data);
+    if (!ok)
+        ssq_bench_corpus_free_datagrams(datagrams);
+    return ok;
+}
+
+void ssq_bench_corpus_free_datagrams(SSQ_BENCH_DATAGRAMS *datagrams) {
+    if (datagrams->data != NULL) {
+        for (size_t i = 0; i < datagrams->count; ++i)
+            free(datagrams->data[i]);
+    }
+    free(datagrams->data);
+    free(datagrams->lens);
+    memset(datagrams, 0, sizeof (*datagrams));
+}
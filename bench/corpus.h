@@ -0,0 +1,61 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest payload of a split packet sent by Source servers. */
+#define SSQ_BENCH_SPLIT_SIZE 1248
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum ssq_bench_corpus_id {
+    SSQ_BENCH_INFO_MINIMAL,
+    SSQ_BENCH_INFO_EDF_PORT_KEYWORDS,
+    SSQ_BENCH_INFO_EDF_ALL,
+    SSQ_BENCH_PLAYER_64,
+    SSQ_BENCH_PLAYER_255,
+    SSQ_BENCH_RULES_SMALL,
+    SSQ_BENCH_RULES_HUGE,
+    SSQ_BENCH_STRINGS_SHORT,
+    SSQ_BENCH_STRINGS_LONG,
+    SSQ_BENCH_CORPUS_COUNT,
+} SSQ_BENCH_CORPUS_ID;
+
+/* A response as handed to the decoders, i.e. reassembled and without its packet header. */
+typedef struct ssq_bench_response {
+    const char *name; /* Name of the response in the benchmark names.             */
+    uint8_t    *data; /* The response, followed by a terminator like a real one. */
+    size_t      len;  /* Length of the response.                                   */
+    size_t      strs; /* Number of strings in `data' (string corpora only).       */
+} SSQ_BENCH_RESPONSE;
+
+/* The datagrams a server sends for a response. */
+typedef struct ssq_bench_datagrams {
+    uint8_t **data;  /* Each datagram, packet header included. */
+    size_t   *lens;  /* Length of each datagram.               */
+    size_t    count; /* Number of datagrams.                   */
+} SSQ_BENCH_DATAGRAMS;
+
+/* Builds the corpus: the same bytes on every run and every platform. */
+bool ssq_bench_corpus_build(SSQ_BENCH_RESPONSE corpus[SSQ_BENCH_CORPUS_COUNT]);
+void ssq_bench_corpus_free(SSQ_BENCH_RESPONSE corpus[SSQ_BENCH_CORPUS_COUNT]);
+
+/* Loads a response captured to a file (e.g. with `tcpdump' then stripped of its packet header). */
+bool ssq_bench_corpus_load(SSQ_BENCH_RESPONSE *response, const char *path);
+
+/*
+ * Splits a response the way a server would, in packets of `split_size' bytes of payload at most.
+ * When it does not fit a single packet and `compress' is set, it is compressed first (needs bzip2).
+ */
+bool ssq_bench_corpus_split(const SSQ_BENCH_RESPONSE *response, uint16_t split_size, bool compress, SSQ_BENCH_DATAGRAMS *datagrams);
+void ssq_bench_corpus_free_datagrams(SSQ_BENCH_DATAGRAMS *datagrams);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !CORPUS_H */
@@ -0,0 +1,353 @@
+#include "fake.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+# include <arpa/inet.h>
+# include <netinet/in.h>
+# include <sys/select.h>
+#endif /* !_WIN32 */
+
+#include "ssq/a2s.h"
+
+#include "clock.h"
+#include "corpus.h"
+#include "packet.h"
+#include "response.h"
+#include "socket.h"
+#include "thread.h"
+
+#define A2S_HEADER_INFO   0x54
+#define A2S_HEADER_PLAYER 0x55
+#define A2S_HEADER_RULES  0x56
+
+/* Offset of the challenge in each query ("\xFF\xFF\xFF\xFFTSource Engine Query\0" for A2S_INFO). */
+#define A2S_INFO_CHALL_OFFSET  25
+#define A2S_OTHER_CHALL_OFFSET 5
+
+#define S2A_CHALL_LEN 9
+
+/* Longest the server waits before looking at the stop flag again. */
+#define SSQ_FAKE_POLL_MS 20
+
+typedef struct ssq_fake_datagram {
+    uint64_t                due;                   /* When the datagram is to be sent.   */
+    SOCKET                  sockfd;                /* The socket to send it from.        */
+    struct sockaddr_storage addr;                  /* Address of the client.             */
+    socklen_t               addr_len;              /* Length of `addr'.                  */
+    size_t                  len;                   /* Length of the datagram.            */
+    uint8_t                 data[SSQ_PACKET_SIZE]; /* The datagram, packet header included. */
+} SSQ_FAKE_DATAGRAM;
+
+struct ssq_fake {
+    SSQ_FAKE_OPTIONS    options;                       /* How the server behaves.                        */
+    SOCKET              sockets[SSQ_FAKE_PORTS_MAX];   /* One socket per port.                           */
+    uint16_t            ports[SSQ_FAKE_PORTS_MAX];     /* The ports actually bound.                      */
+    size_t              socket_count;                  /* Number of sockets opened.                      */
+    SSQ_BENCH_RESPONSE  corpus[SSQ_BENCH_CORPUS_COUNT]; /* The responses the answers are taken from.     */
+    SSQ_BENCH_DATAGRAMS answers[3];                    /* The datagrams of each answer, by query kind.   */
+    uint32_t            secret;                        /* Mixed into the challenges handed out.          */
+    uint32_t            rand_state;                    /* State of the loss, reorder and jitter rolls.   */
+    int32_t             next_id;                       /* Unique number of the next split answer.        */
+    volatile uint64_t   requests;                      /* Number of requests received.                   */
+    SSQ_FAKE_DATAGRAM  *delayed;                       /* Min-heap of the datagrams waiting to be sent.  */
+    size_t              delayed_count;                 /* Number of datagrams in `delayed'.              */
+    size_t              delayed_size;                  /* Number of datagrams allocated for `delayed'.   */
+    SSQ_MUTEX           mutex;                         /* Protects `stopping'.                           */
+    bool                stopping;                      /* Whether the thread must exit.                  */
+    SSQ_THREAD          thread;                        /* The thread answering the queries.              */
+};
+
+void ssq_fake_options_init(SSQ_FAKE_OPTIONS *options) {
+    memset(options, 0, sizeof (*options));
+    options->port_count = 1;
+    options->chall      = SSQ_FAKE_CHALL_ALL;
+    options->split_size = SSQ_BENCH_SPLIT_SIZE;
+}
+
+static uint32_t ssq_fake_rand(SSQ_FAKE *fake) {
+    fake->rand_state = fake->rand_state * 1664525 + 1013904223;
+    return fake->rand_state >> 8;
+}
+
+static bool ssq_fake_roll(SSQ_FAKE *fake, unsigned percentage) {
+    return percentage != 0 && ssq_fake_rand(fake) % 100 < percentage;
+}
+
+/* Challenges are derived from the client's IP address (like Source servers), so that they need not be remembered. */
+static int32_t ssq_fake_chall(const SSQ_FAKE *fake, const struct sockaddr_storage *addr) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+    const uint8_t *bytes = (const uint8_t *)&in->sin_addr;
+    uint32_t hash = 2166136261u ^ fake->secret;
+    for (size_t i = 0; i < sizeof (in->sin_addr); ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return (int32_t)(hash & 0x7FFFFFFF);
+}
+
+static void ssq_fake_sendto(const SSQ_FAKE_DATAGRAM *datagram) {
+#ifdef _WIN32
+    sendto(datagram->sockfd, (const char *)datagram->data, (int)datagram->len, 0, (const struct sockaddr *)&datagram->addr, datagram->addr_len);
+#else /* !_WIN32 */
+    sendto(datagram->sockfd, datagram->data, datagram->len, 0, (const struct sockaddr *)&datagram->addr, datagram->addr_len);
+#endif /* _WIN32 */
+}
+
+static bool ssq_fake_delayed_before(const SSQ_FAKE *fake, size_t a, size_t b) {
+    return fake->delayed[a].due < fake->delayed[b].due;
+}
+
+static void ssq_fake_delayed_swap(SSQ_FAKE *fake, size_t a, size_t b) {
+    SSQ_FAKE_DATAGRAM tmp = fake->delayed[a];
+    fake->delayed[a] = fake->delayed[b];
+    fake->delayed[b] = tmp;
+}
+
+static void ssq_fake_delayed_push(SSQ_FAKE *fake, const SSQ_FAKE_DATAGRAM *datagram) {
+    if (fake->delayed_count == fake->delayed_size) {
+        size_t size = (fake->delayed_size != 0) ? fake->delayed_size * 2 : 64;
+        SSQ_FAKE_DATAGRAM *delayed = realloc(fake->delayed, size * sizeof (*delayed));
+        if (delayed == NULL)
+            return; // Dropped, just like an overflowing socket buffer would.
+        fake->delayed      = delayed;
+        fake->delayed_size = size;
+    }
+    size_t i = fake->delayed_count++;
+    fake->delayed[i] = *datagram;
+    while (i != 0 && ssq_fake_delayed_before(fake, i, (i - 1) / 2)) {
+        ssq_fake_delayed_swap(fake, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void ssq_fake_delayed_pop(SSQ_FAKE *fake) {
+    fake->delayed[0] = fake->delayed[--fake->delayed_count];
+    size_t i = 0;
+    for (;;) {
+        size_t smallest = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < fake->delayed_count; ++child) {
+            if (ssq_fake_delayed_before(fake, child, smallest))
+                smallest = child;
+        }
+        if (smallest == i)
+            break;
+        ssq_fake_delayed_swap(fake, i, smallest);
+        i = smallest;
+    }
+}
+
+/* Sends the datagrams that are due; returns how long until the next one is, in nanoseconds. */
+static uint64_t ssq_fake_flush(SSQ_FAKE *fake) {
+    uint64_t now = ssq_bench_clock_ns();
+    while (fake->delayed_count != 0 && fake->delayed[0].due <= now) {
+        ssq_fake_sendto(&fake->delayed[0]);
+        ssq_fake_delayed_pop(fake);
+    }
+    return (fake->delayed_count != 0) ? fake->delayed[0].due - now : UINT64_MAX;
+}
+
+static void ssq_fake_send(SSQ_FAKE *fake, SOCKET sockfd, const uint8_t data[], size_t len, const struct sockaddr_storage *addr, socklen_t addr_len) {
+    if (ssq_fake_roll(fake, fake->options.loss))
+        return;
+    SSQ_FAKE_DATAGRAM datagram;
+    datagram.sockfd   = sockfd;
+    datagram.addr     = *addr;
+    datagram.addr_len = addr_len;
+    datagram.len      = len;
+    memcpy(datagram.data, data, len);
+    uint64_t delay_ms = fake->options.latency;
+    if (fake->options.jitter != 0)
+        delay_ms += ssq_fake_rand(fake) % (fake->options.jitter + 1);
+    if (delay_ms == 0) {
+        ssq_fake_sendto(&datagram);
+        return;
+    }
+    datagram.due = ssq_bench_clock_ns() + delay_ms * 1000000;
+    ssq_fake_delayed_push(fake, &datagram);
+}
+
+static void ssq_fake_answer(SSQ_FAKE *fake, SOCKET sockfd, const uint8_t query[], size_t query_len, const struct sockaddr_storage *addr, socklen_t addr_len) {
+    if (query_len <= SSQ_PACKET_HEADER_LEN || memcmp(query, "\xFF\xFF\xFF\xFF", SSQ_PACKET_HEADER_LEN) != 0)
+        return;
+    A2S_QUERY_KIND kind;
+    size_t chall_offset = A2S_OTHER_CHALL_OFFSET;
+    bool needs_chall;
+    switch (query[SSQ_PACKET_HEADER_LEN]) {
+        case A2S_HEADER_INFO:
+            kind = A2S_QUERY_INFO;
+            chall_offset = A2S_INFO_CHALL_OFFSET;
+            needs_chall = (fake->options.chall == SSQ_FAKE_CHALL_ALL);
+            break;
+        case A2S_HEADER_PLAYER:
+            kind = A2S_QUERY_PLAYER;
+            needs_chall = (fake->options.chall != SSQ_FAKE_CHALL_NONE);
+            break;
+        case A2S_HEADER_RULES:
+            kind = A2S_QUERY_RULES;
+            needs_chall = (fake->options.chall != SSQ_FAKE_CHALL_NONE);
+            break;
+        default:
+            return;
+    }
+    int32_t expected = ssq_fake_chall(fake, addr);
+    int32_t chall = -1;
+    if (query_len >= chall_offset + sizeof (chall))
+        memcpy(&chall, query + chall_offset, sizeof (chall));
+    if (needs_chall && chall != expected) {
+        uint8_t reply[S2A_CHALL_LEN] = { 0xFF, 0xFF, 0xFF, 0xFF, S2A_HEADER_CHALL };
+        memcpy(reply + SSQ_PACKET_HEADER_LEN + 1, &expected, sizeof (expected));
+        ssq_fake_send(fake, sockfd, reply, sizeof (reply), addr, addr_len);
+        return;
+    }
+    const SSQ_BENCH_DATAGRAMS *answer = &fake->answers[kind];
+    uint8_t order[UINT8_MAX];
+    for (size_t i = 0; i < answer->count; ++i)
+        order[i] = (uint8_t)i;
+    if (answer->count > 1 && ssq_fake_roll(fake, fake->options.reorder)) {
+        for (size_t i = answer->count - 1; i > 0; --i) {
+            size_t j = ssq_fake_rand(fake) % (i + 1);
+            uint8_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+    int32_t id = (fake->next_id++ & 0x7FFFFFFF) | (fake->options.compress ? (int32_t)SSQ_PACKET_FLAG_COMPRESSION : 0);
+    for (size_t i = 0; i < answer->count; ++i) {
+        uint8_t datagram[SSQ_PACKET_SIZE];
+        size_t len = answer->lens[order[i]];
+        memcpy(datagram, answer->data[order[i]], len);
+        if (answer->count > 1)
+            memcpy(datagram + SSQ_PACKET_HEADER_LEN, &id, sizeof (id));
+        ssq_fake_send(fake, sockfd, datagram, len, addr, addr_len);
+    }
+}
+
+static bool ssq_fake_stopping(SSQ_FAKE *fake) {
+    ssq_mutex_lock(&fake->mutex);
+    bool stopping = fake->stopping;
+    ssq_mutex_unlock(&fake->mutex);
+    return stopping;
+}
+
+static void ssq_fake_run(void *arg) {
+    SSQ_FAKE *fake = arg;
+    while (!ssq_fake_stopping(fake)) {
+        uint64_t wait_ns = ssq_fake_flush(fake);
+        if (wait_ns > (uint64_t)SSQ_FAKE_POLL_MS * 1000000)
+            wait_ns = (uint64_t)SSQ_FAKE_POLL_MS * 1000000;
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        SOCKET maxfd = 0;
+        for (size_t i = 0; i < fake->socket_count; ++i) {
+            FD_SET(fake->sockets[i], &readfds);
+            if (fake->sockets[i] > maxfd)
+                maxfd = fake->sockets[i];
+        }
+        struct timeval tv;
+        tv.tv_sec  = 0;
+        tv.tv_usec = (long)(wait_ns / 1000);
+        if (select((int)maxfd + 1, &readfds, NULL, NULL, &tv) <= 0)
+            continue;
+        for (size_t i = 0; i < fake->socket_count; ++i) {
+            if (!FD_ISSET(fake->sockets[i], &readfds))
+                continue;
+            for (;;) {
+                uint8_t query[SSQ_PACKET_SIZE];
+                struct sockaddr_storage addr;
+                socklen_t addr_len = sizeof (addr);
+#ifdef _WIN32
+                int query_len = recvfrom(fake->sockets[i], (char *)query, sizeof (query), 0, (struct sockaddr *)&addr, &addr_len);
+#else /* !_WIN32 */
+                ssize_t query_len = recvfrom(fake->sockets[i], query, sizeof (query), 0, (struct sockaddr *)&addr, &addr_len);
+#endif /* _WIN32 */
+                if (query_len <= 0)
+                    break;
+                ssq_atomic_add(&fake->requests, 1);
+                ssq_fake_answer(fake, fake->sockets[i], query, (size_t)query_len, &addr, addr_len);
+            }
+        }
+    }
+}
+
+static bool ssq_fake_open(SSQ_FAKE *fake) {
+    for (size_t i = 0; i < fake->options.port_count; ++i) {
+        SOCKET sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sockfd == INVALID_SOCKET)
+            return false;
+        fake->sockets[fake->socket_count++] = sockfd;
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof (addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port        = htons((fake->options.port != 0) ? (uint16_t)(fake->options.port + i) : 0);
+        socklen_t addr_len = sizeof (addr);
+        int rcvbuf = 4 * 1024 * 1024;
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf, sizeof (rcvbuf));
+        if (bind(sockfd, (struct sockaddr *)&addr, sizeof (addr)) != 0
+            || getsockname(sockfd, (struct sockaddr *)&addr, &addr_len) != 0
+            || !ssq_socket_set_nonblocking(sockfd))
+            return false;
+        fake->ports[i] = ntohs(addr.sin_port);
+    }
+    return true;
+}
+
+static bool ssq_fake_prepare(SSQ_FAKE *fake) {
+    if (!ssq_bench_corpus_build(fake->corpus))
+        return false;
+    const SSQ_BENCH_CORPUS_ID ids[3] = {
+        [A2S_QUERY_INFO]   = SSQ_BENCH_INFO_EDF_ALL,
+        [A2S_QUERY_PLAYER] = SSQ_BENCH_PLAYER_64,
+        [A2S_QUERY_RULES]  = fake->options.huge_rules ? SSQ_BENCH_RULES_HUGE : SSQ_BENCH_RULES_SMALL,
+    };
+    for (size_t kind = 0; kind < 3; ++kind) {
+        if (!ssq_bench_corpus_split(&fake->corpus[ids[kind]], fake->options.split_size, fake->options.compress, &fake->answers[kind]))
+            return false;
+    }
+    return true;
+}
+
+static void ssq_fake_free(SSQ_FAKE *fake) {
+    for (size_t i = 0; i < fake->socket_count; ++i)
+        closesocket(fake->sockets[i]);
+    for (size_t kind = 0; kind < 3; ++kind)
+        ssq_bench_corpus_free_datagrams(&fake->answers[kind]);
+    ssq_bench_corpus_free(fake->corpus);
+    free(fake->delayed);
+    ssq_mutex_destroy(&fake->mutex);
+    free(fake);
+}
+
+SSQ_FAKE *ssq_fake_start(const SSQ_FAKE_OPTIONS *options) {
+    if (options->port_count == 0 || options->port_count > SSQ_FAKE_PORTS_MAX
+        || options->split_size < 64 || options->split_size > SSQ_PACKET_SIZE - SSQ_PACKET_MULTI_HEADER_LEN
+        || options->loss > 100 || options->reorder > 100)
+        return NULL;
+    SSQ_FAKE *fake = calloc(1, sizeof (*fake));
+    if (fake == NULL)
+        return NULL;
+    fake->options    = *options;
+    fake->secret     = (uint32_t)ssq_bench_clock_ns();
+    fake->rand_state = fake->secret;
+    ssq_mutex_init(&fake->mutex);
+    if (!ssq_fake_prepare(fake) || !ssq_fake_open(fake) || !ssq_thread_start(&fake->thread, ssq_fake_run, fake)) {
+        ssq_fake_free(fake);
+        return NULL;
+    }
+    return fake;
+}
+
+void ssq_fake_stop(SSQ_FAKE *fake) {
+    ssq_mutex_lock(&fake->mutex);
+    fake->stopping = true;
+    ssq_mutex_unlock(&fake->mutex);
+    ssq_thread_join(fake->thread);
+    ssq_fake_free(fake);
+}
+
+uint16_t ssq_fake_port(const SSQ_FAKE *fake, size_t i) {
+    return fake->ports[i];
+}
+
+uint64_t ssq_fake_requests(const SSQ_FAKE *fake) {
+    return ssq_atomic_load(&fake->requests);
+}
@@ -0,0 +1,52 @@
+#ifndef FAKE_H
+#define FAKE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest number of ports a fake server listens on. */
+#define SSQ_FAKE_PORTS_MAX 512
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum ssq_fake_chall {
+    SSQ_FAKE_CHALL_NONE,         /* Every query is answered right away.                  */
+    SSQ_FAKE_CHALL_PLAYER_RULES, /* A2S_PLAYER and A2S_RULES need a challenge.           */
+    SSQ_FAKE_CHALL_ALL,          /* Every query needs a challenge (current Source games). */
+} SSQ_FAKE_CHALL;
+
+typedef struct ssq_fake_options {
+    uint16_t       port;       /* First port to listen on, or 0 for any free ports.          */
+    size_t         port_count; /* Number of ports to listen on (e.g. one per batch target). */
+    SSQ_FAKE_CHALL chall;      /* Which queries need a challenge.                            */
+    uint16_t       split_size; /* Payload size of the packets of split responses.           */
+    bool           compress;   /* Whether split responses are bzip2-compressed.             */
+    bool           huge_rules; /* Whether to answer with a huge rules list.                 */
+    unsigned       loss;       /* Percentage of datagrams dropped.                           */
+    unsigned       reorder;    /* Percentage of split responses sent out of order.           */
+    unsigned       latency;    /* Delay added to every datagram sent, in milliseconds.       */
+    unsigned       jitter;     /* Random extra delay of every datagram, in milliseconds.     */
+} SSQ_FAKE_OPTIONS;
+
+/* Loopback A2S server answering from the benchmark corpus on a thread of its own. */
+typedef struct ssq_fake SSQ_FAKE;
+
+void      ssq_fake_options_init(SSQ_FAKE_OPTIONS *options);
+
+/* Starts answering on 127.0.0.1; returns NULL if the options are invalid or the ports are taken. */
+SSQ_FAKE *ssq_fake_start(const SSQ_FAKE_OPTIONS *options);
+void      ssq_fake_stop(SSQ_FAKE *fake);
+
+/* The `i'-th port the fake server listens on. */
+uint16_t  ssq_fake_port(const SSQ_FAKE *fake, size_t i);
+/* Number of requests received so far, challenge requests and retransmissions included. */
+uint64_t  ssq_fake_requests(const SSQ_FAKE *fake);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !FAKE_H */
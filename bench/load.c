@@ -0,0 +1,562 @@
+/*
+ * load.c -- End-to-end load benchmark against a loopback fake server.
+ *
+ * Usage: ssq_load [OPTION...]
+ *
+ *   -m MODE         `blocking' (one thread and one server per unit of concurrency), `batch'
+ *                   (a single batch with one target per unit of concurrency), `sweep' (rounds of
+ *                   a sweep with one thread per unit of concurrency over a server shared by every
+ *                   target) or `cache' (one thread per unit of concurrency asking a shared cache
+ *                   about a single server); blocking by default
+ *   -c CONCURRENCY  Number of queries in flight (8 by default)
+ *   -d SECONDS      Duration of the run (5 by default)
+ *   -q QUERY        `info', `player', `rules' or `all' (in turns); info by default
+ *   -T MILLIS       Timeout of a query (1000 by default)
+ *   -R COUNT        Retransmissions of a blocking query (SSQ_RETRANSMIT_DEFAULT by default)
+ *   -t MILLIS       How long results stay fresh in the cache (SSQ_CACHE_TTL_DEFAULT by default)
+ *   -a HOST:PORT    Query this server instead of starting the fake server
+ *   -S              Only run the fake server (for other clients) for the duration of the run
+ *   -M              Report the global counters of the library (see ssq/metrics.h)
+ *
+ * Fake server options:
+ *
+ *   -C CHALL        Which queries need a challenge: `none', `player' (A2S_PLAYER and A2S_RULES)
+ *                   or `all'; all by default
+ *   -s SIZE         Payload size of split packets (1248 by default)
+ *   -z              Compress split responses with bzip2
+ *   -H              Answer A2S_RULES with a huge rules list (2000 rules)
+ *   -l PERCENT      Datagrams dropped
+ *   -r PERCENT      Split responses sent out of order
+ *   -L MILLIS       Latency added to every datagram
+ *   -j MILLIS       Random extra latency of every datagram
+ *
+ * The report is made of `key: value' lines: the number of queries, the queries per second, the
+ * latency percentiles of the successful queries and the failures by error code, then the number
+ * of requests the fake server received and, with -M, the counters of the library.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssq/a2s.h"
+#include "ssq/batch.h"
+#include "ssq/cache.h"
+#include "ssq/metrics.h"
+#include "ssq/sweep.h"
+#include "ssq/server.h"
+
+#include "clock.h"
+#include "fake.h"
+#include "thread.h"
+
+#define SSQ_LOAD_ERROR_CODES (SSQE_INVALID_ARGUMENT + 1)
+
+/* Targets of a sweep round per thread. */
+#define SSQ_LOAD_SWEEP_ROUND 16
+
+typedef enum ssq_load_query {
+    SSQ_LOAD_QUERY_INFO   = A2S_QUERY_INFO,
+    SSQ_LOAD_QUERY_PLAYER = A2S_QUERY_PLAYER,
+    SSQ_LOAD_QUERY_RULES  = A2S_QUERY_RULES,
+    SSQ_LOAD_QUERY_ALL,
+} SSQ_LOAD_QUERY;
+
+typedef enum ssq_load_mode {
+    SSQ_LOAD_MODE_BLOCKING,
+    SSQ_LOAD_MODE_BATCH,
+    SSQ_LOAD_MODE_SWEEP,
+    SSQ_LOAD_MODE_CACHE,
+} SSQ_LOAD_MODE;
+
+typedef struct ssq_load_options {
+    SSQ_LOAD_MODE    mode;        /* Which API the queries go through.             */
+    size_t           concurrency; /* Number of queries in flight.                  */
+    uint64_t         duration;    /* Duration of the run, in milliseconds.         */
+    SSQ_LOAD_QUERY   query;       /* The queries to send.                          */
+    uint64_t         timeout;     /* Timeout of a query, in milliseconds.          */
+    unsigned         retransmits; /* Retransmissions of a blocking query.          */
+    uint64_t         ttl;         /* How long results stay fresh in the cache.     */
+    const char      *hostname;    /* Server to query instead of the fake, if any.  */
+    uint16_t         port;        /* Port of `hostname'.                           */
+    bool             serve_only;  /* Whether to only run the fake server.          */
+    bool             metrics;     /* Whether to report the library counters.       */
+    SSQ_FAKE_OPTIONS fake;        /* How the fake server behaves.                  */
+} SSQ_LOAD_OPTIONS;
+
+/* What a worker measured; merged into a single report at the end of the run. */
+typedef struct ssq_load_stats {
+    uint64_t *latencies;                       /* Latency of each successful query, in ns. */
+    size_t    latency_count;                   /* Number of entries in `latencies'.        */
+    size_t    latency_size;                    /* Number of entries allocated.             */
+    size_t    failures[SSQ_LOAD_ERROR_CODES];  /* Number of failed queries by error code.  */
+} SSQ_LOAD_STATS;
+
+typedef struct ssq_load_worker {
+    const SSQ_LOAD_OPTIONS *options;  /* Options of the run.                    */
+    uint16_t                port;     /* Port of the server to query.           */
+    size_t                  offset;   /* Turn of the first query, for `all'.    */
+    uint64_t                deadline; /* When to stop sending queries.          */
+    uint64_t                started;  /* When the current round started.        */
+    SSQ_MUTEX               mutex;    /* Protects the stats during a sweep.     */
+    SSQ_CACHE              *cache;    /* The cache shared by the workers.       */
+    SSQ_SERVER             *server;   /* The server shared by the workers.      */
+    SSQ_LOAD_STATS          stats;    /* What the worker measured.              */
+    SSQ_THREAD              thread;   /* The thread of the worker.              */
+} SSQ_LOAD_WORKER;
+
+static const char *const ssq_load_error_names[SSQ_LOAD_ERROR_CODES] = {
+    [SSQE_OK]               = "SSQE_OK",
+    [SSQE_SYSTEM]           = "SSQE_SYSTEM",
+    [SSQE_INVALID_RESPONSE] = "SSQE_INVALID_RESPONSE",
+    [SSQE_UNSUPPORTED]      = "SSQE_UNSUPPORTED",
+    [SSQE_GAI]              = "SSQE_GAI",
+    [SSQE_NO_SOCKET]        = "SSQE_NO_SOCKET",
+    [SSQE_TIMEOUT]          = "SSQE_TIMEOUT",
+    [SSQE_BUFFER_TOO_SMALL] = "SSQE_BUFFER_TOO_SMALL",
+    [SSQE_INVALID_ARGUMENT] = "SSQE_INVALID_ARGUMENT",
+};
+
+static void ssq_load_record(SSQ_LOAD_STATS *stats, SSQ_ERROR_CODE code, uint64_t latency) {
+    if (code != SSQE_OK) {
+        ++stats->failures[((size_t)code < SSQ_LOAD_ERROR_CODES) ? code : SSQE_SYSTEM];
+        return;
+    }
+    if (stats->latency_count == stats->latency_size) {
+        size_t size = (stats->latency_size != 0) ? stats->latency_size * 2 : 1024;
+        uint64_t *latencies = realloc(stats->latencies, size * sizeof (*latencies));
+        if (latencies == NULL)
+            return;
+        stats->latencies    = latencies;
+        stats->latency_size = size;
+    }
+    stats->latencies[stats->latency_count++] = latency;
+}
+
+static A2S_QUERY_KIND ssq_load_kind(SSQ_LOAD_QUERY query, size_t turn) {
+    return (query == SSQ_LOAD_QUERY_ALL) ? (A2S_QUERY_KIND)(turn % 3) : (A2S_QUERY_KIND)query;
+}
+
+/* Sends one blocking query; returns how it went. */
+static SSQ_ERROR_CODE ssq_load_query(SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    switch (kind) {
+        case A2S_QUERY_INFO:
+            ssq_info_free(ssq_info(server));
+            break;
+        case A2S_QUERY_PLAYER: {
+            uint8_t player_count = 0;
+            A2S_PLAYER *players = ssq_player(server, &player_count);
+            ssq_player_free(players, player_count);
+            break;
+        }
+        case A2S_QUERY_RULES: {
+            uint16_t rule_count = 0;
+            A2S_RULES *rules = ssq_rules(server, &rule_count);
+            ssq_rules_free(rules, rule_count);
+            break;
+        }
+    }
+    SSQ_ERROR_CODE code = ssq_server_ecode(server);
+    ssq_server_eclr(server);
+    return code;
+}
+
+static void ssq_load_blocking_worker(void *arg) {
+    SSQ_LOAD_WORKER *worker = arg;
+    const SSQ_LOAD_OPTIONS *options = worker->options;
+    SSQ_SERVER *server = ssq_server_new(options->hostname, worker->port);
+    if (server == NULL) {
+        ssq_load_record(&worker->stats, SSQE_SYSTEM, 0);
+        return;
+    }
+    if (!ssq_server_eok(server)) {
+        ssq_load_record(&worker->stats, ssq_server_ecode(server), 0);
+        ssq_server_free(server);
+        return;
+    }
+    ssq_server_timeout(server, SSQ_TIMEOUT_RECV | SSQ_TIMEOUT_SEND, options->timeout);
+    ssq_server_retransmit(server, options->retransmits);
+    for (size_t turn = worker->offset; ssq_bench_clock_ns() < worker->deadline; ++turn) {
+        uint64_t start = ssq_bench_clock_ns();
+        SSQ_ERROR_CODE code = ssq_load_query(server, ssq_load_kind(options->query, turn));
+        ssq_load_record(&worker->stats, code, ssq_bench_clock_ns() - start);
+    }
+    ssq_server_free(server);
+}
+
+static void ssq_load_cache_worker(void *arg) {
+    SSQ_LOAD_WORKER *worker = arg;
+    for (size_t turn = worker->offset; ssq_bench_clock_ns() < worker->deadline; ++turn) {
+        uint64_t start = ssq_bench_clock_ns();
+        SSQ_CALL call;
+        ssq_result_free(ssq_cache_get(worker->cache, worker->server, ssq_load_kind(worker->options->query, turn), &call));
+        ssq_load_record(&worker->stats, call.code, ssq_bench_clock_ns() - start);
+    }
+}
+
+static void ssq_load_batch_callback(SSQ_SERVER *server, size_t index, SSQ_BATCH_RESULT *result, void *data) {
+    (void)index;
+    SSQ_LOAD_WORKER *worker = data;
+    SSQ_ERROR_CODE code = ssq_server_ecode(server);
+    ssq_load_record(&worker->stats, code, ssq_bench_clock_ns() - worker->started);
+    ssq_info_free(result->info);
+    ssq_player_free(result->players, result->player_count);
+    ssq_rules_free(result->rules, result->rule_count);
+}
+
+/* Runs rounds of batches over every target; the latency of a query is measured from the start of its round. */
+static bool ssq_load_run_batch(SSQ_LOAD_WORKER *worker, SSQ_SERVER *const servers[]) {
+    const SSQ_LOAD_OPTIONS *options = worker->options;
+    SSQ_BATCH *batches[3] = { NULL, NULL, NULL };
+    bool ok = true;
+    for (size_t kind = 0; kind < 3 && ok; ++kind) {
+        batches[kind] = ssq_batch_new((A2S_QUERY_KIND)kind);
+        ok = (batches[kind] != NULL);
+        if (ok)
+            ssq_batch_timeout(batches[kind], options->timeout);
+    }
+    for (size_t turn = 0; ok && ssq_bench_clock_ns() < worker->deadline; ++turn) {
+        SSQ_BATCH *batch = batches[ssq_load_kind(options->query, turn)];
+        worker->started = ssq_bench_clock_ns();
+        ok = ssq_batch_run(batch, servers, options->concurrency, ssq_load_batch_callback, worker);
+        if (!ok)
+            fprintf(stderr, "Batch failed: %s\n", ssq_batch_emsg(batch));
+    }
+    for (size_t kind = 0; kind < 3; ++kind)
+        ssq_batch_free(batches[kind]);
+    return ok;
+}
+
+static bool ssq_load_batch(SSQ_LOAD_WORKER *worker, const SSQ_FAKE *fake) {
+    const SSQ_LOAD_OPTIONS *options = worker->options;
+    SSQ_SERVER **servers = calloc(options->concurrency, sizeof (*servers));
+    bool ok = (servers != NULL);
+    for (size_t i = 0; ok && i < options->concurrency; ++i) {
+        // Queries to the same address are never in flight together, hence a port per target.
+        uint16_t port = (fake != NULL) ? ssq_fake_port(fake, i) : options->port;
+        servers[i] = ssq_server_new(options->hostname, port);
+        ok = (servers[i] != NULL && ssq_server_eok(servers[i]));
+    }
+    if (ok)
+        ok = ssq_load_run_batch(worker, servers);
+    else
+        fprintf(stderr, "Could not create the batch targets\n");
+    for (size_t i = 0; servers != NULL && i < options->concurrency; ++i)
+        ssq_server_free(servers[i]);
+    free(servers);
+    return ok;
+}
+
+static void ssq_load_sweep_callback(const SSQ_SWEEP_TARGET *target, size_t index, SSQ_RESULT *result, const SSQ_CALL *call, void *data) {
+    (void)target;
+    (void)index;
+    SSQ_LOAD_WORKER *worker = data;
+    uint64_t latency = ssq_bench_clock_ns() - worker->started;
+    ssq_result_free(result);
+    ssq_mutex_lock(&worker->mutex);
+    ssq_load_record(&worker->stats, call->code, latency);
+    ssq_mutex_unlock(&worker->mutex);
+}
+
+/* Runs rounds of a sweep over a single server; the latency of a query is measured from the start of its round. */
+static bool ssq_load_sweep(SSQ_LOAD_WORKER *worker) {
+    const SSQ_LOAD_OPTIONS *options = worker->options;
+    size_t target_count = options->concurrency * SSQ_LOAD_SWEEP_ROUND;
+    SSQ_SWEEP_TARGET *targets = calloc(target_count, sizeof (*targets));
+    SSQ_SERVER *server = ssq_server_new(options->hostname, options->port);
+    SSQ_SWEEP *sweep = ssq_sweep_new(options->concurrency);
+    bool ok = (targets != NULL && server != NULL && ssq_server_eok(server) && sweep != NULL);
+    if (ok) {
+        ssq_server_timeout(server, SSQ_TIMEOUT_RECV | SSQ_TIMEOUT_SEND, options->timeout);
+        ssq_server_retransmit(server, options->retransmits);
+    } else {
+        fprintf(stderr, "Could not create the sweep\n");
+    }
+    ssq_mutex_init(&worker->mutex);
+    for (size_t turn = 0; ok && ssq_bench_clock_ns() < worker->deadline; ++turn) {
+        for (size_t i = 0; i < target_count; ++i) {
+            targets[i].server = server;
+            targets[i].kind   = ssq_load_kind(options->query, turn * target_count + i);
+        }
+        worker->started = ssq_bench_clock_ns();
+        ok = ssq_sweep_run(sweep, targets, target_count, ssq_load_sweep_callback, worker);
+        if (!ok)
+            fprintf(stderr, "Sweep failed: %s\n", ssq_sweep_emsg(sweep));
+    }
+    ssq_mutex_destroy(&worker->mutex);
+    ssq_sweep_free(sweep);
+    ssq_server_free(server);
+    free(targets);
+    return ok;
+}
+
+static int ssq_load_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double ssq_load_percentile_ms(const SSQ_LOAD_STATS *stats, double percentile) {
+    if (stats->latency_count == 0)
+        return 0;
+    size_t rank = (size_t)(percentile / 100 * (double)(stats->latency_count - 1) + 0.5);
+    return (double)stats->latencies[rank] / 1e6;
+}
+
+static void ssq_load_report(const SSQ_LOAD_OPTIONS *options, SSQ_LOAD_STATS *stats, uint64_t elapsed_ns) {
+    static const char *const modes[]   = { "blocking", "batch", "sweep", "cache" };
+    static const char *const queries[] = { "info", "player", "rules", "all" };
+    size_t failed = 0;
+    for (size_t code = 0; code < SSQ_LOAD_ERROR_CODES; ++code)
+        failed += stats->failures[code];
+    size_t total = stats->latency_count + failed;
+    double seconds = (double)elapsed_ns / 1e9;
+    qsort(stats->latencies, stats->latency_count, sizeof (*stats->latencies), ssq_load_compare);
+    printf("mode: %s\n", modes[options->mode]);
+    printf("query: %s\n", queries[options->query]);
+    printf("concurrency: %zu\n", options->concurrency);
+    printf("duration_s: %.3f\n", seconds);
+    printf("queries: %zu\n", total);
+    printf("succeeded: %zu\n", stats->latency_count);
+    printf("failed: %zu\n", failed);
+    printf("qps: %.1f\n", (double)stats->latency_count / seconds);
+    printf("latency_ms: p50=%.3f p90=%.3f p99=%.3f p99.9=%.3f max=%.3f\n",
+           ssq_load_percentile_ms(stats, 50), ssq_load_percentile_ms(stats, 90), ssq_load_percentile_ms(stats, 99),
+           ssq_load_percentile_ms(stats, 99.9), ssq_load_percentile_ms(stats, 100));
+    printf("failures:");
+    for (size_t code = 0; code < SSQ_LOAD_ERROR_CODES; ++code) {
+        if (stats->failures[code] != 0)
+            printf(" %s=%zu", ssq_load_error_names[code], stats->failures[code]);
+    }
+    printf("\n");
+}
+
+static void ssq_load_report_metrics(void) {
+    SSQ_METRICS metrics;
+    ssq_metrics_get(&metrics);
+    printf("metrics: queries=%" PRIu64 " challenges=%" PRIu64 " retransmits=%" PRIu64 " fragments=%" PRIu64 " bytes=%" PRIu64 "\n",
+           metrics.queries, metrics.challenges, metrics.retransmits, metrics.fragments, metrics.bytes);
+    printf("metrics_failures: timeouts=%" PRIu64 " invalid_responses=%" PRIu64 " system_errors=%" PRIu64 "\n",
+           metrics.timeouts, metrics.invalid_responses, metrics.system_errors);
+    // Each bucket is named after the lower bound of its round-trip times, in milliseconds.
+    printf("rtt_ms:");
+    for (size_t i = 0; i < SSQ_METRICS_RTT_BUCKETS; ++i) {
+        if (metrics.rtt[i] != 0)
+            printf(" %" PRIu64 "=%" PRIu64, (i == 0) ? 0 : (uint64_t)1 << (i - 1), metrics.rtt[i]);
+    }
+    printf("\n");
+}
+
+static void ssq_load_merge(SSQ_LOAD_STATS *into, SSQ_LOAD_STATS *from) {
+    for (size_t code = 0; code < SSQ_LOAD_ERROR_CODES; ++code)
+        into->failures[code] += from->failures[code];
+    for (size_t i = 0; i < from->latency_count; ++i)
+        ssq_load_record(into, SSQE_OK, from->latencies[i]);
+    free(from->latencies);
+    memset(from, 0, sizeof (*from));
+}
+
+static void ssq_load_usage(const char program[]) {
+    fprintf(stderr,
+        "Usage: %s [-m blocking|batch|sweep|cache] [-c CONCURRENCY] [-d SECONDS] [-q info|player|rules|all]\n"
+        "       [-T MILLIS] [-R COUNT] [-t MILLIS] [-a HOST:PORT | -S] [-M] [-C none|player|all] [-s SIZE] [-z] [-H]\n"
+        "       [-l PERCENT] [-r PERCENT] [-L MILLIS] [-j MILLIS]\n", program);
+}
+
+static bool ssq_load_parse_enum(const char value[], const char *const names[], size_t name_count, int *result) {
+    for (size_t i = 0; i < name_count; ++i) {
+        if (strcmp(value, names[i]) == 0) {
+            *result = (int)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ssq_load_parse(int argc, char *argv[], SSQ_LOAD_OPTIONS *options) {
+    static const char *const modes[]   = { "blocking", "batch", "sweep", "cache" };
+    static const char *const queries[] = { "info", "player", "rules", "all" };
+    static const char *const challs[]  = { "none", "player", "all" };
+    memset(options, 0, sizeof (*options));
+    options->concurrency = 8;
+    options->duration    = 5000;
+    options->query       = SSQ_LOAD_QUERY_INFO;
+    options->timeout     = 1000;
+    options->retransmits = SSQ_RETRANSMIT_DEFAULT;
+    options->ttl         = SSQ_CACHE_TTL_DEFAULT;
+    options->hostname    = "127.0.0.1";
+    ssq_fake_options_init(&options->fake);
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0')
+            return false;
+        // Flags first, then the options taking a value.
+        switch (arg[1]) {
+            case 'S': options->serve_only      = true; continue;
+            case 'M': options->metrics         = true; continue;
+            case 'z': options->fake.compress   = true; continue;
+            case 'H': options->fake.huge_rules = true; continue;
+            default:  break;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        int choice;
+        switch (arg[1]) {
+            case 'm':
+                if (!ssq_load_parse_enum(value, modes, 4, &choice))
+                    return false;
+                options->mode = (SSQ_LOAD_MODE)choice;
+                break;
+            case 'c': options->concurrency = strtoul(value, NULL, 10);              break;
+            case 'd': options->duration    = strtoull(value, NULL, 10) * 1000;     break;
+            case 'T': options->timeout     = strtoull(value, NULL, 10);            break;
+            case 'R': options->retransmits = (unsigned)strtoul(value, NULL, 10);   break;
+            case 't': options->ttl         = strtoull(value, NULL, 10);            break;
+            case 's': options->fake.split_size = (uint16_t)strtoul(value, NULL, 10); break;
+            case 'l': options->fake.loss       = (unsigned)strtoul(value, NULL, 10); break;
+            case 'r': options->fake.reorder    = (unsigned)strtoul(value, NULL, 10); break;
+            case 'L': options->fake.latency    = (unsigned)strtoul(value, NULL, 10); break;
+            case 'j': options->fake.jitter     = (unsigned)strtoul(value, NULL, 10); break;
+            case 'q':
+                if (!ssq_load_parse_enum(value, queries, 4, &choice))
+                    return false;
+                options->query = (SSQ_LOAD_QUERY)choice;
+                break;
+            case 'C':
+                if (!ssq_load_parse_enum(value, challs, 3, &choice))
+                    return false;
+                options->fake.chall = (SSQ_FAKE_CHALL)choice;
+                break;
+            case 'a': {
+                static char hostname[256];
+                const char *colon = strrchr(value, ':');
+                if (colon == NULL || (size_t)(colon - value) >= sizeof (hostname))
+                    return false;
+                memcpy(hostname, value, (size_t)(colon - value));
+                hostname[colon - value] = '\0';
+                options->hostname = hostname;
+                options->port     = (uint16_t)strtoul(colon + 1, NULL, 10);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    if (options->concurrency == 0 || (options->mode == SSQ_LOAD_MODE_BATCH && options->concurrency > SSQ_FAKE_PORTS_MAX)
+        || (options->serve_only && options->port != 0))
+        return false;
+    options->fake.port_count = (options->mode == SSQ_LOAD_MODE_BATCH) ? options->concurrency : 1;
+    return true;
+}
+
+static void ssq_load_sleep_until(uint64_t deadline) {
+    for (uint64_t now; (now = ssq_bench_clock_ns()) < deadline;) {
+        uint64_t left_ms = (deadline - now) / 1000000 + 1;
+#ifdef _WIN32
+        Sleep((DWORD)left_ms);
+#else /* !_WIN32 */
+        struct timespec ts = { (time_t)(left_ms / 1000), (long)(left_ms % 1000) * 1000000 };
+        nanosleep(&ts, NULL);
+#endif /* _WIN32 */
+    }
+}
+
+int main(int argc, char *argv[]) {
+    SSQ_LOAD_OPTIONS options;
+    if (!ssq_load_parse(argc, argv, &options)) {
+        ssq_load_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        fprintf(stderr, "Could not initialize Winsock\n");
+        return EXIT_FAILURE;
+    }
+#endif /* _WIN32 */
+    SSQ_FAKE *fake = NULL;
+    if (options.port == 0) {
+        fake = ssq_fake_start(&options.fake);
+        if (fake == NULL) {
+            fprintf(stderr, "Could not start the fake server\n");
+            return EXIT_FAILURE;
+        }
+        options.port = ssq_fake_port(fake, 0);
+    }
+    printf("# ssq_load %s\n", SSQ_BENCH_VERSION);
+    uint64_t start = ssq_bench_clock_ns();
+    uint64_t deadline = start + options.duration * 1000000;
+    if (options.serve_only) {
+        printf("listening: 127.0.0.1:%" PRIu16 " (%zu ports)\n", options.port, options.fake.port_count);
+        fflush(stdout);
+        ssq_load_sleep_until(deadline);
+        ssq_fake_stop(fake);
+        return EXIT_SUCCESS;
+    }
+
+    ssq_metrics_enable(options.metrics);
+    bool ok = true;
+    SSQ_LOAD_STATS stats;
+    memset(&stats, 0, sizeof (stats));
+    if (options.mode == SSQ_LOAD_MODE_BATCH || options.mode == SSQ_LOAD_MODE_SWEEP) {
+        SSQ_LOAD_WORKER worker;
+        memset(&worker, 0, sizeof (worker));
+        worker.options  = &options;
+        worker.deadline = deadline;
+        ok = (options.mode == SSQ_LOAD_MODE_BATCH) ? ssq_load_batch(&worker, fake) : ssq_load_sweep(&worker);
+        ssq_load_merge(&stats, &worker.stats);
+    } else {
+        // In cache mode, every worker asks the same cache about the same server.
+        bool cached = (options.mode == SSQ_LOAD_MODE_CACHE);
+        SSQ_CACHE *cache = NULL;
+        SSQ_SERVER *server = NULL;
+        if (cached) {
+            cache  = ssq_cache_new(options.ttl, SSQ_CACHE_STALE_DEFAULT, 0);
+            server = ssq_server_new(options.hostname, options.port);
+            ok = (cache != NULL && server != NULL && ssq_server_eok(server));
+            if (ok) {
+                ssq_server_timeout(server, SSQ_TIMEOUT_RECV | SSQ_TIMEOUT_SEND, options.timeout);
+                ssq_server_retransmit(server, options.retransmits);
+            }
+        }
+        SSQ_LOAD_WORKER *workers = ok ? calloc(options.concurrency, sizeof (*workers)) : NULL;
+        size_t started = 0;
+        for (; workers != NULL && started < options.concurrency; ++started) {
+            workers[started].options  = &options;
+            workers[started].port     = options.port;
+            workers[started].offset   = started;
+            workers[started].deadline = deadline;
+            workers[started].cache    = cache;
+            workers[started].server   = server;
+            if (!ssq_thread_start(&workers[started].thread, cached ? ssq_load_cache_worker : ssq_load_blocking_worker, &workers[started]))
+                break;
+        }
+        ok = (started == options.concurrency);
+        for (size_t i = 0; i < started; ++i) {
+            ssq_thread_join(workers[i].thread);
+            ssq_load_merge(&stats, &workers[i].stats);
+        }
+        free(workers);
+        // The cache goes first: its threads may still be refreshing a result of the server.
+        ssq_cache_free(cache);
+        ssq_server_free(server);
+        if (!ok)
+            fprintf(stderr, "Could not start the workers\n");
+    }
+    uint64_t elapsed = ssq_bench_clock_ns() - start;
+    uint64_t requests = 0;
+    if (fake != NULL) {
+        requests = ssq_fake_requests(fake);
+        ssq_fake_stop(fake);
+    }
+    if (ok) {
+        ssq_load_report(&options, &stats, elapsed);
+        if (fake != NULL)
+            printf("server_requests: %" PRIu64 "\n", requests);
+        if (options.metrics)
+            ssq_load_report_metrics();
+    }
+    free(stats.latencies);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
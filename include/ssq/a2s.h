@@ -1,3 +1,24 @@
+/* a2s.h -- A2S server queries. */
+
+#ifndef SSQ_A2S_H
+#define SSQ_A2S_H
+
 #include "ssq/a2s/info.h"
 #include "ssq/a2s/player.h"
 #include "ssq/a2s/rules.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum a2s_query_kind {
+    A2S_QUERY_INFO,
+    A2S_QUERY_PLAYER,
+    A2S_QUERY_RULES,
+} A2S_QUERY_KIND;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_A2S_H */
@@ -63,6 +63,19 @@ typedef struct a2s_info {
 } A2S_INFO;
 
 A2S_INFO *ssq_info(SSQ_SERVER *server);
+/*
+ * Same as `ssq_info', except that nothing is decoded when the response is byte for byte the one
+ * last decoded by a call of this kind on the server (as told by a 64-bit fingerprint of it): NULL
+ * is returned and `unchanged' set to true, so that the result of that call can be kept instead.
+ * Threads sharing a server keep a fingerprint each with `ssq_call_result_if_changed' instead.
+ */
+A2S_INFO *ssq_info_if_changed(SSQ_SERVER *server, bool *unchanged);
+/*
+ * Lays the result out in `buf' (aligned as if returned by malloc) instead of allocating it. The size the result
+ * needs is stored in `required', and SSQE_BUFFER_TOO_SMALL is reported when `buf_size' falls short of it.
+ * A result stored in a caller-supplied buffer must not be passed to `ssq_info_free'.
+ */
+A2S_INFO *ssq_info_into(SSQ_SERVER *server, void *buf, size_t buf_size, size_t *required);
 void      ssq_info_free(A2S_INFO *info);
 
 bool      ssq_info_has_gameid(const A2S_INFO *info);
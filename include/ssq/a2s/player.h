@@ -20,6 +20,10 @@ typedef struct a2s_player {
 } A2S_PLAYER;
 
 A2S_PLAYER *ssq_player(SSQ_SERVER *server, uint8_t *player_count);
+/* Same as `ssq_player' but skips unchanged responses (see `ssq_info_if_changed'). */
+A2S_PLAYER *ssq_player_if_changed(SSQ_SERVER *server, uint8_t *player_count, bool *unchanged);
+/* Same as `ssq_player' but stores the players in `buf' (see `ssq_info_into'); they must not be freed. */
+A2S_PLAYER *ssq_player_into(SSQ_SERVER *server, void *buf, size_t buf_size, uint8_t *player_count, size_t *required);
 void        ssq_player_free(A2S_PLAYER *players, uint8_t player_count);
 
 #ifdef __cplusplus
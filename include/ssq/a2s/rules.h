@@ -19,8 +19,44 @@ typedef struct a2s_rules {
 } A2S_RULES;
 
 A2S_RULES *ssq_rules(SSQ_SERVER *server, uint16_t *rule_count);
+/* Same as `ssq_rules' but skips unchanged responses (see `ssq_info_if_changed'). */
+A2S_RULES *ssq_rules_if_changed(SSQ_SERVER *server, uint16_t *rule_count, bool *unchanged);
+/* Same as `ssq_rules' but stores the rules in `buf' (see `ssq_info_into'); they must not be freed. */
+A2S_RULES *ssq_rules_into(SSQ_SERVER *server, void *buf, size_t buf_size, uint16_t *rule_count, size_t *required);
 void       ssq_rules_free(A2S_RULES *rules, uint16_t rule_count);
 
+/*
+ * Rules hashed by name once so that lookups take constant time and never allocate. Names are
+ * compared byte for byte; when a name occurs more than once, the first occurrence wins.
+ */
+typedef struct a2s_rules_index A2S_RULES_INDEX;
+
+/* Queries the rules of `server' and indexes them; the index owns the rules. */
+A2S_RULES_INDEX *ssq_rules_indexed(SSQ_SERVER *server);
+/* Indexes rules fetched beforehand; they are not copied and must outlive the index. */
+A2S_RULES_INDEX *ssq_rules_index_new(const A2S_RULES *rules, uint16_t rule_count);
+void             ssq_rules_index_free(A2S_RULES_INDEX *index);
+
+/* The indexed rules, in the order of the response. */
+const A2S_RULES *ssq_rules_index_rules(const A2S_RULES_INDEX *index, uint16_t *rule_count);
+
+/* Returns the rule named `name', or NULL if there is none. */
+const A2S_RULES *ssq_rules_find(const A2S_RULES_INDEX *index, const char *name);
+const A2S_RULES *ssq_rules_find_len(const A2S_RULES_INDEX *index, const char *name, size_t name_len);
+
+/*
+ * Counts the rules whose name starts with `prefix' and stores in `first' the position of the
+ * first of them in name order, so that they can be iterated over with `ssq_rules_sorted':
+ *
+ *     uint16_t first;
+ *     uint16_t count = ssq_rules_prefix(index, "mp_", 3, &first);
+ *     for (uint16_t i = first; i < first + count; ++i)
+ *         puts(ssq_rules_sorted(index, i)->name);
+ */
+uint16_t         ssq_rules_prefix(const A2S_RULES_INDEX *index, const char *prefix, size_t prefix_len, uint16_t *first);
+/* The `i'-th rule in byte order of the names. */
+const A2S_RULES *ssq_rules_sorted(const A2S_RULES_INDEX *index, uint16_t i);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,63 @@
+/* async.h -- Non-blocking A2S queries driven by an external event loop. */
+
+#ifndef SSQ_ASYNC_H
+#define SSQ_ASYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+#include "ssq/error.h"
+#include "ssq/server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#ifdef _WIN32
+typedef SOCKET SSQ_SOCKET;
+#else /* !_WIN32 */
+typedef int    SSQ_SOCKET;
+#endif /* _WIN32 */
+
+/* A query in progress; the server it was begun on must outlive it. */
+typedef struct ssq_async SSQ_ASYNC;
+
+typedef enum ssq_async_status {
+    SSQ_ASYNC_PENDING, /* Waiting for the socket to become readable or for the deadline. */
+    SSQ_ASYNC_DONE,    /* A response was received and the result can be retrieved.      */
+    SSQ_ASYNC_FAILED,  /* The query failed; see the error accessors.                     */
+} SSQ_ASYNC_STATUS;
+
+SSQ_ASYNC        *ssq_async_begin(SSQ_SERVER *server, A2S_QUERY_KIND kind);
+void              ssq_async_free(SSQ_ASYNC *async);
+
+SSQ_SOCKET        ssq_async_fd(const SSQ_ASYNC *async);
+/* UINT64_MAX when the receive timeout of the server is 0 (no timeout). */
+uint64_t          ssq_async_deadline(const SSQ_ASYNC *async);
+uint64_t          ssq_async_now(void);
+SSQ_ASYNC_STATUS  ssq_async_status(const SSQ_ASYNC *async);
+
+SSQ_ASYNC_STATUS  ssq_async_on_readable(SSQ_ASYNC *async);
+SSQ_ASYNC_STATUS  ssq_async_on_timeout(SSQ_ASYNC *async);
+
+A2S_INFO         *ssq_async_info(SSQ_ASYNC *async);
+A2S_PLAYER       *ssq_async_player(SSQ_ASYNC *async, uint8_t *player_count);
+A2S_RULES        *ssq_async_rules(SSQ_ASYNC *async, uint16_t *rule_count);
+
+/* The response is kept until the query is freed, so these may be retried with a larger buffer. */
+A2S_INFO         *ssq_async_info_into(SSQ_ASYNC *async, void *buf, size_t buf_size, size_t *required);
+A2S_PLAYER       *ssq_async_player_into(SSQ_ASYNC *async, void *buf, size_t buf_size, uint8_t *player_count, size_t *required);
+A2S_RULES        *ssq_async_rules_into(SSQ_ASYNC *async, void *buf, size_t buf_size, uint16_t *rule_count, size_t *required);
+
+bool              ssq_async_eok(const SSQ_ASYNC *async);
+SSQ_ERROR_CODE    ssq_async_ecode(const SSQ_ASYNC *async);
+const char       *ssq_async_emsg(const SSQ_ASYNC *async);
+void              ssq_async_eclr(SSQ_ASYNC *async);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_ASYNC_H */
@@ -0,0 +1,62 @@
+/* batch.h -- Mass A2S queries over a single unconnected socket. */
+
+#ifndef SSQ_BATCH_H
+#define SSQ_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+#include "ssq/error.h"
+#include "ssq/server.h"
+
+#ifndef SSQ_BATCH_WINDOW_DEFAULT
+# define SSQ_BATCH_WINDOW_DEFAULT 4096 // queries in flight
+#endif /* !SSQ_BATCH_WINDOW_DEFAULT */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct ssq_batch SSQ_BATCH;
+
+typedef struct ssq_batch_result {
+    A2S_INFO   *info;         /* Result of an A2S_INFO query.        */
+    A2S_PLAYER *players;      /* Result of an A2S_PLAYER query.      */
+    uint8_t     player_count; /* Number of players in `players'.     */
+    A2S_RULES  *rules;        /* Result of an A2S_RULES query.       */
+    uint16_t    rule_count;   /* Number of rules in `rules'.         */
+} SSQ_BATCH_RESULT;
+
+/*
+ * Called once per target as soon as its query completes. The query's error (if any) is stored in the
+ * server's last error, which is cleared when the query is dispatched. The callee takes ownership of the
+ * members of `result' and must release them with the matching `ssq_*_free' function.
+ */
+typedef void (*SSQ_BATCH_CALLBACK)(SSQ_SERVER *server, size_t index, SSQ_BATCH_RESULT *result, void *data);
+
+SSQ_BATCH     *ssq_batch_new(A2S_QUERY_KIND kind);
+void           ssq_batch_free(SSQ_BATCH *batch);
+
+/* Time to wait for each response, counted from when its request is queued; 0 waits forever. */
+void           ssq_batch_timeout(SSQ_BATCH *batch, uint64_t value_in_ms);
+void           ssq_batch_window(SSQ_BATCH *batch, size_t max_in_flight);
+
+/*
+ * Queries every server, calling `callback' for each. Returns false if the run was cut short for want
+ * of memory. A receive error not tied to a target is stored in the error of the batch as well, the
+ * queries going through the broken socket failing with it.
+ */
+bool           ssq_batch_run(SSQ_BATCH *batch, SSQ_SERVER *const *servers, size_t server_count, SSQ_BATCH_CALLBACK callback, void *data);
+
+bool           ssq_batch_eok(const SSQ_BATCH *batch);
+SSQ_ERROR_CODE ssq_batch_ecode(const SSQ_BATCH *batch);
+const char    *ssq_batch_emsg(const SSQ_BATCH *batch);
+void           ssq_batch_eclr(SSQ_BATCH *batch);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_BATCH_H */
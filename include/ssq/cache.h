@@ -0,0 +1,60 @@
+/* cache.h -- Results of queries shared between the threads asking for them. */
+
+#ifndef SSQ_CACHE_H
+#define SSQ_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+#include "ssq/call.h"
+#include "ssq/result.h"
+#include "ssq/server.h"
+
+#ifndef SSQ_CACHE_TTL_DEFAULT
+# define SSQ_CACHE_TTL_DEFAULT 5000 // ms
+#endif /* !SSQ_CACHE_TTL_DEFAULT */
+
+#ifndef SSQ_CACHE_STALE_DEFAULT
+# define SSQ_CACHE_STALE_DEFAULT 30000 // ms
+#endif /* !SSQ_CACHE_STALE_DEFAULT */
+
+#ifndef SSQ_CACHE_THREADS_DEFAULT
+# define SSQ_CACHE_THREADS_DEFAULT 2
+#endif /* !SSQ_CACHE_THREADS_DEFAULT */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Results are cached per server and kind of query. A result is fresh for `ttl_in_ms' milliseconds
+ * once received, then stale for `stale_in_ms' more: a stale result is still returned at once while
+ * a thread of the cache queries the server again. Past that, the next caller queries the server
+ * itself, and the callers asking for the same result meanwhile wait for its query instead of
+ * sending their own.
+ *
+ * Servers are told apart by their handle. The cache queries them through `ssq_call_result', so a
+ * server may be shared with other threads under the same restrictions.
+ */
+typedef struct ssq_cache SSQ_CACHE;
+
+/* No thread is started when `stale_in_ms' is 0; a `thread_count' of 0 selects the default. */
+SSQ_CACHE  *ssq_cache_new(uint64_t ttl_in_ms, uint64_t stale_in_ms, size_t thread_count);
+/* No call may be in progress on the cache. */
+void        ssq_cache_free(SSQ_CACHE *cache);
+
+/*
+ * Returns a reference to the result of the query `kind' of `server', to be released with
+ * `ssq_result_free', and stores the outcome of the query in `call'. Returns NULL if the query
+ * failed; failures are not cached.
+ */
+SSQ_RESULT *ssq_cache_get(SSQ_CACHE *cache, SSQ_SERVER *server, A2S_QUERY_KIND kind, SSQ_CALL *call);
+/* Drops the results of `server' once none of its queries is in flight, so that it can be freed. */
+void        ssq_cache_evict(SSQ_CACHE *cache, const SSQ_SERVER *server);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_CACHE_H */
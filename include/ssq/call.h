@@ -0,0 +1,52 @@
+/* call.h -- Queries of a server shared between threads. */
+
+#ifndef SSQ_CALL_H
+#define SSQ_CALL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+#include "ssq/error.h"
+#include "ssq/result.h"
+#include "ssq/server.h"
+
+/* Size of the error message of a call, terminator included. */
+#define SSQ_CALL_MESSAGE_SIZE 512
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Outcome of a single call, owned by the caller. */
+typedef struct ssq_call {
+    SSQ_ERROR_CODE code;                           /* SSQE_OK if the call succeeded. */
+    char           message[SSQ_CALL_MESSAGE_SIZE]; /* Description of the error.      */
+} SSQ_CALL;
+
+/*
+ * Same as `ssq_info', `ssq_player', `ssq_rules' and `ssq_result_new', except that the outcome is
+ * stored in `call' instead of the server's last error, so that several threads can query the same
+ * server at once. Each call goes through a socket of its own. Challenges and behaviors learnt
+ * during a call are shared with every later call.
+ *
+ * The server must not be configured meanwhile: timeouts, socket reuse, forgetting and
+ * re-resolution by a resolver are not synchronized with the calls.
+ */
+A2S_INFO   *ssq_call_info(SSQ_SERVER *server, SSQ_CALL *call);
+A2S_PLAYER *ssq_call_player(SSQ_SERVER *server, uint8_t *player_count, SSQ_CALL *call);
+A2S_RULES  *ssq_call_rules(SSQ_SERVER *server, uint16_t *rule_count, SSQ_CALL *call);
+SSQ_RESULT *ssq_call_result(SSQ_SERVER *server, A2S_QUERY_KIND kind, SSQ_CALL *call);
+/*
+ * Same as `ssq_result_if_changed', except that the response is compared with the last one decoded
+ * by the caller rather than by the server, as threads polling the same server each want to hear of
+ * every change. `fingerprint' is the caller's own: 0 before its first call, it is kept between the
+ * calls of a given kind and updated when a response is decoded.
+ */
+SSQ_RESULT *ssq_call_result_if_changed(SSQ_SERVER *server, A2S_QUERY_KIND kind, uint64_t *fingerprint, bool *unchanged, SSQ_CALL *call);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_CALL_H */
@@ -14,6 +14,9 @@ typedef enum ssq_error_code {
     SSQE_UNSUPPORTED,
     SSQE_GAI,
     SSQE_NO_SOCKET,
+    SSQE_TIMEOUT,
+    SSQE_BUFFER_TOO_SMALL,
+    SSQE_INVALID_ARGUMENT,
 } SSQ_ERROR_CODE;
 
 #ifdef __cplusplus
@@ -0,0 +1,45 @@
+/* master.h -- Steam master server list queries. */
+
+#ifndef SSQ_MASTER_H
+#define SSQ_MASTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ssq/registry.h"
+#include "ssq/server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum ssq_master_region {
+    SSQ_MASTER_REGION_US_EAST       = 0x00,
+    SSQ_MASTER_REGION_US_WEST       = 0x01,
+    SSQ_MASTER_REGION_SOUTH_AMERICA = 0x02,
+    SSQ_MASTER_REGION_EUROPE        = 0x03,
+    SSQ_MASTER_REGION_ASIA          = 0x04,
+    SSQ_MASTER_REGION_AUSTRALIA     = 0x05,
+    SSQ_MASTER_REGION_MIDDLE_EAST   = 0x06,
+    SSQ_MASTER_REGION_AFRICA        = 0x07,
+    SSQ_MASTER_REGION_WORLD         = 0xFF,
+} SSQ_MASTER_REGION;
+
+/* Called once per address listed. Returning false stops the listing. */
+typedef bool (*SSQ_MASTER_CALLBACK)(const struct sockaddr *addr, size_t addr_len, void *data);
+
+/*
+ * Lists the servers matching `filter' (e.g. "\\appid\\730"), one page at a time: each page is
+ * handed to the callback as soon as it is received, then the next one is requested from the last
+ * address listed. Returns how many addresses were listed; errors are stored in the master
+ * server's last error.
+ */
+size_t ssq_master_list(SSQ_SERVER *master, SSQ_MASTER_REGION region, const char *filter, SSQ_MASTER_CALLBACK callback, void *data);
+/* Adds the listed servers to a registry. */
+size_t ssq_master_list_into(SSQ_SERVER *master, SSQ_MASTER_REGION region, const char *filter, SSQ_REGISTRY *registry);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_MASTER_H */
@@ -0,0 +1,61 @@
+/* metrics.h -- Counters of the exchanges with servers. */
+
+#ifndef SSQ_METRICS_H
+#define SSQ_METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ssq/server.h"
+
+/* Buckets of the round-trip time histogram (see SSQ_METRICS). */
+#define SSQ_METRICS_RTT_BUCKETS 17
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Every counter only ever grows until reset. Failures are counted by error code when a query
+ * ends on a failed exchange with the server and when its response then fails to decode, a
+ * malformed response counting as an invalid one. A buffer too small to decode into is not counted.
+ *
+ * Round-trip times are those measured by blocking queries to time their retransmissions: the first
+ * bucket counts the ones under a millisecond, bucket `i' those from 2^(i-1) up to 2^i milliseconds
+ * and the last bucket every longer one.
+ */
+typedef struct ssq_metrics {
+    uint64_t queries;                      /* Queries started, however many requests they took. */
+    uint64_t challenges;                   /* Challenges answered, each costing a round trip.   */
+    uint64_t retransmits;                  /* Requests sent again for want of a response.       */
+    uint64_t fragments;                    /* Packets received.                                 */
+    uint64_t bytes;                        /* Bytes received, packet headers included.          */
+    uint64_t timeouts;                     /* Queries that failed with SSQE_TIMEOUT.            */
+    uint64_t invalid_responses;            /* Queries that failed with SSQE_INVALID_RESPONSE.   */
+    uint64_t system_errors;                /* Queries that failed with SSQE_SYSTEM.             */
+    uint64_t rtt[SSQ_METRICS_RTT_BUCKETS]; /* Round-trip times, by power of two.                */
+} SSQ_METRICS;
+
+/*
+ * The global counters add up the queries of every server. They are off by default: while neither
+ * they nor the counters of a server are enabled, the queries of the server only pay for a test.
+ */
+void ssq_metrics_enable(bool enable);
+void ssq_metrics_get(SSQ_METRICS *metrics);
+void ssq_metrics_reset(void);
+
+/*
+ * The counters of a server are shared by the calls made on it from other threads. They are off by
+ * default; no query of the server may be in progress while they are enabled or disabled. Returns
+ * false if they could not be allocated.
+ */
+bool ssq_server_metrics_enable(SSQ_SERVER *server, bool enable);
+/* Stores the counters of `server' in `metrics', all 0 if they are disabled. */
+void ssq_server_metrics_get(const SSQ_SERVER *server, SSQ_METRICS *metrics);
+void ssq_server_metrics_reset(SSQ_SERVER *server);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_METRICS_H */
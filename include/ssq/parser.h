@@ -0,0 +1,60 @@
+/* parser.h -- A2S_PLAYER and A2S_RULES responses decoded while their packets are still arriving. */
+
+#ifndef SSQ_PARSER_H
+#define SSQ_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+#include "ssq/error.h"
+#include "ssq/server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Called once per record decoded. The record and its strings are only valid during the call.
+ * Returning false stops the decoding.
+ */
+typedef bool (*SSQ_PLAYER_CALLBACK)(const A2S_PLAYER *player, void *data);
+typedef bool (*SSQ_RULES_CALLBACK)(const A2S_RULES *rule, void *data);
+
+/*
+ * Queries the players (or rules) of a server and hands them to the callback one by one: each
+ * packet of a split response is decoded as soon as the packets before it have arrived, and the
+ * response is never concatenated. Only compressed responses are decoded once complete.
+ * Returns how many records were delivered; errors are stored in the server's last error.
+ */
+size_t ssq_player_each(SSQ_SERVER *server, SSQ_PLAYER_CALLBACK callback, void *data);
+size_t ssq_rules_each(SSQ_SERVER *server, SSQ_RULES_CALLBACK callback, void *data);
+
+/*
+ * Push parser for responses received by other means. The bytes of the response are fed in
+ * order, in pieces of any size, with or without the leading 0xFFFFFFFF.
+ */
+typedef struct ssq_parser SSQ_PARSER;
+
+SSQ_PARSER    *ssq_parser_new_player(SSQ_PLAYER_CALLBACK callback, void *data);
+SSQ_PARSER    *ssq_parser_new_rules(SSQ_RULES_CALLBACK callback, void *data);
+void           ssq_parser_free(SSQ_PARSER *parser);
+
+/* Returns false once the response is invalid or the callback stopped the decoding. */
+bool           ssq_parser_feed(SSQ_PARSER *parser, const uint8_t *bytes, size_t len);
+/* Whether every record announced by the response was delivered. */
+bool           ssq_parser_done(const SSQ_PARSER *parser);
+/* Number of records delivered so far. */
+uint16_t       ssq_parser_count(const SSQ_PARSER *parser);
+
+bool           ssq_parser_eok(const SSQ_PARSER *parser);
+SSQ_ERROR_CODE ssq_parser_ecode(const SSQ_PARSER *parser);
+const char    *ssq_parser_emsg(const SSQ_PARSER *parser);
+void           ssq_parser_eclr(SSQ_PARSER *parser);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_PARSER_H */
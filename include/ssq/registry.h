@@ -0,0 +1,46 @@
+/* registry.h -- Servers built in bulk from numeric addresses. */
+
+#ifndef SSQ_REGISTRY_H
+#define SSQ_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/error.h"
+#include "ssq/server.h"
+
+/*
+ * A target file is a plain array of records: a 16-byte IPv6 address (IPv4 addresses being mapped
+ * as ::ffff:a.b.c.d) followed by a 2-byte port, both in network byte order.
+ */
+#define SSQ_REGISTRY_RECORD_SIZE 18
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct ssq_registry SSQ_REGISTRY;
+
+SSQ_REGISTRY      *ssq_registry_new(void);
+SSQ_REGISTRY      *ssq_registry_load(const char *path);
+void               ssq_registry_free(SSQ_REGISTRY *registry);
+
+/* The registry owns the servers: they must not be freed with `ssq_server_free'. */
+SSQ_SERVER        *ssq_registry_add(SSQ_REGISTRY *registry, const struct sockaddr *addr, size_t addr_len);
+bool               ssq_registry_add_records(SSQ_REGISTRY *registry, const uint8_t *records, size_t record_count);
+
+size_t             ssq_registry_count(const SSQ_REGISTRY *registry);
+SSQ_SERVER        *ssq_registry_server(const SSQ_REGISTRY *registry, size_t index);
+SSQ_SERVER *const *ssq_registry_servers(const SSQ_REGISTRY *registry);
+
+bool               ssq_registry_eok(const SSQ_REGISTRY *registry);
+SSQ_ERROR_CODE     ssq_registry_ecode(const SSQ_REGISTRY *registry);
+const char        *ssq_registry_emsg(const SSQ_REGISTRY *registry);
+void               ssq_registry_eclr(SSQ_REGISTRY *registry);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_REGISTRY_H */
@@ -0,0 +1,70 @@
+/* resolver.h -- Parallel, caching hostname resolution for servers. */
+
+#ifndef SSQ_RESOLVER_H
+#define SSQ_RESOLVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/error.h"
+#include "ssq/server.h"
+
+#ifndef SSQ_RESOLVER_THREADS_DEFAULT
+# define SSQ_RESOLVER_THREADS_DEFAULT 4
+#endif /* !SSQ_RESOLVER_THREADS_DEFAULT */
+#ifndef SSQ_RESOLVER_TTL_DEFAULT
+# define SSQ_RESOLVER_TTL_DEFAULT 300000 // ms
+#endif /* !SSQ_RESOLVER_TTL_DEFAULT */
+#ifndef SSQ_RESOLVER_NEGATIVE_TTL_DEFAULT
+# define SSQ_RESOLVER_NEGATIVE_TTL_DEFAULT 30000 // ms
+#endif /* !SSQ_RESOLVER_NEGATIVE_TTL_DEFAULT */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Hostnames are resolved by a pool of threads. Answers are cached for the TTL, failures for the
+ * negative TTL, and servers sharing a hostname and port share their resolution. Resolved addresses
+ * are only ever handed over to the servers from within `ssq_resolver_update' and
+ * `ssq_resolver_wait', on the calling thread.
+ *
+ * Handing over a new answer frees the addresses the servers used so far and, for a server that
+ * moved, closes its socket: no query on a server of the resolver may be in progress meanwhile, on
+ * any thread. This includes asynchronous and batched queries, the calls of `ssq/call.h', sweeps and
+ * the refreshes of a cache.
+ */
+typedef struct ssq_resolver SSQ_RESOLVER;
+
+SSQ_RESOLVER  *ssq_resolver_new(size_t thread_count);
+void           ssq_resolver_free(SSQ_RESOLVER *resolver);
+
+void           ssq_resolver_ttl(SSQ_RESOLVER *resolver, uint64_t ttl_in_ms, uint64_t negative_ttl_in_ms);
+/* Resolves hostnames from a hosts(5) file instead of the system resolver (the first address of a name wins). */
+bool           ssq_resolver_hosts_file(SSQ_RESOLVER *resolver, const char *path);
+
+/*
+ * Adds a server whose address is resolved in the background. The resolver owns the server: it must
+ * not be freed with `ssq_server_free'. Until its first resolution completes, queries fail.
+ */
+SSQ_SERVER    *ssq_resolver_add(SSQ_RESOLVER *resolver, const char *hostname, uint16_t port);
+
+/*
+ * Hands the completed resolutions over and starts the ones due, without blocking. Returns how many
+ * were handed over. Must not run while a server of the resolver is being queried (see above).
+ */
+size_t         ssq_resolver_update(SSQ_RESOLVER *resolver);
+/* Waits for every resolution in progress, then hands them over, as `ssq_resolver_update' does. */
+size_t         ssq_resolver_wait(SSQ_RESOLVER *resolver);
+
+bool           ssq_resolver_eok(const SSQ_RESOLVER *resolver);
+SSQ_ERROR_CODE ssq_resolver_ecode(const SSQ_RESOLVER *resolver);
+const char    *ssq_resolver_emsg(const SSQ_RESOLVER *resolver);
+void           ssq_resolver_eclr(SSQ_RESOLVER *resolver);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_RESOLVER_H */
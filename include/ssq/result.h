@@ -0,0 +1,41 @@
+/* result.h -- Query results borrowing their strings from the response they were decoded from. */
+
+#ifndef SSQ_RESULT_H
+#define SSQ_RESULT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+#include "ssq/async.h"
+#include "ssq/server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A result handle keeps the response alive; the strings of the result point straight into it
+ * and remain valid until the handle is freed. A handle is never modified once built, so that it
+ * can be shared between threads, each one holding a reference of its own.
+ */
+typedef struct ssq_result SSQ_RESULT;
+
+SSQ_RESULT       *ssq_result_new(SSQ_SERVER *server, A2S_QUERY_KIND kind);
+/* Same as `ssq_result_new' but skips unchanged responses (see `ssq_info_if_changed'). */
+SSQ_RESULT       *ssq_result_if_changed(SSQ_SERVER *server, A2S_QUERY_KIND kind, bool *unchanged);
+SSQ_RESULT       *ssq_result_from_async(SSQ_ASYNC *async);
+/* Adds a reference to the handle and returns it; each reference is released by `ssq_result_free'. */
+SSQ_RESULT       *ssq_result_ref(SSQ_RESULT *result);
+void              ssq_result_free(SSQ_RESULT *result);
+
+A2S_QUERY_KIND    ssq_result_kind(const SSQ_RESULT *result);
+const A2S_INFO   *ssq_result_info(const SSQ_RESULT *result);
+const A2S_PLAYER *ssq_result_players(const SSQ_RESULT *result, uint8_t *player_count);
+const A2S_RULES  *ssq_result_rules(const SSQ_RESULT *result, uint16_t *rule_count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_RESULT_H */
@@ -4,10 +4,12 @@
 #define SSQ_SERVER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #ifdef _WIN32
 # include <ws2tcpip.h>
 #else /* !_WIN32 */
+# include <sys/socket.h>
 # include <sys/time.h>
 #endif /* _WIN32 */
 
@@ -19,6 +21,9 @@
 #ifndef SSQ_TIMEOUT_SEND_DEFAULT
 # define SSQ_TIMEOUT_SEND_DEFAULT 5000 // ms
 #endif /* !SSQ_TIMEOUT_SEND_DEFAULT */
+#ifndef SSQ_RETRANSMIT_DEFAULT
+# define SSQ_RETRANSMIT_DEFAULT 3 // per request
+#endif /* !SSQ_RETRANSMIT_DEFAULT */
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,13 +37,30 @@ typedef enum ssq_timeout_selector {
 } SSQ_TIMEOUT_SELECTOR;
 
 SSQ_SERVER    *ssq_server_new(const char *hostname, uint16_t port);
+/* Builds a server from a numeric IPv4 or IPv6 socket address, without going through the resolver. */
+SSQ_SERVER    *ssq_server_new_addr(const struct sockaddr *addr, size_t addr_len);
 void           ssq_server_free(SSQ_SERVER *server);
 
+/*
+ * The receive timeout bounds the wait for the first packet of a response, retransmissions
+ * included, and then for each of the following packets.
+ */
 #ifdef _WIN32
 void           ssq_server_timeout(SSQ_SERVER *server, SSQ_TIMEOUT_SELECTOR which, DWORD value_in_ms);
 #else /* !_WIN32 */
 void           ssq_server_timeout(SSQ_SERVER *server, SSQ_TIMEOUT_SELECTOR which, time_t value_in_ms);
 #endif /* _WIN32 */
+/*
+ * Sets how many times a blocking query sends its request again while waiting for the response.
+ * The request is sent again once the round-trip time measured on the previous queries to the
+ * server, plus four times its variance, has elapsed, the wait doubling with each retransmission.
+ * Once a split response started to arrive, the same budget applies to the gaps between its
+ * packets, after which the missing ones are recovered from the copy the server sends again.
+ */
+void           ssq_server_retransmit(SSQ_SERVER *server, unsigned max_retransmits);
+
+void           ssq_server_reuse_socket(SSQ_SERVER *server, bool reuse);
+void           ssq_server_forget(SSQ_SERVER *server);
 
 bool           ssq_server_eok(const SSQ_SERVER *server);
 SSQ_ERROR_CODE ssq_server_ecode(const SSQ_SERVER *server);
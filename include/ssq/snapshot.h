@@ -0,0 +1,35 @@
+/* snapshot.h -- A2S_INFO, A2S_PLAYER and A2S_RULES queries pipelined over a single socket. */
+
+#ifndef SSQ_SNAPSHOT_H
+#define SSQ_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+#include "ssq/server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct ssq_snapshot {
+    A2S_INFO   *info;         /* Result of the A2S_INFO query, or NULL.   */
+    A2S_PLAYER *players;      /* Result of the A2S_PLAYER query, or NULL. */
+    uint8_t     player_count; /* Number of players in `players'.          */
+    A2S_RULES  *rules;        /* Result of the A2S_RULES query, or NULL.  */
+    uint16_t    rule_count;   /* Number of rules in `rules'.              */
+} SSQ_SNAPSHOT;
+
+/*
+ * Sends the three queries back-to-back and collects their responses as they arrive.
+ * Members of `snapshot' whose query failed are left NULL; the first failure is stored in the
+ * server's last error.
+ */
+void ssq_snapshot(SSQ_SERVER *server, SSQ_SNAPSHOT *snapshot);
+void ssq_snapshot_free(SSQ_SNAPSHOT *snapshot);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_SNAPSHOT_H */
@@ -0,0 +1,68 @@
+/* sweep.h -- Blocking queries of many servers spread over a pool of threads. */
+
+#ifndef SSQ_SWEEP_H
+#define SSQ_SWEEP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ssq/a2s.h"
+#include "ssq/call.h"
+#include "ssq/error.h"
+#include "ssq/result.h"
+#include "ssq/server.h"
+
+#ifndef SSQ_SWEEP_THREADS_DEFAULT
+# define SSQ_SWEEP_THREADS_DEFAULT 8
+#endif /* !SSQ_SWEEP_THREADS_DEFAULT */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Each thread of a sweep starts with an even share of the targets and, once it has run out of its
+ * own, takes half of the targets left to another thread. A thread stuck waiting on a slow server
+ * thus never holds more than the target it is querying.
+ */
+typedef struct ssq_sweep SSQ_SWEEP;
+
+typedef struct ssq_sweep_target {
+    SSQ_SERVER    *server; /* The server to query. */
+    A2S_QUERY_KIND kind;   /* The query to send.   */
+} SSQ_SWEEP_TARGET;
+
+typedef struct ssq_sweep_output {
+    SSQ_RESULT *result; /* Result of the query, or NULL if it failed. */
+    SSQ_CALL    call;   /* Outcome of the query.                      */
+} SSQ_SWEEP_OUTPUT;
+
+/*
+ * Called once per target as soon as its query completes, on the thread that ran it: several calls
+ * may run at once. The callee takes ownership of `result' (NULL if the query failed) and must
+ * release it with `ssq_result_free'.
+ */
+typedef void (*SSQ_SWEEP_CALLBACK)(const SSQ_SWEEP_TARGET *target, size_t index, SSQ_RESULT *result, const SSQ_CALL *call, void *data);
+
+SSQ_SWEEP     *ssq_sweep_new(size_t thread_count);
+void           ssq_sweep_free(SSQ_SWEEP *sweep);
+
+/*
+ * Queries every target and returns once they have all completed. The queries go through
+ * `ssq_call_result', so a server may appear in several targets and is subject to the same
+ * restrictions; each one waits for as long as the timeouts of its server allow.
+ */
+bool           ssq_sweep_run(SSQ_SWEEP *sweep, const SSQ_SWEEP_TARGET *targets, size_t target_count, SSQ_SWEEP_CALLBACK callback, void *data);
+/* Same as `ssq_sweep_run', except that the outcome of each target is stored at the same index of `outputs'. */
+bool           ssq_sweep_into(SSQ_SWEEP *sweep, const SSQ_SWEEP_TARGET *targets, size_t target_count, SSQ_SWEEP_OUTPUT *outputs);
+
+bool           ssq_sweep_eok(const SSQ_SWEEP *sweep);
+SSQ_ERROR_CODE ssq_sweep_ecode(const SSQ_SWEEP *sweep);
+const char    *ssq_sweep_emsg(const SSQ_SWEEP *sweep);
+void           ssq_sweep_eclr(SSQ_SWEEP *sweep);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_SWEEP_H */
@@ -0,0 +1,51 @@
+/* trace.h -- Timestamps of the phases of the queries of a server. */
+
+#ifndef SSQ_TRACE_H
+#define SSQ_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum ssq_trace_phase {
+    SSQ_TRACE_SOCKET,       /* A socket was opened for the query.                                   */
+    SSQ_TRACE_SEND,         /* A request of `size' bytes was sent, first or again.                  */
+    SSQ_TRACE_RECV,         /* A packet of `size' bytes was received.                               */
+    SSQ_TRACE_CHALLENGE,    /* The server asked for a challenge: the request is sent again with it. */
+    SSQ_TRACE_REASSEMBLED,  /* The packets were put back together into a response of `size' bytes.  */
+    SSQ_TRACE_DECODE_BEGIN, /* Decoding of `size' bytes of the response started.                    */
+    SSQ_TRACE_DECODE_END,   /* Decoding ended, successfully or not.                                 */
+} SSQ_TRACE_PHASE;
+
+typedef struct ssq_trace_event {
+    SSQ_TRACE_PHASE phase;
+    uint64_t        time_in_ns; /* When the phase was reached (see `ssq_trace_now'). */
+    size_t          size;       /* Bytes involved, 0 if none.                         */
+} SSQ_TRACE_EVENT;
+
+/*
+ * Called on the thread running the query as it reaches each phase. The calls made on a server from
+ * other threads (see `ssq/call.h') call it at the same time.
+ */
+typedef void (*SSQ_TRACE_CALLBACK)(const SSQ_TRACE_EVENT *event, void *data);
+
+/*
+ * Sets the callback told about the phases of the queries of `server', NULL to stop. The hooks are
+ * only compiled in with the SSQ_USE_TRACE build option: returns false if they were left out.
+ */
+bool     ssq_server_trace(SSQ_SERVER *server, SSQ_TRACE_CALLBACK callback, void *data);
+
+/* Nanoseconds elapsed on the monotonic clock of the events since an unspecified point in time. */
+uint64_t ssq_trace_now(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SSQ_TRACE_H */
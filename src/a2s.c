@@ -0,0 +1,10 @@
+#include "a2s.h"
+
+size_t ssq_a2s_payload(A2S_QUERY_KIND kind, uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall) {
+    switch (kind) {
+        case A2S_QUERY_INFO:   return ssq_info_payload(payload, chall);
+        case A2S_QUERY_PLAYER: return ssq_player_payload(payload, chall);
+        case A2S_QUERY_RULES:  return ssq_rules_payload(payload, chall);
+        default:               return 0;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef A2S_H
+#define A2S_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/a2s.h"
+
+#include "error.h"
+
+/* Size of the largest request payload (A2S_INFO with a challenge). */
+#define A2S_PAYLOAD_SIZE 29
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+size_t      ssq_a2s_payload(A2S_QUERY_KIND kind, uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall);
+
+size_t      ssq_info_payload(uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall);
+size_t      ssq_player_payload(uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall);
+size_t      ssq_rules_payload(uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall);
+
+A2S_INFO   *ssq_info_deserialize(const uint8_t *response, size_t response_len, SSQ_ERROR *error);
+A2S_PLAYER *ssq_player_deserialize(const uint8_t *response, size_t response_len, uint8_t *player_count, SSQ_ERROR *error);
+A2S_RULES  *ssq_rules_deserialize(const uint8_t *response, size_t response_len, uint16_t *rule_count, SSQ_ERROR *error);
+
+A2S_INFO   *ssq_info_deserialize_into(const uint8_t *response, size_t response_len, void *buf, size_t buf_size, size_t *required, SSQ_ERROR *error);
+A2S_PLAYER *ssq_player_deserialize_into(const uint8_t *response, size_t response_len, void *buf, size_t buf_size, uint8_t *player_count, size_t *required, SSQ_ERROR *error);
+A2S_RULES  *ssq_rules_deserialize_into(const uint8_t *response, size_t response_len, void *buf, size_t buf_size, uint16_t *rule_count, size_t *required, SSQ_ERROR *error);
+
+/* The result starts `prefix' bytes into the returned block and its strings point into `response'. */
+void       *ssq_info_deserialize_borrowed(const uint8_t *response, size_t response_len, size_t prefix, SSQ_ERROR *error);
+void       *ssq_player_deserialize_borrowed(const uint8_t *response, size_t response_len, size_t prefix, uint8_t *player_count, SSQ_ERROR *error);
+void       *ssq_rules_deserialize_borrowed(const uint8_t *response, size_t response_len, size_t prefix, uint16_t *rule_count, SSQ_ERROR *error);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !A2S_H */
@@ -3,14 +3,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "a2s.h"
+#include "arena.h"
 #include "packet.h"
 #include "query.h"
 #include "response.h"
 #include "server.h"
 #include "stream.h"
+#include "trace.h"
 
 #define A2S_HEADER_INFO 0x54
-#define S2A_HEADER_INFO 0x49
 
 #define A2S_INFO_CHALL_LEN    (sizeof (int32_t))
 #define A2S_INFO_CHALL_OFFSET (A2S_INFO_PAYLOAD_LEN_WITH_CHALL - A2S_INFO_CHALL_LEN)
@@ -31,18 +33,12 @@ static inline void payload_set_challenge(uint8_t payload[A2S_INFO_PAYLOAD_LEN_WI
     memcpy(payload + A2S_INFO_CHALL_OFFSET, &chall, sizeof (chall));
 }
 
-static uint8_t *ssq_info_query(SSQ_SERVER *server, size_t *response_len) {
-    // Allocate additional storage for possible challenge.
-    uint8_t payload[A2S_INFO_PAYLOAD_LEN_WITH_CHALL];
+size_t ssq_info_payload(uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall) {
     payload_init(payload);
-    uint8_t *response = ssq_query(server, payload, A2S_INFO_PAYLOAD_LEN_WITHOUT_CHALL, response_len);
-    while (response != NULL && ssq_response_has_challenge(response, *response_len)) {
-        int32_t chall = ssq_response_get_challenge(response, *response_len);
-        payload_set_challenge(payload, chall);
-        free(response);
-        response = ssq_query(server, payload, A2S_INFO_PAYLOAD_LEN_WITH_CHALL, response_len);
-    }
-    return response;
+    if (chall == NULL)
+        return A2S_INFO_PAYLOAD_LEN_WITHOUT_CHALL;
+    payload_set_challenge(payload, *chall);
+    return A2S_INFO_PAYLOAD_LEN_WITH_CHALL;
 }
 
 static A2S_ENVIRONMENT ssq_info_deserialize_environment(SSQ_STREAM *stream) {
@@ -64,27 +60,29 @@ static A2S_SERVER_TYPE ssq_info_deserialize_server_type(SSQ_STREAM *stream) {
     }
 }
 
-A2S_INFO *ssq_info_deserialize(const uint8_t payload[], size_t payload_len, SSQ_ERROR *error) {
-    SSQ_STREAM stream;
-    ssq_stream_wrap(&stream, payload, payload_len);
-    if (ssq_response_is_truncated(payload, payload_len))
-        ssq_stream_advance(&stream, SSQ_PACKET_HEADER_LEN);
-    uint8_t response_header = ssq_stream_read_uint8_t(&stream);
+static bool ssq_info_deserialize_header(SSQ_STREAM *stream, const uint8_t response[], size_t response_len, SSQ_ERROR *error) {
+    ssq_stream_wrap(stream, response, response_len);
+    if (ssq_response_is_truncated(response, response_len))
+        ssq_stream_advance(stream, SSQ_PACKET_HEADER_LEN);
+    uint8_t response_header = ssq_stream_read_uint8_t(stream);
     if (response_header != S2A_HEADER_INFO) {
         ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid A2S_INFO response header");
-        return NULL;
-    }
-    A2S_INFO *info = malloc(sizeof (*info));
-    if (info == NULL) {
-        ssq_error_set_from_errno(error);
-        return NULL;
+        return false;
     }
+    return true;
+}
+
+/* Lays out the result in `arena'; returns NULL when the arena is only measuring. */
+static A2S_INFO *ssq_info_deserialize_fields(SSQ_STREAM stream, SSQ_ARENA *arena) {
+    A2S_INFO scratch;
+    A2S_INFO *result = ssq_arena_alloc(arena, sizeof (*result));
+    A2S_INFO *info = (result != NULL) ? result : &scratch;
     memset(info, 0, sizeof (*info));
     info->protocol    = ssq_stream_read_uint8_t(&stream);
-    info->name        = ssq_stream_read_string(&stream, &info->name_len);
-    info->map         = ssq_stream_read_string(&stream, &info->map_len);
-    info->folder      = ssq_stream_read_string(&stream, &info->folder_len);
-    info->game        = ssq_stream_read_string(&stream, &info->game_len);
+    info->name        = ssq_stream_read_string(&stream, arena, &info->name_len);
+    info->map         = ssq_stream_read_string(&stream, arena, &info->map_len);
+    info->folder      = ssq_stream_read_string(&stream, arena, &info->folder_len);
+    info->game        = ssq_stream_read_string(&stream, arena, &info->game_len);
     info->id          = ssq_stream_read_uint16_t(&stream);
     info->players     = ssq_stream_read_uint8_t(&stream);
     info->max_players = ssq_stream_read_uint8_t(&stream);
@@ -93,9 +91,9 @@ A2S_INFO *ssq_info_deserialize(const uint8_t payload[], size_t payload_len, SSQ_
     info->environment = ssq_info_deserialize_environment(&stream);
     info->visibility  = ssq_stream_read_bool(&stream);
     info->vac         = ssq_stream_read_bool(&stream);
-    info->version     = ssq_stream_read_string(&stream, &info->version_len);
+    info->version     = ssq_stream_read_string(&stream, arena, &info->version_len);
     if (ssq_stream_end(&stream))
-        return info;
+        goto end;
     info->edf = ssq_stream_read_uint8_t(&stream);
     if (info->edf & A2S_INFO_FLAG_PORT)
         info->port = ssq_stream_read_uint16_t(&stream);
@@ -103,37 +101,117 @@ A2S_INFO *ssq_info_deserialize(const uint8_t payload[], size_t payload_len, SSQ_
         info->steamid = ssq_stream_read_uint64_t(&stream);
     if (info->edf & A2S_INFO_FLAG_STV) {
         info->stv_port = ssq_stream_read_uint16_t(&stream);
-        info->stv_name = ssq_stream_read_string(&stream, &info->stv_name_len);
+        info->stv_name = ssq_stream_read_string(&stream, arena, &info->stv_name_len);
     }
     if (info->edf & A2S_INFO_FLAG_KEYWORDS)
-        info->keywords = ssq_stream_read_string(&stream, &info->keywords_len);
+        info->keywords = ssq_stream_read_string(&stream, arena, &info->keywords_len);
     if (info->edf & A2S_INFO_FLAG_GAMEID)
         info->gameid = ssq_stream_read_uint64_t(&stream);
-    return info;
+end:
+    return result;
+}
+
+static size_t ssq_info_deserialize_size(const SSQ_STREAM *stream) {
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, NULL, 0);
+    ssq_info_deserialize_fields(*stream, &arena);
+    return arena.used;
+}
+
+A2S_INFO *ssq_info_deserialize(const uint8_t response[], size_t response_len, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_info_deserialize_header(&stream, response, response_len, error))
+        return NULL;
+    size_t size = ssq_info_deserialize_size(&stream);
+    void *block = malloc(size);
+    if (block == NULL) {
+        ssq_error_set_from_errno(error);
+        return NULL;
+    }
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, block, size);
+    return ssq_info_deserialize_fields(stream, &arena);
+}
+
+A2S_INFO *ssq_info_deserialize_into(const uint8_t response[], size_t response_len, void *buf, size_t buf_size, size_t *required, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_info_deserialize_header(&stream, response, response_len, error))
+        return NULL;
+    *required = ssq_info_deserialize_size(&stream);
+    if (buf == NULL || buf_size < *required) {
+        ssq_error_set(error, SSQE_BUFFER_TOO_SMALL, "Buffer too small to hold the A2S_INFO result");
+        return NULL;
+    }
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, buf, buf_size);
+    return ssq_info_deserialize_fields(stream, &arena);
+}
+
+void *ssq_info_deserialize_borrowed(const uint8_t response[], size_t response_len, size_t prefix, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_info_deserialize_header(&stream, response, response_len, error))
+        return NULL;
+    uint8_t *block = malloc(prefix + sizeof (A2S_INFO));
+    if (block == NULL) {
+        ssq_error_set_from_errno(error);
+        return NULL;
+    }
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, block + prefix, sizeof (A2S_INFO));
+    arena.borrow = true;
+    ssq_info_deserialize_fields(stream, &arena);
+    return block;
 }
 
 A2S_INFO *ssq_info(SSQ_SERVER *server) {
     size_t response_len;
-    uint8_t *response = ssq_info_query(server, &response_len);
+    uint8_t *response = ssq_query_a2s(server, A2S_QUERY_INFO, &response_len);
+    if (response == NULL)
+        return NULL;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_INFO *info = ssq_info_deserialize(response, response_len, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    free(response);
+    ssq_query_decoded(server, &error);
+    return info;
+}
+
+A2S_INFO *ssq_info_if_changed(SSQ_SERVER *server, bool *unchanged) {
+    size_t response_len;
+    uint64_t fingerprint;
+    uint8_t *response = ssq_query_a2s_changed(server, A2S_QUERY_INFO, &response_len, &fingerprint, unchanged);
+    if (response == NULL)
+        return NULL;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_INFO *info = ssq_info_deserialize(response, response_len, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    free(response);
+    if (error.code == SSQE_OK)
+        ssq_server_learn_fingerprint(server, A2S_QUERY_INFO, fingerprint);
+    ssq_query_decoded(server, &error);
+    return info;
+}
+
+A2S_INFO *ssq_info_into(SSQ_SERVER *server, void *buf, size_t buf_size, size_t *required) {
+    size_t response_len;
+    uint8_t *response = ssq_query_a2s(server, A2S_QUERY_INFO, &response_len);
     if (response == NULL)
         return NULL;
-    A2S_INFO *info = ssq_info_deserialize(response, response_len, &server->last_error);
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_INFO *info = ssq_info_deserialize_into(response, response_len, buf, buf_size, required, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
     free(response);
+    ssq_query_decoded(server, &error);
     return info;
 }
 
 void ssq_info_free(A2S_INFO *info) {
-    if (info == NULL)
-        return;
-    free(info->name);
-    free(info->map);
-    free(info->folder);
-    free(info->game);
-    free(info->version);
-    if (ssq_info_has_stv(info))
-        free(info->stv_name);
-    if (ssq_info_has_keywords(info))
-        free(info->keywords);
     free(info);
 }
 
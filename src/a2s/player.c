@@ -3,14 +3,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "a2s.h"
+#include "arena.h"
 #include "packet.h"
 #include "query.h"
 #include "response.h"
 #include "server.h"
 #include "stream.h"
+#include "trace.h"
 
 #define A2S_HEADER_PLAYER 0x55
-#define S2A_HEADER_PLAYER 0x44
 
 #define A2S_PLAYER_CHALL_LEN    (sizeof (int32_t))
 #define A2S_PLAYER_CHALL_OFFSET (A2S_PLAYER_PAYLOAD_LEN - A2S_PLAYER_CHALL_LEN)
@@ -29,60 +31,147 @@ static inline void payload_set_challenge(uint8_t payload[A2S_PLAYER_PAYLOAD_LEN]
     memcpy(payload + A2S_PLAYER_CHALL_OFFSET, &chall, sizeof (chall));
 }
 
-static uint8_t *ssq_player_query(SSQ_SERVER *server, size_t *response_len) {
-    uint8_t payload[A2S_PLAYER_PAYLOAD_LEN];
+size_t ssq_player_payload(uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall) {
     payload_init(payload);
-    uint8_t *response = ssq_query(server, payload, A2S_PLAYER_PAYLOAD_LEN, response_len);
-    while (response != NULL && ssq_response_has_challenge(response, *response_len)) {
-        int32_t chall = ssq_response_get_challenge(response, *response_len);
-        payload_set_challenge(payload, chall);
-        free(response);
-        response = ssq_query(server, payload, A2S_PLAYER_PAYLOAD_LEN, response_len);
-    }
-    return response;
+    if (chall != NULL)
+        payload_set_challenge(payload, *chall);
+    return A2S_PLAYER_PAYLOAD_LEN;
 }
 
-A2S_PLAYER *ssq_player_deserialize(const uint8_t response[], size_t response_len, uint8_t *player_count, SSQ_ERROR *error) {
-    SSQ_STREAM stream;
-    ssq_stream_wrap(&stream, response, response_len);
+static bool ssq_player_deserialize_header(SSQ_STREAM *stream, const uint8_t response[], size_t response_len, uint8_t *player_count, SSQ_ERROR *error) {
+    ssq_stream_wrap(stream, response, response_len);
     if (ssq_response_is_truncated(response, response_len))
-        ssq_stream_advance(&stream, SSQ_PACKET_HEADER_LEN);
-    uint8_t response_header = ssq_stream_read_uint8_t(&stream);
+        ssq_stream_advance(stream, SSQ_PACKET_HEADER_LEN);
+    uint8_t response_header = ssq_stream_read_uint8_t(stream);
     if (response_header != S2A_HEADER_PLAYER) {
         ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid A2S_PLAYER response header");
-        return NULL;
+        return false;
     }
-    *player_count = ssq_stream_read_uint8_t(&stream);
+    *player_count = ssq_stream_read_uint8_t(stream);
+    return true;
+}
+
+/* Lays out the result in `arena'; returns NULL when the arena is only measuring. */
+static A2S_PLAYER *ssq_player_deserialize_fields(SSQ_STREAM stream, uint8_t player_count, SSQ_ARENA *arena) {
+    A2S_PLAYER *players = ssq_arena_alloc(arena, player_count * sizeof (*players));
+    for (uint8_t i = 0; i < player_count; ++i) {
+        A2S_PLAYER player;
+        player.index    = ssq_stream_read_uint8_t(&stream);
+        player.name     = ssq_stream_read_string(&stream, arena, &player.name_len);
+        player.score    = ssq_stream_read_int32_t(&stream);
+        player.duration = ssq_stream_read_float(&stream);
+        if (players != NULL)
+            players[i] = player;
+    }
+    return players;
+}
+
+static size_t ssq_player_deserialize_size(const SSQ_STREAM *stream, uint8_t player_count) {
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, NULL, 0);
+    ssq_player_deserialize_fields(*stream, player_count, &arena);
+    return arena.used;
+}
+
+A2S_PLAYER *ssq_player_deserialize(const uint8_t response[], size_t response_len, uint8_t *player_count, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_player_deserialize_header(&stream, response, response_len, player_count, error))
+        return NULL;
     if (*player_count == 0)
         return NULL;
-    A2S_PLAYER *players = calloc(*player_count, sizeof (*players));
-    if (players == NULL) {
+    size_t size = ssq_player_deserialize_size(&stream, *player_count);
+    void *block = malloc(size);
+    if (block == NULL) {
         ssq_error_set_from_errno(error);
         return NULL;
     }
-    for (uint8_t i = 0; i < *player_count; ++i) {
-        players[i].index    = ssq_stream_read_uint8_t(&stream);
-        players[i].name     = ssq_stream_read_string(&stream, &players[i].name_len);
-        players[i].score    = ssq_stream_read_int32_t(&stream);
-        players[i].duration = ssq_stream_read_float(&stream);
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, block, size);
+    return ssq_player_deserialize_fields(stream, *player_count, &arena);
+}
+
+A2S_PLAYER *ssq_player_deserialize_into(const uint8_t response[], size_t response_len, void *buf, size_t buf_size, uint8_t *player_count, size_t *required, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_player_deserialize_header(&stream, response, response_len, player_count, error))
+        return NULL;
+    *required = ssq_player_deserialize_size(&stream, *player_count);
+    if (*player_count == 0)
+        return NULL;
+    if (buf == NULL || buf_size < *required) {
+        ssq_error_set(error, SSQE_BUFFER_TOO_SMALL, "Buffer too small to hold the A2S_PLAYER result");
+        return NULL;
+    }
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, buf, buf_size);
+    return ssq_player_deserialize_fields(stream, *player_count, &arena);
+}
+
+void *ssq_player_deserialize_borrowed(const uint8_t response[], size_t response_len, size_t prefix, uint8_t *player_count, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_player_deserialize_header(&stream, response, response_len, player_count, error))
+        return NULL;
+    size_t size = *player_count * sizeof (A2S_PLAYER);
+    uint8_t *block = malloc(prefix + size);
+    if (block == NULL) {
+        ssq_error_set_from_errno(error);
+        return NULL;
     }
-    return players;
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, block + prefix, size);
+    arena.borrow = true;
+    ssq_player_deserialize_fields(stream, *player_count, &arena);
+    return block;
 }
 
 A2S_PLAYER *ssq_player(SSQ_SERVER *server, uint8_t *player_count) {
     size_t response_len;
-    uint8_t *response = ssq_player_query(server, &response_len);
+    uint8_t *response = ssq_query_a2s(server, A2S_QUERY_PLAYER, &response_len);
+    if (response == NULL)
+        return NULL;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_PLAYER *players = ssq_player_deserialize(response, response_len, player_count, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    free(response);
+    ssq_query_decoded(server, &error);
+    return players;
+}
+
+A2S_PLAYER *ssq_player_if_changed(SSQ_SERVER *server, uint8_t *player_count, bool *unchanged) {
+    size_t response_len;
+    uint64_t fingerprint;
+    uint8_t *response = ssq_query_a2s_changed(server, A2S_QUERY_PLAYER, &response_len, &fingerprint, unchanged);
+    if (response == NULL)
+        return NULL;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_PLAYER *players = ssq_player_deserialize(response, response_len, player_count, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    free(response);
+    if (error.code == SSQE_OK)
+        ssq_server_learn_fingerprint(server, A2S_QUERY_PLAYER, fingerprint);
+    ssq_query_decoded(server, &error);
+    return players;
+}
+
+A2S_PLAYER *ssq_player_into(SSQ_SERVER *server, void *buf, size_t buf_size, uint8_t *player_count, size_t *required) {
+    size_t response_len;
+    uint8_t *response = ssq_query_a2s(server, A2S_QUERY_PLAYER, &response_len);
     if (response == NULL)
         return NULL;
-    A2S_PLAYER *players = ssq_player_deserialize(response, response_len, player_count, &server->last_error);
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_PLAYER *players = ssq_player_deserialize_into(response, response_len, buf, buf_size, player_count, required, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
     free(response);
+    ssq_query_decoded(server, &error);
     return players;
 }
 
 void ssq_player_free(A2S_PLAYER players[], uint8_t player_count) {
-    if (players == NULL)
-        return;
-    for (uint8_t i = 0; i < player_count; ++i)
-        free(players[i].name);
+    (void)player_count;
     free(players);
 }
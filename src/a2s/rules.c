@@ -3,14 +3,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "a2s.h"
+#include "arena.h"
 #include "packet.h"
 #include "query.h"
 #include "response.h"
 #include "server.h"
 #include "stream.h"
+#include "trace.h"
 
 #define A2S_HEADER_RULES 0x56
-#define S2A_HEADER_RULES 0x45
 
 #define A2S_RULES_CHALL_LEN    (sizeof (int32_t))
 #define A2S_RULES_CHALL_OFFSET (A2S_RULES_PAYLOAD_LEN - A2S_RULES_CHALL_LEN)
@@ -29,60 +31,156 @@ static inline void payload_set_challenge(uint8_t payload[A2S_RULES_PAYLOAD_LEN],
     memcpy(payload + A2S_RULES_CHALL_OFFSET, &chall, sizeof (chall));
 }
 
-static uint8_t *ssq_rules_query(SSQ_SERVER *server, size_t *response_len) {
-    uint8_t payload[A2S_RULES_PAYLOAD_LEN];
+size_t ssq_rules_payload(uint8_t payload[A2S_PAYLOAD_SIZE], const int32_t *chall) {
     payload_init(payload);
-    uint8_t *response = ssq_query(server, payload, A2S_RULES_PAYLOAD_LEN, response_len);
-    while (response != NULL && ssq_response_has_challenge(response, *response_len)) {
-        int32_t chall = ssq_response_get_challenge(response, *response_len);
-        payload_set_challenge(payload, chall);
-        free(response);
-        response = ssq_query(server, payload, A2S_RULES_PAYLOAD_LEN, response_len);
-    }
-    return response;
+    if (chall != NULL)
+        payload_set_challenge(payload, *chall);
+    return A2S_RULES_PAYLOAD_LEN;
 }
 
-A2S_RULES *ssq_rules_deserialize(const uint8_t response[], size_t response_len, uint16_t *rule_count, SSQ_ERROR *error) {
-    SSQ_STREAM stream;
-    ssq_stream_wrap(&stream, response, response_len);
+static bool ssq_rules_deserialize_header(SSQ_STREAM *stream, const uint8_t response[], size_t response_len, uint16_t *rule_count, SSQ_ERROR *error) {
+    ssq_stream_wrap(stream, response, response_len);
     if (ssq_response_is_truncated(response, response_len))
-        ssq_stream_advance(&stream, SSQ_PACKET_HEADER_LEN);
-    uint8_t response_header = ssq_stream_read_uint8_t(&stream);
+        ssq_stream_advance(stream, SSQ_PACKET_HEADER_LEN);
+    uint8_t response_header = ssq_stream_read_uint8_t(stream);
     if (response_header != S2A_HEADER_RULES) {
         ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid A2S_RULES response header");
-        return NULL;
+        return false;
+    }
+    *rule_count = ssq_stream_read_uint16_t(stream);
+    return true;
+}
+
+/* Lays out the result in `arena'; returns NULL when the arena is only measuring. */
+static A2S_RULES *ssq_rules_deserialize_fields(SSQ_STREAM stream, uint16_t rule_count, SSQ_ARENA *arena) {
+    A2S_RULES *rules = ssq_arena_alloc(arena, rule_count * sizeof (*rules));
+    for (uint16_t i = 0; i < rule_count; ++i) {
+        A2S_RULES rule;
+        rule.name  = ssq_stream_read_string(&stream, arena, &rule.name_len);
+        rule.value = ssq_stream_read_string(&stream, arena, &rule.value_len);
+        if (rules != NULL)
+            rules[i] = rule;
     }
-    *rule_count = ssq_stream_read_uint16_t(&stream);
+    return rules;
+}
+
+static size_t ssq_rules_deserialize_size(const SSQ_STREAM *stream, uint16_t rule_count) {
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, NULL, 0);
+    ssq_rules_deserialize_fields(*stream, rule_count, &arena);
+    return arena.used;
+}
+
+A2S_RULES *ssq_rules_deserialize(const uint8_t response[], size_t response_len, uint16_t *rule_count, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_rules_deserialize_header(&stream, response, response_len, rule_count, error))
+        return NULL;
     if (*rule_count == 0)
         return NULL;
-    A2S_RULES *rules = calloc(*rule_count, sizeof (*rules));
-    if (rules == NULL) {
+    // Both passes read the strings off a single sweep over the response.
+    SSQ_STREAM_INDEX index;
+    ssq_stream_index(&stream, &index);
+    A2S_RULES *rules = NULL;
+    size_t size = ssq_rules_deserialize_size(&stream, *rule_count);
+    void *block = malloc(size);
+    if (block != NULL) {
+        SSQ_ARENA arena;
+        ssq_arena_init(&arena, block, size);
+        rules = ssq_rules_deserialize_fields(stream, *rule_count, &arena);
+    } else {
         ssq_error_set_from_errno(error);
-        return NULL;
     }
-    for (uint16_t i = 0; i < *rule_count; ++i) {
-        rules[i].name  = ssq_stream_read_string(&stream, &rules[i].name_len);
-        rules[i].value = ssq_stream_read_string(&stream, &rules[i].value_len);
+    ssq_stream_index_free(&index);
+    return rules;
+}
+
+A2S_RULES *ssq_rules_deserialize_into(const uint8_t response[], size_t response_len, void *buf, size_t buf_size, uint16_t *rule_count, size_t *required, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_rules_deserialize_header(&stream, response, response_len, rule_count, error))
+        return NULL;
+    SSQ_STREAM_INDEX index;
+    ssq_stream_index(&stream, &index);
+    A2S_RULES *rules = NULL;
+    *required = ssq_rules_deserialize_size(&stream, *rule_count);
+    if (*rule_count == 0) {
+        // Nothing to store.
+    } else if (buf == NULL || buf_size < *required) {
+        ssq_error_set(error, SSQE_BUFFER_TOO_SMALL, "Buffer too small to hold the A2S_RULES result");
+    } else {
+        SSQ_ARENA arena;
+        ssq_arena_init(&arena, buf, buf_size);
+        rules = ssq_rules_deserialize_fields(stream, *rule_count, &arena);
     }
+    ssq_stream_index_free(&index);
     return rules;
 }
 
+void *ssq_rules_deserialize_borrowed(const uint8_t response[], size_t response_len, size_t prefix, uint16_t *rule_count, SSQ_ERROR *error) {
+    SSQ_STREAM stream;
+    if (!ssq_rules_deserialize_header(&stream, response, response_len, rule_count, error))
+        return NULL;
+    size_t size = *rule_count * sizeof (A2S_RULES);
+    uint8_t *block = malloc(prefix + size);
+    if (block == NULL) {
+        ssq_error_set_from_errno(error);
+        return NULL;
+    }
+    SSQ_ARENA arena;
+    ssq_arena_init(&arena, block + prefix, size);
+    arena.borrow = true;
+    ssq_rules_deserialize_fields(stream, *rule_count, &arena);
+    return block;
+}
+
 A2S_RULES *ssq_rules(SSQ_SERVER *server, uint16_t *rule_count) {
     size_t response_len;
-    uint8_t *response = ssq_rules_query(server, &response_len);
+    uint8_t *response = ssq_query_a2s(server, A2S_QUERY_RULES, &response_len);
+    if (response == NULL)
+        return NULL;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_RULES *rules = ssq_rules_deserialize(response, response_len, rule_count, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    free(response);
+    ssq_query_decoded(server, &error);
+    return rules;
+}
+
+A2S_RULES *ssq_rules_if_changed(SSQ_SERVER *server, uint16_t *rule_count, bool *unchanged) {
+    size_t response_len;
+    uint64_t fingerprint;
+    uint8_t *response = ssq_query_a2s_changed(server, A2S_QUERY_RULES, &response_len, &fingerprint, unchanged);
     if (response == NULL)
         return NULL;
-    A2S_RULES *rules = ssq_rules_deserialize(response, response_len, rule_count, &server->last_error);
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_RULES *rules = ssq_rules_deserialize(response, response_len, rule_count, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
     free(response);
+    if (error.code == SSQE_OK)
+        ssq_server_learn_fingerprint(server, A2S_QUERY_RULES, fingerprint);
+    ssq_query_decoded(server, &error);
+    return rules;
+}
+
+A2S_RULES *ssq_rules_into(SSQ_SERVER *server, void *buf, size_t buf_size, uint16_t *rule_count, size_t *required) {
+    size_t response_len;
+    uint8_t *response = ssq_query_a2s(server, A2S_QUERY_RULES, &response_len);
+    if (response == NULL)
+        return NULL;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_RULES *rules = ssq_rules_deserialize_into(response, response_len, buf, buf_size, rule_count, required, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    free(response);
+    ssq_query_decoded(server, &error);
     return rules;
 }
 
 void ssq_rules_free(A2S_RULES rules[], uint16_t rule_count) {
-    if (rules == NULL)
-        return;
-    for (uint16_t i = 0; i < rule_count; ++i) {
-        free(rules[i].name);
-        free(rules[i].value);
-    }
+    (void)rule_count;
     free(rules);
 }
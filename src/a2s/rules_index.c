@@ -0,0 +1,216 @@
+#include "ssq/a2s/rules.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "a2s.h"
+#include "helper.h"
+#include "metrics.h"
+#include "query.h"
+#include "server.h"
+#include "trace.h"
+
+/*
+ * Buckets hold the position of a rule plus one (0 marking an empty bucket) in their low half and
+ * the high half of the hash of its name in their high half, so that most mismatches are ruled out
+ * without touching the name.
+ */
+#define SSQ_RULES_BUCKET(rule, hash) (((uint32_t)(hash) & 0xFFFF0000u) | ((uint32_t)(rule) + 1))
+#define SSQ_RULES_BUCKET_EMPTY       0
+
+struct a2s_rules_index {
+    const A2S_RULES *rules;      /* The indexed rules.                                 */
+    A2S_RULES       *owned;      /* `rules' if the index owns them, or NULL.           */
+    uint16_t         rule_count; /* Number of rules in `rules'.                        */
+    size_t           mask;       /* Number of buckets minus one.                       */
+    uint32_t        *buckets;    /* Open-addressing table, linearly probed.            */
+    uint16_t        *sorted;     /* Positions of the rules in byte order of the names. */
+};
+
+static uint32_t ssq_rules_hash(const char name[], size_t name_len) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < name_len; ++i)
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    return hash;
+}
+
+static inline bool ssq_rules_name_equal(const A2S_RULES *rule, const char name[], size_t name_len) {
+    return rule->name_len == name_len && memcmp(rule->name, name, name_len) == 0;
+}
+
+/* Byte order of the names. */
+static inline int ssq_rules_compare(const A2S_RULES *a, const A2S_RULES *b) {
+    int cmp = memcmp(a->name, b->name, ssq_helper_minz(a->name_len, b->name_len));
+    if (cmp != 0)
+        return cmp;
+    return (a->name_len > b->name_len) - (a->name_len < b->name_len);
+}
+
+/* Length of the runs sorted by insertion before being merged. */
+#define SSQ_RULES_SORT_RUN 8
+
+/*
+ * Stable bottom-up merge sort of the positions of the rules, so that the first occurrence of a
+ * name comes first; `tmp' holds as many positions as `sorted'.
+ */
+static void ssq_rules_sort(const A2S_RULES rules[], uint16_t sorted[], uint16_t tmp[], size_t len) {
+    for (size_t run = 0; run < len; run += SSQ_RULES_SORT_RUN) {
+        size_t run_end = ssq_helper_minz(run + SSQ_RULES_SORT_RUN, len);
+        for (size_t i = run; i < run_end; ++i) {
+            uint16_t pos = (uint16_t)i;
+            size_t j = i;
+            for (; j > run && ssq_rules_compare(&rules[sorted[j - 1]], &rules[pos]) > 0; --j)
+                sorted[j] = sorted[j - 1];
+            sorted[j] = pos;
+        }
+    }
+    uint16_t *src = sorted;
+    uint16_t *dst = tmp;
+    for (size_t width = SSQ_RULES_SORT_RUN; width < len; width *= 2) {
+        for (size_t lo = 0; lo < len; lo += 2 * width) {
+            size_t mid = ssq_helper_minz(lo + width, len);
+            size_t hi  = ssq_helper_minz(lo + 2 * width, len);
+            size_t a = lo, b = mid, out = lo;
+            while (a < mid && b < hi)
+                dst[out++] = (ssq_rules_compare(&rules[src[b]], &rules[src[a]]) < 0) ? src[b++] : src[a++];
+            while (a < mid)
+                dst[out++] = src[a++];
+            while (b < hi)
+                dst[out++] = src[b++];
+        }
+        uint16_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != sorted)
+        memcpy(sorted, src, len * sizeof (*sorted));
+}
+
+A2S_RULES_INDEX *ssq_rules_index_new(const A2S_RULES rules[], uint16_t rule_count) {
+    // At most half full, so that probe sequences stay short.
+    size_t bucket_count = 1;
+    while (bucket_count < 2 * (size_t)rule_count)
+        bucket_count <<= 1;
+    // The second half of the positions is only scratch space for the sort.
+    size_t size = sizeof (A2S_RULES_INDEX) + bucket_count * sizeof (uint32_t) + 2 * rule_count * sizeof (uint16_t);
+    A2S_RULES_INDEX *index = malloc(size);
+    if (index == NULL)
+        return NULL;
+    index->rules      = rules;
+    index->owned      = NULL;
+    index->rule_count = rule_count;
+    index->mask       = bucket_count - 1;
+    index->buckets    = (uint32_t *)(index + 1);
+    index->sorted     = (uint16_t *)(index->buckets + bucket_count);
+    memset(index->buckets, SSQ_RULES_BUCKET_EMPTY, bucket_count * sizeof (uint32_t));
+    for (uint16_t i = 0; i < rule_count; ++i) {
+        uint32_t hash = ssq_rules_hash(rules[i].name, rules[i].name_len);
+        size_t bucket = hash & index->mask;
+        bool duplicate = false;
+        for (; index->buckets[bucket] != SSQ_RULES_BUCKET_EMPTY; bucket = (bucket + 1) & index->mask) {
+            uint32_t entry = index->buckets[bucket];
+            if ((entry ^ hash) <= 0xFFFFu && ssq_rules_name_equal(&rules[(entry & 0xFFFFu) - 1], rules[i].name, rules[i].name_len)) {
+                duplicate = true;
+                break;
+            }
+        }
+        if (!duplicate)
+            index->buckets[bucket] = SSQ_RULES_BUCKET(i, hash);
+    }
+    ssq_rules_sort(rules, index->sorted, index->sorted + rule_count, rule_count);
+    return index;
+}
+
+A2S_RULES_INDEX *ssq_rules_indexed(SSQ_SERVER *server) {
+    size_t response_len;
+    uint8_t *response = ssq_query_a2s(server, A2S_QUERY_RULES, &response_len);
+    if (response == NULL)
+        return NULL;
+    // The last error of the server may be stale, and an empty list of rules is no failure.
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    uint16_t rule_count = 0;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    A2S_RULES *rules = ssq_rules_deserialize(response, response_len, &rule_count, &error);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    free(response);
+    ssq_metrics_failed(server, &error);
+    A2S_RULES_INDEX *index = NULL;
+    if (error.code == SSQE_OK) {
+        index = ssq_rules_index_new(rules, (rules != NULL) ? rule_count : 0);
+        if (index == NULL)
+            ssq_error_set_from_errno(&error);
+    }
+    if (index == NULL) {
+        server->last_error = error;
+        ssq_rules_free(rules, rule_count);
+        return NULL;
+    }
+    index->owned = rules;
+    return index;
+}
+
+void ssq_rules_index_free(A2S_RULES_INDEX *index) {
+    if (index == NULL)
+        return;
+    ssq_rules_free(index->owned, index->rule_count);
+    free(index);
+}
+
+const A2S_RULES *ssq_rules_index_rules(const A2S_RULES_INDEX *index, uint16_t *rule_count) {
+    *rule_count = index->rule_count;
+    return index->rules;
+}
+
+const A2S_RULES *ssq_rules_find_len(const A2S_RULES_INDEX *index, const char name[], size_t name_len) {
+    uint32_t hash = ssq_rules_hash(name, name_len);
+    for (size_t bucket = hash & index->mask;; bucket = (bucket + 1) & index->mask) {
+        uint32_t entry = index->buckets[bucket];
+        if (entry == SSQ_RULES_BUCKET_EMPTY)
+            return NULL;
+        const A2S_RULES *rule = &index->rules[(entry & 0xFFFFu) - 1];
+        if ((entry ^ hash) <= 0xFFFFu && ssq_rules_name_equal(rule, name, name_len))
+            return rule;
+    }
+}
+
+const A2S_RULES *ssq_rules_find(const A2S_RULES_INDEX *index, const char name[]) {
+    return ssq_rules_find_len(index, name, strlen(name));
+}
+
+static inline bool ssq_rules_has_prefix(const A2S_RULES *rule, const char prefix[], size_t prefix_len) {
+    return rule->name_len >= prefix_len && memcmp(rule->name, prefix, prefix_len) == 0;
+}
+
+/* Whether the name of `rule' sorts before `prefix' without starting with it. */
+static inline bool ssq_rules_before_prefix(const A2S_RULES *rule, const char prefix[], size_t prefix_len) {
+    int cmp = memcmp(rule->name, prefix, ssq_helper_minz(rule->name_len, prefix_len));
+    return cmp < 0 || (cmp == 0 && rule->name_len < prefix_len);
+}
+
+uint16_t ssq_rules_prefix(const A2S_RULES_INDEX *index, const char prefix[], size_t prefix_len, uint16_t *first) {
+    // The matching names form a run of the sorted rules: find where it starts, then where it ends.
+    size_t lo = 0;
+    size_t hi = index->rule_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ssq_rules_before_prefix(&index->rules[index->sorted[mid]], prefix, prefix_len))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *first = (uint16_t)lo;
+    hi = index->rule_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ssq_rules_has_prefix(&index->rules[index->sorted[mid]], prefix, prefix_len))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (uint16_t)(lo - *first);
+}
+
+const A2S_RULES *ssq_rules_sorted(const A2S_RULES_INDEX *index, uint16_t i) {
+    return &index->rules[index->sorted[i]];
+}
@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Bump allocator carving a result out of a single block; measures only when it has no storage. */
+typedef struct ssq_arena {
+    uint8_t *data;   /* Storage of the block, or NULL when only measuring.   */
+    size_t   size;   /* Size of the block.                                   */
+    size_t   used;   /* Number of bytes handed out so far.                   */
+    bool     borrow; /* Whether strings point into the response being read. */
+} SSQ_ARENA;
+
+static inline void ssq_arena_init(SSQ_ARENA *arena, void *data, size_t size) {
+    arena->data   = data;
+    arena->size   = size;
+    arena->used   = 0;
+    arena->borrow = false;
+}
+
+/* Returns the next `n' bytes of the block, or NULL when measuring or out of space. */
+static inline void *ssq_arena_alloc(SSQ_ARENA *arena, size_t n) {
+    void *ptr = NULL;
+    if (arena->data != NULL && n <= arena->size - arena->used)
+        ptr = arena->data + arena->used;
+    arena->used += n;
+    return ptr;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !ARENA_H */
@@ -0,0 +1,199 @@
+#include "ssq/async.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "async.h"
+#include "helper.h"
+#include "metrics.h"
+#include "response.h"
+#include "trace.h"
+
+static void ssq_async_fail(SSQ_ASYNC *async) {
+    ssq_metrics_failed(async->server, &async->error);
+    async->status = SSQ_ASYNC_FAILED;
+    ssq_reassembly_clear(&async->reassembly);
+    if (async->sockfd != INVALID_SOCKET) {
+        closesocket(async->sockfd);
+        async->sockfd = INVALID_SOCKET;
+    }
+}
+
+static void ssq_async_send(SSQ_ASYNC *async) {
+    if (!ssq_socket_send(async->sockfd, async->payload, async->payload_len, &async->error)) {
+        ssq_async_fail(async);
+        return;
+    }
+    SSQ_TRACE(async->server, SSQ_TRACE_SEND, async->payload_len);
+    // A receive timeout of 0 waits forever, as it does for blocking queries.
+    async->deadline = (async->timeout != 0) ? ssq_helper_clock_millis() + async->timeout : UINT64_MAX;
+}
+
+SSQ_ASYNC *ssq_async_begin(SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    SSQ_ASYNC *async = malloc(sizeof (*async));
+    if (async == NULL)
+        return NULL;
+    memset(async, 0, sizeof (*async));
+    async->server  = server;
+    async->kind    = kind;
+    async->status  = SSQ_ASYNC_PENDING;
+    async->timeout = ssq_server_recv_timeout(server);
+    async->sockfd  = INVALID_SOCKET;
+    ssq_reassembly_init(&async->reassembly);
+    if (!ssq_server_answers(server, kind, &async->error)) {
+        ssq_async_fail(async);
+        return async;
+    }
+    int32_t cached;
+    const int32_t *cached_chall = ssq_server_chall(server, kind, &cached);
+    async->challenged  = (cached_chall != NULL);
+    async->payload_len = ssq_a2s_payload(kind, async->payload, cached_chall);
+    ssq_metrics_count(server, SSQ_METRICS_QUERIES);
+    async->sockfd = ssq_socket_open(server->addr_list, &async->error);
+    if (async->sockfd == INVALID_SOCKET) {
+        ssq_async_fail(async);
+        return async;
+    }
+    if (!ssq_socket_set_nonblocking(async->sockfd)) {
+        ssq_socket_set_error(&async->error);
+        ssq_async_fail(async);
+        return async;
+    }
+    SSQ_TRACE(server, SSQ_TRACE_SOCKET, 0);
+    ssq_async_send(async);
+    return async;
+}
+
+void ssq_async_free(SSQ_ASYNC *async) {
+    if (async == NULL)
+        return;
+    ssq_reassembly_clear(&async->reassembly);
+    if (async->sockfd != INVALID_SOCKET)
+        closesocket(async->sockfd);
+    free(async->response);
+    free(async);
+}
+
+SSQ_SOCKET       ssq_async_fd(const SSQ_ASYNC *async)       { return async->sockfd;   }
+uint64_t         ssq_async_deadline(const SSQ_ASYNC *async) { return async->deadline; }
+uint64_t         ssq_async_now(void)                        { return ssq_helper_clock_millis(); }
+SSQ_ASYNC_STATUS ssq_async_status(const SSQ_ASYNC *async)   { return async->status;   }
+
+/* Handles a complete response: either a challenge to answer or the final result. */
+static void ssq_async_complete(SSQ_ASYNC *async) {
+    size_t response_len;
+    uint8_t *response = ssq_reassembly_to_response(&async->reassembly, &response_len, &async->error);
+    ssq_reassembly_clear(&async->reassembly);
+    if (response == NULL) {
+        ssq_async_fail(async);
+        return;
+    }
+    SSQ_TRACE(async->server, SSQ_TRACE_REASSEMBLED, response_len);
+    if (ssq_response_has_challenge(response, response_len)) {
+        int32_t chall = ssq_response_get_challenge(response, response_len);
+        free(response);
+        ssq_server_learn_chall(async->server, async->kind, chall);
+        ssq_metrics_count(async->server, SSQ_METRICS_CHALLENGES);
+        SSQ_TRACE(async->server, SSQ_TRACE_CHALLENGE, 0);
+        async->challenged  = true;
+        async->payload_len = ssq_a2s_payload(async->kind, async->payload, &chall);
+        ssq_async_send(async);
+        return;
+    }
+    async->response     = response;
+    async->response_len = response_len;
+    async->status       = SSQ_ASYNC_DONE;
+    ssq_server_learn_answer(async->server, async->kind);
+    closesocket(async->sockfd);
+    async->sockfd = INVALID_SOCKET;
+}
+
+SSQ_ASYNC_STATUS ssq_async_on_readable(SSQ_ASYNC *async) {
+    while (async->status == SSQ_ASYNC_PENDING) {
+        long bytes_received = ssq_reassembly_recv(&async->reassembly, async->sockfd, &async->error);
+        ssq_metrics_received(async->server, bytes_received);
+        if (bytes_received != SOCKET_ERROR)
+            SSQ_TRACE(async->server, SSQ_TRACE_RECV, (size_t)bytes_received);
+        if (bytes_received == SOCKET_ERROR && async->error.code == SSQE_OK)
+            break;
+        if (async->error.code != SSQE_OK)
+            ssq_async_fail(async);
+        else if (ssq_reassembly_done(&async->reassembly))
+            ssq_async_complete(async);
+    }
+    return async->status;
+}
+
+SSQ_ASYNC_STATUS ssq_async_on_timeout(SSQ_ASYNC *async) {
+    if (async->status == SSQ_ASYNC_PENDING && ssq_helper_clock_millis() >= async->deadline) {
+        ssq_error_set(&async->error, SSQE_TIMEOUT, "Timed out waiting for a response");
+        if (async->challenged)
+            ssq_server_learn_timeout(async->server, async->kind);
+        ssq_async_fail(async);
+    }
+    return async->status;
+}
+
+/*
+ * Whether the response can be decoded, telling the tracing callback that decoding starts if so. The
+ * error of the query, if any, is left by an earlier decoding: it is cleared for the new one.
+ */
+static bool ssq_async_decoding(SSQ_ASYNC *async) {
+    if (async->status != SSQ_ASYNC_DONE)
+        return false;
+    ssq_async_eclr(async);
+    SSQ_TRACE(async->server, SSQ_TRACE_DECODE_BEGIN, async->response_len);
+    return true;
+}
+
+/* Tells the tracing callback that decoding ended, counts a failure and returns what was decoded. */
+static void *ssq_async_decoded(const SSQ_ASYNC *async, void *decoded) {
+    SSQ_TRACE(async->server, SSQ_TRACE_DECODE_END, 0);
+    ssq_metrics_failed(async->server, &async->error);
+    return decoded;
+}
+
+A2S_INFO *ssq_async_info(SSQ_ASYNC *async) {
+    if (!ssq_async_decoding(async))
+        return NULL;
+    return ssq_async_decoded(async, ssq_info_deserialize(async->response, async->response_len, &async->error));
+}
+
+A2S_PLAYER *ssq_async_player(SSQ_ASYNC *async, uint8_t *player_count) {
+    if (!ssq_async_decoding(async))
+        return NULL;
+    return ssq_async_decoded(async, ssq_player_deserialize(async->response, async->response_len, player_count, &async->error));
+}
+
+A2S_RULES *ssq_async_rules(SSQ_ASYNC *async, uint16_t *rule_count) {
+    if (!ssq_async_decoding(async))
+        return NULL;
+    return ssq_async_decoded(async, ssq_rules_deserialize(async->response, async->response_len, rule_count, &async->error));
+}
+
+A2S_INFO *ssq_async_info_into(SSQ_ASYNC *async, void *buf, size_t buf_size, size_t *required) {
+    if (!ssq_async_decoding(async))
+        return NULL;
+    return ssq_async_decoded(async, ssq_info_deserialize_into(async->response, async->response_len, buf, buf_size, required, &async->error));
+}
+
+A2S_PLAYER *ssq_async_player_into(SSQ_ASYNC *async, void *buf, size_t buf_size, uint8_t *player_count, size_t *required) {
+    if (!ssq_async_decoding(async))
+        return NULL;
+    return ssq_async_decoded(async, ssq_player_deserialize_into(async->response, async->response_len, buf, buf_size, player_count, required, &async->error));
+}
+
+A2S_RULES *ssq_async_rules_into(SSQ_ASYNC *async, void *buf, size_t buf_size, uint16_t *rule_count, size_t *required) {
+    if (!ssq_async_decoding(async))
+        return NULL;
+    return ssq_async_decoded(async, ssq_rules_deserialize_into(async->response, async->response_len, buf, buf_size, rule_count, required, &async->error));
+}
+
+bool           ssq_async_eok(const SSQ_ASYNC *async)   { return ssq_async_ecode(async) == SSQE_OK; }
+SSQ_ERROR_CODE ssq_async_ecode(const SSQ_ASYNC *async) { return async->error.code; }
+const char    *ssq_async_emsg(const SSQ_ASYNC *async)  { return async->error.message; }
+
+void ssq_async_eclr(SSQ_ASYNC *async) {
+    async->error.code = SSQE_OK;
+    async->error.message[0] = '\0';
+}
@@ -0,0 +1,39 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/async.h"
+
+#include "a2s.h"
+#include "error.h"
+#include "packet.h"
+#include "server.h"
+#include "socket.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct ssq_async {
+    SSQ_SERVER      *server;                    /* The server being queried.                    */
+    A2S_QUERY_KIND   kind;                      /* The kind of query being performed.           */
+    bool             challenged;                /* Whether the server sent a challenge.         */
+    SSQ_ASYNC_STATUS status;                    /* Current state of the query.                  */
+    SSQ_ERROR        error;                     /* Error information when the query failed.     */
+    SOCKET           sockfd;                    /* Non-blocking socket connected to the server. */
+    uint64_t         timeout;                   /* Time (in ms) to wait for each response.      */
+    uint64_t         deadline;                  /* Point in time at which the query times out.  */
+    uint8_t          payload[A2S_PAYLOAD_SIZE]; /* Request payload (re)sent to the server.      */
+    size_t           payload_len;               /* Length of the request payload.               */
+    SSQ_REASSEMBLY   reassembly;                /* Packets of the response received so far.     */
+    uint8_t         *response;                  /* The complete response once done.             */
+    size_t           response_len;              /* Length of the complete response.             */
+} SSQ_ASYNC;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !ASYNC_H */
@@ -0,0 +1,638 @@
+#ifdef SSQ_HAVE_MMSG
+# define _GNU_SOURCE
+#endif /* SSQ_HAVE_MMSG */
+
+#include "ssq/batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <netinet/in.h>
+# include <poll.h>
+#endif /* !_WIN32 */
+
+#include "batch.h"
+#include "helper.h"
+#include "metrics.h"
+#include "response.h"
+#include "trace.h"
+
+#define SSQ_BATCH_NO_SLOT ((size_t)-1)
+
+SSQ_BATCH *ssq_batch_new(A2S_QUERY_KIND kind) {
+    SSQ_BATCH *batch = malloc(sizeof (*batch));
+    if (batch == NULL)
+        return NULL;
+    memset(batch, 0, sizeof (*batch));
+    batch->kind    = kind;
+    batch->timeout = SSQ_TIMEOUT_RECV_DEFAULT;
+    batch->window  = SSQ_BATCH_WINDOW_DEFAULT;
+    for (int family = 0; family < SSQ_BATCH_FAMILY_COUNT; ++family)
+        batch->sockfds[family] = INVALID_SOCKET;
+    ssq_batch_eclr(batch);
+    return batch;
+}
+
+void ssq_batch_free(SSQ_BATCH *batch) {
+    if (batch == NULL)
+        return;
+    for (int family = 0; family < SSQ_BATCH_FAMILY_COUNT; ++family)
+        if (batch->sockfds[family] != INVALID_SOCKET)
+            closesocket(batch->sockfds[family]);
+    free(batch);
+}
+
+void ssq_batch_timeout(SSQ_BATCH *batch, uint64_t value_in_ms) {
+    batch->timeout = value_in_ms;
+}
+
+void ssq_batch_window(SSQ_BATCH *batch, size_t max_in_flight) {
+    batch->window = (max_in_flight > 0) ? max_in_flight : 1;
+}
+
+static int ssq_batch_family_of(const struct sockaddr *addr) {
+    return (addr->sa_family == AF_INET6) ? SSQ_BATCH_FAMILY_INET6 : SSQ_BATCH_FAMILY_INET;
+}
+
+static SOCKET ssq_batch_socket(SSQ_BATCH *batch, int family, SSQ_ERROR *error) {
+    if (batch->sockfds[family] != INVALID_SOCKET)
+        return batch->sockfds[family];
+    SOCKET sockfd = socket((family == SSQ_BATCH_FAMILY_INET6) ? AF_INET6 : AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sockfd == INVALID_SOCKET) {
+        ssq_socket_set_error(error);
+        return INVALID_SOCKET;
+    }
+    if (!ssq_socket_set_nonblocking(sockfd)) {
+        ssq_socket_set_error(error);
+        closesocket(sockfd);
+        return INVALID_SOCKET;
+    }
+    // Best effort: a larger buffer absorbs bursts of responses between two receive calls.
+    int rcvbuf = SSQ_BATCH_RCVBUF;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf, sizeof (rcvbuf));
+    batch->sockfds[family] = sockfd;
+    return sockfd;
+}
+
+/* Address map */
+
+static size_t ssq_batch_addr_hash(const struct sockaddr *addr) {
+    const uint8_t *bytes;
+    size_t len;
+    uint16_t port;
+    if (addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+        bytes = (const uint8_t *)&in6->sin6_addr;
+        len   = sizeof (in6->sin6_addr);
+        port  = in6->sin6_port;
+    } else {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+        bytes = (const uint8_t *)&in->sin_addr;
+        len   = sizeof (in->sin_addr);
+        port  = in->sin_port;
+    }
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    hash = (hash ^ (port & 0xFF)) * 16777619u;
+    hash = (hash ^ (port >> 8)) * 16777619u;
+    return hash;
+}
+
+static bool ssq_batch_addr_equal(const struct sockaddr *a, const struct sockaddr *b) {
+    if (a->sa_family != b->sa_family)
+        return false;
+    if (a->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+        const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+        return a6->sin6_port == b6->sin6_port && memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof (a6->sin6_addr)) == 0;
+    }
+    const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+    const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+    return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
+
+static size_t ssq_batch_table_find(const SSQ_BATCH *batch, const struct sockaddr *addr) {
+    for (size_t bucket = ssq_batch_addr_hash(addr) & batch->table_mask;; bucket = (bucket + 1) & batch->table_mask) {
+        size_t slot = batch->table[bucket];
+        if (slot == SSQ_BATCH_NO_SLOT)
+            return SSQ_BATCH_NO_SLOT;
+        if (ssq_batch_addr_equal(addr, (const struct sockaddr *)&batch->slots[slot].addr))
+            return slot;
+    }
+}
+
+static void ssq_batch_table_insert(SSQ_BATCH *batch, size_t slot) {
+    size_t bucket = ssq_batch_addr_hash((const struct sockaddr *)&batch->slots[slot].addr) & batch->table_mask;
+    while (batch->table[bucket] != SSQ_BATCH_NO_SLOT)
+        bucket = (bucket + 1) & batch->table_mask;
+    batch->table[bucket] = slot;
+}
+
+static void ssq_batch_table_remove(SSQ_BATCH *batch, size_t slot) {
+    size_t bucket = ssq_batch_addr_hash((const struct sockaddr *)&batch->slots[slot].addr) & batch->table_mask;
+    while (batch->table[bucket] != slot)
+        bucket = (bucket + 1) & batch->table_mask;
+    // Backward-shift deletion keeps the probe sequences intact without tombstones.
+    for (size_t next = (bucket + 1) & batch->table_mask; batch->table[next] != SSQ_BATCH_NO_SLOT; next = (next + 1) & batch->table_mask) {
+        size_t home = ssq_batch_addr_hash((const struct sockaddr *)&batch->slots[batch->table[next]].addr) & batch->table_mask;
+        bool movable = (bucket <= next) ? (home <= bucket || home > next) : (home <= bucket && home > next);
+        if (movable) {
+            batch->table[bucket] = batch->table[next];
+            bucket = next;
+        }
+    }
+    batch->table[bucket] = SSQ_BATCH_NO_SLOT;
+}
+
+/* Run state */
+
+static bool ssq_batch_state_init(SSQ_BATCH *batch, size_t server_count) {
+    batch->slot_count = ssq_helper_minz(batch->window, server_count);
+    size_t buckets = 1;
+    while (buckets < batch->slot_count * 2)
+        buckets <<= 1;
+    batch->table_mask     = buckets - 1;
+    batch->free_count     = batch->slot_count;
+    batch->send_count     = 0;
+    batch->next_deadline  = UINT64_MAX;
+    batch->deferred_count = 0;
+    batch->deferred_size  = 0;
+    batch->deferred       = NULL;
+    batch->slots          = calloc(batch->slot_count, sizeof (*batch->slots));
+    batch->free_slots     = calloc(batch->slot_count, sizeof (*batch->free_slots));
+    batch->send_queue     = calloc(batch->slot_count, sizeof (*batch->send_queue));
+    batch->table          = malloc(buckets * sizeof (*batch->table));
+    batch->datagrams      = malloc(SSQ_BATCH_VLEN * SSQ_PACKET_SIZE);
+    if (batch->slots == NULL || batch->free_slots == NULL || batch->send_queue == NULL || batch->table == NULL || batch->datagrams == NULL) {
+        ssq_error_set_from_errno(&batch->error);
+        return false;
+    }
+    for (size_t i = 0; i < batch->slot_count; ++i) {
+        batch->free_slots[i] = batch->slot_count - 1 - i;
+        ssq_reassembly_init(&batch->slots[i].reassembly);
+    }
+    for (size_t i = 0; i < buckets; ++i)
+        batch->table[i] = SSQ_BATCH_NO_SLOT;
+    return true;
+}
+
+static void ssq_batch_state_clear(SSQ_BATCH *batch) {
+    if (batch->slots != NULL)
+        for (size_t i = 0; i < batch->slot_count; ++i)
+            ssq_reassembly_clear(&batch->slots[i].reassembly);
+    free(batch->slots);
+    free(batch->free_slots);
+    free(batch->send_queue);
+    free(batch->table);
+    free(batch->deferred);
+    free(batch->datagrams);
+    batch->slots      = NULL;
+    batch->free_slots = NULL;
+    batch->send_queue = NULL;
+    batch->table      = NULL;
+    batch->deferred   = NULL;
+    batch->datagrams  = NULL;
+}
+
+static size_t ssq_batch_in_flight(const SSQ_BATCH *batch) {
+    return batch->slot_count - batch->free_count;
+}
+
+/* Completion */
+
+static void ssq_batch_deliver(SSQ_BATCH *batch, SSQ_SERVER *server, size_t index, const uint8_t response[], size_t response_len, SSQ_BATCH_CALLBACK callback, void *data) {
+    SSQ_BATCH_RESULT result;
+    memset(&result, 0, sizeof (result));
+    if (response != NULL) {
+        SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+        switch (batch->kind) {
+            case A2S_QUERY_INFO:
+                result.info = ssq_info_deserialize(response, response_len, &server->last_error);
+                break;
+            case A2S_QUERY_PLAYER:
+                result.players = ssq_player_deserialize(response, response_len, &result.player_count, &server->last_error);
+                break;
+            case A2S_QUERY_RULES:
+                result.rules = ssq_rules_deserialize(response, response_len, &result.rule_count, &server->last_error);
+                break;
+        }
+        SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+        // The last error of the server was cleared when its query started.
+        ssq_metrics_failed(server, &server->last_error);
+    }
+    callback(server, index, &result, data);
+}
+
+static void ssq_batch_dequeue(SSQ_BATCH *batch, size_t slot) {
+    for (size_t i = 0; i < batch->send_count; ++i) {
+        if (batch->send_queue[i] == slot) {
+            memmove(batch->send_queue + i, batch->send_queue + i + 1, (batch->send_count - i - 1) * sizeof (*batch->send_queue));
+            --batch->send_count;
+            break;
+        }
+    }
+    batch->slots[slot].queued = false;
+}
+
+/* Ends the query of a slot, whatever state it is in: a request still queued is taken off the queue. */
+static void ssq_batch_finish(SSQ_BATCH *batch, size_t slot, const uint8_t response[], size_t response_len, SSQ_BATCH_CALLBACK callback, void *data) {
+    SSQ_BATCH_SLOT *entry = &batch->slots[slot];
+    if (entry->queued)
+        ssq_batch_dequeue(batch, slot);
+    if (response == NULL)
+        ssq_metrics_failed(entry->server, &entry->server->last_error);
+    ssq_batch_table_remove(batch, slot);
+    ssq_reassembly_clear(&entry->reassembly);
+    batch->free_slots[batch->free_count++] = slot;
+    ssq_batch_deliver(batch, entry->server, entry->index, response, response_len, callback, data);
+}
+
+/* A timeout of 0 waits forever, as it does for the other queries. */
+static inline uint64_t ssq_batch_deadline(const SSQ_BATCH *batch, uint64_t now) {
+    return (batch->timeout != 0) ? now + batch->timeout : UINT64_MAX;
+}
+
+/* The time spent waiting for room in the socket buffer counts towards the timeout of the query. */
+static void ssq_batch_enqueue(SSQ_BATCH *batch, size_t slot) {
+    SSQ_BATCH_SLOT *entry = &batch->slots[slot];
+    entry->queued   = true;
+    entry->deadline = ssq_batch_deadline(batch, ssq_helper_clock_millis());
+    if (entry->deadline < batch->next_deadline)
+        batch->next_deadline = entry->deadline;
+    batch->send_queue[batch->send_count++] = slot;
+}
+
+/* Dispatch */
+
+static const struct addrinfo *ssq_batch_target_addr(const SSQ_SERVER *server) {
+    for (const struct addrinfo *addr = server->addr_list; addr != NULL; addr = addr->ai_next)
+        if (addr->ai_family == AF_INET || addr->ai_family == AF_INET6)
+            return addr;
+    return NULL;
+}
+
+static bool ssq_batch_defer(SSQ_BATCH *batch, size_t index) {
+    if (batch->deferred_count == batch->deferred_size) {
+        size_t size = (batch->deferred_size > 0) ? batch->deferred_size * 2 : 16;
+        size_t *deferred = realloc(batch->deferred, size * sizeof (*deferred));
+        if (deferred == NULL) {
+            ssq_error_set_from_errno(&batch->error);
+            return false;
+        }
+        batch->deferred      = deferred;
+        batch->deferred_size = size;
+    }
+    batch->deferred[batch->deferred_count++] = index;
+    return true;
+}
+
+/* Starts the query of a target. Returns false if it shares its address with a query in flight. */
+static bool ssq_batch_dispatch(SSQ_BATCH *batch, SSQ_SERVER *const servers[], size_t index, SSQ_BATCH_CALLBACK callback, void *data) {
+    SSQ_SERVER *server = servers[index];
+    const struct addrinfo *addr = ssq_batch_target_addr(server);
+    if (addr != NULL && ssq_batch_table_find(batch, addr->ai_addr) != SSQ_BATCH_NO_SLOT)
+        return false;
+    ssq_server_eclr(server);
+    if (addr == NULL) {
+        ssq_error_set(&server->last_error, SSQE_NO_SOCKET, "No address to send the query to");
+        ssq_batch_deliver(batch, server, index, NULL, 0, callback, data);
+        return true;
+    }
+    if (!ssq_server_answers(server, batch->kind, &server->last_error)) {
+        ssq_batch_deliver(batch, server, index, NULL, 0, callback, data);
+        return true;
+    }
+    ssq_metrics_count(server, SSQ_METRICS_QUERIES);
+    int family = ssq_batch_family_of(addr->ai_addr);
+    if (ssq_batch_socket(batch, family, &server->last_error) == INVALID_SOCKET) {
+        ssq_metrics_failed(server, &server->last_error);
+        ssq_batch_deliver(batch, server, index, NULL, 0, callback, data);
+        return true;
+    }
+    size_t slot = batch->free_slots[--batch->free_count];
+    SSQ_BATCH_SLOT *entry = &batch->slots[slot];
+    int32_t cached;
+    const int32_t *cached_chall = ssq_server_chall(server, batch->kind, &cached);
+    entry->index       = index;
+    entry->server      = server;
+    entry->family      = family;
+    entry->addr_len    = (socklen_t)addr->ai_addrlen;
+    entry->challenged  = (cached_chall != NULL);
+    entry->payload_len = ssq_a2s_payload(batch->kind, entry->payload, cached_chall);
+    memcpy(&entry->addr, addr->ai_addr, addr->ai_addrlen);
+    ssq_batch_table_insert(batch, slot);
+    ssq_batch_enqueue(batch, slot);
+    return true;
+}
+
+static bool ssq_batch_fill(SSQ_BATCH *batch, SSQ_SERVER *const servers[], size_t server_count, size_t *next, SSQ_BATCH_CALLBACK callback, void *data) {
+    size_t kept = 0;
+    for (size_t i = 0; i < batch->deferred_count; ++i) {
+        if (batch->free_count == 0 || !ssq_batch_dispatch(batch, servers, batch->deferred[i], callback, data))
+            batch->deferred[kept++] = batch->deferred[i];
+    }
+    batch->deferred_count = kept;
+    while (batch->free_count > 0 && *next < server_count) {
+        size_t index = (*next)++;
+        if (!ssq_batch_dispatch(batch, servers, index, callback, data) && !ssq_batch_defer(batch, index))
+            return false;
+    }
+    return true;
+}
+
+/* Sending */
+
+static void ssq_batch_sent(SSQ_BATCH *batch, size_t slot, uint64_t now) {
+    SSQ_TRACE(batch->slots[slot].server, SSQ_TRACE_SEND, batch->slots[slot].payload_len);
+    batch->slots[slot].queued   = false;
+    batch->slots[slot].deadline = ssq_batch_deadline(batch, now);
+    if (batch->slots[slot].deadline < batch->next_deadline)
+        batch->next_deadline = batch->slots[slot].deadline;
+}
+
+static void ssq_batch_send_failed(SSQ_BATCH *batch, size_t slot, SSQ_BATCH_CALLBACK callback, void *data) {
+    batch->slots[slot].queued = false;
+    ssq_socket_set_error(&batch->slots[slot].server->last_error);
+    ssq_batch_finish(batch, slot, NULL, 0, callback, data);
+}
+
+/* Sends up to SSQ_BATCH_VLEN queued requests of the same family. Returns how many were consumed, or 0 if the socket would block. */
+static size_t ssq_batch_send_some(SSQ_BATCH *batch, const size_t queue[], size_t count, uint64_t now, SSQ_BATCH_CALLBACK callback, void *data) {
+    int family = batch->slots[queue[0]].family;
+    SOCKET sockfd = batch->sockfds[family];
+    size_t n = 0;
+    while (n < count && n < SSQ_BATCH_VLEN && batch->slots[queue[n]].family == family)
+        ++n;
+#ifdef SSQ_HAVE_MMSG
+    struct mmsghdr msgs[SSQ_BATCH_VLEN];
+    struct iovec iovs[SSQ_BATCH_VLEN];
+    memset(msgs, 0, n * sizeof (*msgs));
+    for (size_t i = 0; i < n; ++i) {
+        SSQ_BATCH_SLOT *entry = &batch->slots[queue[i]];
+        iovs[i].iov_base                = entry->payload;
+        iovs[i].iov_len                 = entry->payload_len;
+        msgs[i].msg_hdr.msg_name        = &entry->addr;
+        msgs[i].msg_hdr.msg_namelen     = entry->addr_len;
+        msgs[i].msg_hdr.msg_iov         = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen      = 1;
+    }
+    int sent = sendmmsg(sockfd, msgs, (unsigned int)n, 0);
+    if (sent < 0) {
+        if (ssq_socket_would_block())
+            return 0;
+        ssq_batch_send_failed(batch, queue[0], callback, data);
+        return 1;
+    }
+    for (int i = 0; i < sent; ++i)
+        ssq_batch_sent(batch, queue[i], now);
+    return (size_t)sent;
+#else /* !SSQ_HAVE_MMSG */
+    for (size_t i = 0; i < n; ++i) {
+        SSQ_BATCH_SLOT *entry = &batch->slots[queue[i]];
+# ifdef _WIN32
+        int sent = sendto(sockfd, (const char *)entry->payload, (int)entry->payload_len, 0, (const struct sockaddr *)&entry->addr, entry->addr_len);
+# else /* !_WIN32 */
+        ssize_t sent = sendto(sockfd, entry->payload, entry->payload_len, 0, (const struct sockaddr *)&entry->addr, entry->addr_len);
+# endif /* _WIN32 */
+        if (sent == SOCKET_ERROR) {
+            if (ssq_socket_would_block())
+                return i;
+            ssq_batch_send_failed(batch, queue[i], callback, data);
+            return i + 1;
+        }
+        ssq_batch_sent(batch, queue[i], now);
+    }
+    return n;
+#endif /* SSQ_HAVE_MMSG */
+}
+
+/* Returns false if some requests are still queued because the socket buffer is full. */
+static bool ssq_batch_flush(SSQ_BATCH *batch, SSQ_BATCH_CALLBACK callback, void *data) {
+    uint64_t now = ssq_helper_clock_millis();
+    size_t done = 0;
+    while (done < batch->send_count) {
+        size_t consumed = ssq_batch_send_some(batch, batch->send_queue + done, batch->send_count - done, now, callback, data);
+        if (consumed == 0)
+            break;
+        done += consumed;
+    }
+    memmove(batch->send_queue, batch->send_queue + done, (batch->send_count - done) * sizeof (*batch->send_queue));
+    batch->send_count -= done;
+    return batch->send_count == 0;
+}
+
+/* Receiving */
+
+static void ssq_batch_on_complete(SSQ_BATCH *batch, size_t slot, SSQ_BATCH_CALLBACK callback, void *data) {
+    SSQ_BATCH_SLOT *entry = &batch->slots[slot];
+    SSQ_ERROR *error = &entry->server->last_error;
+    size_t response_len;
+    uint8_t *response = ssq_reassembly_to_response(&entry->reassembly, &response_len, error);
+    ssq_reassembly_clear(&entry->reassembly);
+    if (response != NULL)
+        SSQ_TRACE(entry->server, SSQ_TRACE_REASSEMBLED, response_len);
+    if (response != NULL && ssq_response_has_challenge(response, response_len)) {
+        int32_t chall = ssq_response_get_challenge(response, response_len);
+        free(response);
+        ssq_server_learn_chall(entry->server, batch->kind, chall);
+        ssq_metrics_count(entry->server, SSQ_METRICS_CHALLENGES);
+        SSQ_TRACE(entry->server, SSQ_TRACE_CHALLENGE, 0);
+        entry->challenged  = true;
+        entry->payload_len = ssq_a2s_payload(batch->kind, entry->payload, &chall);
+        if (!entry->queued)
+            ssq_batch_enqueue(batch, slot);
+        return;
+    }
+    if (response != NULL)
+        ssq_server_learn_answer(entry->server, batch->kind);
+    ssq_batch_finish(batch, slot, response, response_len, callback, data);
+    free(response);
+}
+
+static void ssq_batch_on_datagram(SSQ_BATCH *batch, const struct sockaddr *from, const uint8_t datagram[], size_t datagram_len, SSQ_BATCH_CALLBACK callback, void *data) {
+    size_t slot = ssq_batch_table_find(batch, from);
+    if (slot == SSQ_BATCH_NO_SLOT)
+        return; // Late or unsolicited datagram.
+    SSQ_BATCH_SLOT *entry = &batch->slots[slot];
+    SSQ_ERROR *error = &entry->server->last_error;
+    ssq_metrics_received(entry->server, (long)datagram_len);
+    SSQ_TRACE(entry->server, SSQ_TRACE_RECV, datagram_len);
+    ssq_reassembly_add(&entry->reassembly, datagram, datagram_len, error);
+    if (error->code != SSQE_OK)
+        ssq_batch_finish(batch, slot, NULL, 0, callback, data);
+    else if (ssq_reassembly_done(&entry->reassembly))
+        ssq_batch_on_complete(batch, slot, callback, data);
+}
+
+/* Whether a receive error leaves the socket usable: no datagram, a signal, or (on Windows) a target refusing an earlier request. */
+static bool ssq_batch_recv_transient(void) {
+#ifdef _WIN32
+    return ssq_socket_would_block() || WSAGetLastError() == WSAECONNRESET;
+#else /* !_WIN32 */
+    return ssq_socket_would_block() || errno == EINTR;
+#endif /* _WIN32 */
+}
+
+/*
+ * Any other receive error cannot be tied to a target: it is stored in the error of the batch and
+ * fails every query going through the socket, which is closed (the next query opens another one).
+ */
+static void ssq_batch_recv_failed(SSQ_BATCH *batch, int family, SSQ_BATCH_CALLBACK callback, void *data) {
+    SSQ_ERROR error;
+    ssq_socket_set_error(&error);
+    if (batch->error.code == SSQE_OK)
+        batch->error = error;
+    for (size_t bucket = 0; bucket <= batch->table_mask; ++bucket) {
+        size_t slot = batch->table[bucket];
+        if (slot == SSQ_BATCH_NO_SLOT || batch->slots[slot].family != family)
+            continue;
+        batch->slots[slot].server->last_error = error;
+        ssq_batch_finish(batch, slot, NULL, 0, callback, data);
+        --bucket; // The removal may have shifted another entry into this bucket.
+    }
+    closesocket(batch->sockfds[family]);
+    batch->sockfds[family] = INVALID_SOCKET;
+}
+
+/* Receives up to SSQ_BATCH_VLEN datagrams. Returns how many were received. */
+static size_t ssq_batch_recv_some(SSQ_BATCH *batch, int family, SSQ_BATCH_CALLBACK callback, void *data) {
+    SOCKET sockfd = batch->sockfds[family];
+    struct sockaddr_storage from[SSQ_BATCH_VLEN];
+#ifdef SSQ_HAVE_MMSG
+    struct mmsghdr msgs[SSQ_BATCH_VLEN];
+    struct iovec iovs[SSQ_BATCH_VLEN];
+    memset(msgs, 0, sizeof (msgs));
+    for (size_t i = 0; i < SSQ_BATCH_VLEN; ++i) {
+        iovs[i].iov_base            = batch->datagrams + i * SSQ_PACKET_SIZE;
+        iovs[i].iov_len             = SSQ_PACKET_SIZE;
+        msgs[i].msg_hdr.msg_name    = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof (from[i]);
+        msgs[i].msg_hdr.msg_iov     = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+    int received = recvmmsg(sockfd, msgs, SSQ_BATCH_VLEN, 0, NULL);
+    if (received < 0 && !ssq_batch_recv_transient())
+        ssq_batch_recv_failed(batch, family, callback, data);
+    if (received <= 0)
+        return 0;
+    for (int i = 0; i < received; ++i)
+        ssq_batch_on_datagram(batch, (const struct sockaddr *)&from[i], iovs[i].iov_base, msgs[i].msg_len, callback, data);
+    return (size_t)received;
+#else /* !SSQ_HAVE_MMSG */
+    size_t received = 0;
+    for (; received < SSQ_BATCH_VLEN; ++received) {
+        uint8_t *datagram = batch->datagrams + received * SSQ_PACKET_SIZE;
+        socklen_t from_len = sizeof (from[received]);
+# ifdef _WIN32
+        int datagram_len = recvfrom(sockfd, (char *)datagram, SSQ_PACKET_SIZE, 0, (struct sockaddr *)&from[received], &from_len);
+# else /* !_WIN32 */
+        ssize_t datagram_len = recvfrom(sockfd, datagram, SSQ_PACKET_SIZE, 0, (struct sockaddr *)&from[received], &from_len);
+# endif /* _WIN32 */
+        if (datagram_len == SOCKET_ERROR) {
+            if (!ssq_batch_recv_transient())
+                ssq_batch_recv_failed(batch, family, callback, data);
+            break;
+        }
+        ssq_batch_on_datagram(batch, (const struct sockaddr *)&from[received], datagram, (size_t)datagram_len, callback, data);
+    }
+    return received;
+#endif /* SSQ_HAVE_MMSG */
+}
+
+static void ssq_batch_recv(SSQ_BATCH *batch, SSQ_BATCH_CALLBACK callback, void *data) {
+    for (int family = 0; family < SSQ_BATCH_FAMILY_COUNT; ++family) {
+        if (batch->sockfds[family] == INVALID_SOCKET)
+            continue;
+        while (ssq_batch_recv_some(batch, family, callback, data) == SSQ_BATCH_VLEN)
+            continue;
+    }
+}
+
+/* Times out the expired queries and updates the earliest remaining deadline. */
+static void ssq_batch_expire(SSQ_BATCH *batch, SSQ_BATCH_CALLBACK callback, void *data) {
+    uint64_t now = ssq_helper_clock_millis();
+    if (now < batch->next_deadline)
+        return;
+    uint64_t next_deadline = UINT64_MAX;
+    for (size_t bucket = 0; bucket <= batch->table_mask; ++bucket) {
+        size_t slot = batch->table[bucket];
+        if (slot == SSQ_BATCH_NO_SLOT)
+            continue;
+        SSQ_BATCH_SLOT *entry = &batch->slots[slot];
+        if (now < entry->deadline) {
+            if (entry->deadline < next_deadline)
+                next_deadline = entry->deadline;
+            continue;
+        }
+        ssq_error_set(&entry->server->last_error, SSQE_TIMEOUT, "Timed out waiting for a response");
+        // A request still queued never went out: the socket buffer stayed full.
+        if (!entry->queued && entry->challenged)
+            ssq_server_learn_timeout(entry->server, batch->kind);
+        ssq_batch_finish(batch, slot, NULL, 0, callback, data);
+        --bucket; // The removal may have shifted another entry into this bucket.
+    }
+    batch->next_deadline = next_deadline;
+}
+
+/* Waits until a socket is readable (or writable if `want_write') or the deadline passes. */
+static void ssq_batch_wait(const SSQ_BATCH *batch, bool want_write, uint64_t deadline) {
+    uint64_t now = ssq_helper_clock_millis();
+    int timeout = (deadline > now) ? (int)ssq_helper_minz(deadline - now, 1000) : 0;
+#ifdef _WIN32
+    fd_set readfds, writefds;
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    for (int family = 0; family < SSQ_BATCH_FAMILY_COUNT; ++family) {
+        if (batch->sockfds[family] == INVALID_SOCKET)
+            continue;
+        FD_SET(batch->sockfds[family], &readfds);
+        if (want_write)
+            FD_SET(batch->sockfds[family], &writefds);
+    }
+    struct timeval tv = { timeout / 1000, timeout % 1000 * 1000 };
+    select(0, &readfds, &writefds, NULL, &tv);
+#else /* !_WIN32 */
+    struct pollfd pfds[SSQ_BATCH_FAMILY_COUNT];
+    nfds_t nfds = 0;
+    for (int family = 0; family < SSQ_BATCH_FAMILY_COUNT; ++family) {
+        if (batch->sockfds[family] == INVALID_SOCKET)
+            continue;
+        pfds[nfds].fd      = batch->sockfds[family];
+        pfds[nfds].events  = POLLIN | (want_write ? POLLOUT : 0);
+        pfds[nfds].revents = 0;
+        ++nfds;
+    }
+    poll(pfds, nfds, timeout);
+#endif /* _WIN32 */
+}
+
+bool ssq_batch_run(SSQ_BATCH *batch, SSQ_SERVER *const servers[], size_t server_count, SSQ_BATCH_CALLBACK callback, void *data) {
+    if (server_count == 0)
+        return true;
+    bool ok = ssq_batch_state_init(batch, server_count);
+    size_t next = 0;
+    while (ok) {
+        ok = ssq_batch_fill(batch, servers, server_count, &next, callback, data);
+        if (!ok || ssq_batch_in_flight(batch) == 0)
+            break;
+        bool flushed = ssq_batch_flush(batch, callback, data);
+        ssq_batch_expire(batch, callback, data);
+        if (ssq_batch_in_flight(batch) == 0)
+            continue;
+        ssq_batch_wait(batch, !flushed, batch->next_deadline);
+        ssq_batch_recv(batch, callback, data);
+    }
+    ssq_batch_state_clear(batch);
+    return ok;
+}
+
+bool           ssq_batch_eok(const SSQ_BATCH *batch)   { return ssq_batch_ecode(batch) == SSQE_OK; }
+SSQ_ERROR_CODE ssq_batch_ecode(const SSQ_BATCH *batch) { return batch->error.code; }
+const char    *ssq_batch_emsg(const SSQ_BATCH *batch)  { return batch->error.message; }
+
+void ssq_batch_eclr(SSQ_BATCH *batch) {
+    batch->error.code = SSQE_OK;
+    batch->error.message[0] = '\0';
+}
@@ -0,0 +1,71 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/batch.h"
+
+#include "a2s.h"
+#include "error.h"
+#include "packet.h"
+#include "server.h"
+#include "socket.h"
+
+/* Maximum number of datagrams exchanged per system call. */
+#define SSQ_BATCH_VLEN 64
+
+/* Receive buffer size requested for the batch sockets. */
+#define SSQ_BATCH_RCVBUF (4 * 1024 * 1024)
+
+#define SSQ_BATCH_FAMILY_INET  0
+#define SSQ_BATCH_FAMILY_INET6 1
+#define SSQ_BATCH_FAMILY_COUNT 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct ssq_batch_slot {
+    size_t                  index;                     /* Index of the target being queried.         */
+    SSQ_SERVER             *server;                    /* The server being queried.                  */
+    struct sockaddr_storage addr;                      /* Address the request is sent to.            */
+    socklen_t               addr_len;                  /* Length of `addr'.                          */
+    int                     family;                    /* Socket the query goes through.             */
+    uint8_t                 payload[A2S_PAYLOAD_SIZE]; /* Request payload (re)sent to the server.    */
+    size_t                  payload_len;               /* Length of the request payload.             */
+    bool                    challenged;                /* Whether the request carries a challenge.   */
+    bool                    queued;                    /* Whether the request is waiting to be sent. */
+    uint64_t                deadline;                  /* Point in time at which it times out.        */
+    SSQ_REASSEMBLY          reassembly;                /* Packets of the response received so far.   */
+} SSQ_BATCH_SLOT;
+
+typedef struct ssq_batch {
+    A2S_QUERY_KIND  kind;                           /* The kind of query performed on every target.  */
+    SSQ_ERROR       error;                          /* Error information about the batch itself.     */
+    uint64_t        timeout;                        /* Time (in ms) to wait for each response.       */
+    size_t          window;                         /* Maximum number of queries in flight.          */
+    SOCKET          sockfds[SSQ_BATCH_FAMILY_COUNT]; /* Unconnected sockets, one per address family. */
+
+    /* State of the run in progress. */
+    SSQ_BATCH_SLOT *slots;                          /* Queries in flight.                            */
+    size_t          slot_count;                     /* Number of entries in `slots'.                 */
+    size_t         *free_slots;                     /* Stack of unused slots.                        */
+    size_t          free_count;                     /* Number of unused slots.                       */
+    size_t         *table;                          /* Open-addressed map from address to slot.      */
+    size_t          table_mask;                     /* Number of buckets in `table' minus one.       */
+    size_t         *send_queue;                     /* Slots whose request is waiting to be sent.    */
+    size_t          send_count;                     /* Number of entries in `send_queue'.            */
+    uint64_t        next_deadline;                  /* Earliest deadline of the queries in flight.   */
+    size_t         *deferred;                       /* Targets sharing the address of a query.       */
+    size_t          deferred_count;                 /* Number of entries in `deferred'.              */
+    size_t          deferred_size;                  /* Capacity of `deferred'.                       */
+    uint8_t        *datagrams;                      /* Receive buffers for SSQ_BATCH_VLEN datagrams. */
+} SSQ_BATCH;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !BATCH_H */
@@ -0,0 +1,327 @@
+#include "ssq/cache.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "helper.h"
+#include "server.h"
+#include "thread.h"
+
+#define SSQ_CACHE_BUCKETS_MIN 64
+
+typedef struct ssq_cache_entry {
+    struct ssq_cache_entry *next;       /* Next entry of the same bucket.                    */
+    struct ssq_cache_entry *next_stale; /* Next entry waiting for a refresh thread.          */
+    SSQ_SERVER             *server;     /* The server queried.                               */
+    A2S_QUERY_KIND          kind;       /* The query sent.                                   */
+    SSQ_RESULT             *result;     /* Result of the last query that succeeded, or NULL. */
+    uint64_t                received;   /* When `result' was received.                       */
+    SSQ_CALL                call;       /* Outcome of the last query.                        */
+    uint64_t                queries;    /* Number of queries completed.                      */
+    size_t                  users;      /* Number of callers holding on to the entry.        */
+    bool                    in_flight;  /* Whether a query is in flight, or queued.          */
+    bool                    queued;     /* Whether the query waits for a refresh thread.     */
+    bool                    evicted;    /* Whether the entry left the table.                 */
+} SSQ_CACHE_ENTRY;
+
+struct ssq_cache {
+    uint64_t          ttl;          /* How long a result is fresh, in milliseconds.        */
+    uint64_t          expiry;       /* How long a result is returned at all.               */
+    SSQ_THREAD       *threads;      /* Refresh threads.                                    */
+    size_t            thread_count; /* Number of entries in `threads'.                     */
+
+    SSQ_MUTEX         mutex;        /* Protects every member below and the entries.        */
+    SSQ_COND          work_cond;    /* Signaled when an entry is queued or on shutdown.    */
+    SSQ_COND          done_cond;    /* Signaled when a query completes or a user leaves.   */
+    SSQ_CACHE_ENTRY **buckets;      /* Chained hash table of the entries.                  */
+    size_t            bucket_count; /* Number of buckets, a power of two.                  */
+    size_t            entry_count;  /* Number of entries in the table.                     */
+    SSQ_CACHE_ENTRY  *stale_head;   /* First entry waiting for a refresh thread.           */
+    SSQ_CACHE_ENTRY  *stale_tail;   /* Last entry waiting for a refresh thread.            */
+    bool              stopping;     /* Whether the threads must exit.                      */
+};
+
+static size_t ssq_cache_hash(const SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    uint64_t key = ((uint64_t)(uintptr_t)server ^ (uint64_t)kind) * UINT64_C(0x9E3779B97F4A7C15);
+    return (size_t)(key >> 32);
+}
+
+/* Returns the link to the entry of the key, which points to NULL if there is none. */
+static SSQ_CACHE_ENTRY **ssq_cache_find(SSQ_CACHE *cache, const SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    SSQ_CACHE_ENTRY **link = &cache->buckets[ssq_cache_hash(server, kind) & (cache->bucket_count - 1)];
+    while (*link != NULL && ((*link)->server != server || (*link)->kind != kind))
+        link = &(*link)->next;
+    return link;
+}
+
+static void ssq_cache_entry_free(SSQ_CACHE_ENTRY *entry) {
+    ssq_result_free(entry->result);
+    free(entry);
+}
+
+/* Whether no caller nor query needs the entry. */
+static inline bool ssq_cache_entry_idle(const SSQ_CACHE_ENTRY *entry) {
+    return entry->users == 0 && !entry->in_flight;
+}
+
+/* Frees the idle entries that have nothing to return anymore. */
+static void ssq_cache_prune(SSQ_CACHE *cache) {
+    uint64_t now = ssq_helper_clock_millis();
+    for (size_t i = 0; i < cache->bucket_count; ++i) {
+        SSQ_CACHE_ENTRY **link = &cache->buckets[i];
+        while (*link != NULL) {
+            SSQ_CACHE_ENTRY *entry = *link;
+            if (ssq_cache_entry_idle(entry) && (entry->result == NULL || now - entry->received >= cache->expiry)) {
+                *link = entry->next;
+                ssq_cache_entry_free(entry);
+                --cache->entry_count;
+            } else {
+                link = &entry->next;
+            }
+        }
+    }
+}
+
+static bool ssq_cache_grow(SSQ_CACHE *cache) {
+    size_t bucket_count = cache->bucket_count * 2;
+    SSQ_CACHE_ENTRY **buckets = calloc(bucket_count, sizeof (*buckets));
+    if (buckets == NULL)
+        return false;
+    for (size_t i = 0; i < cache->bucket_count; ++i) {
+        SSQ_CACHE_ENTRY *entry = cache->buckets[i];
+        while (entry != NULL) {
+            SSQ_CACHE_ENTRY *next = entry->next;
+            size_t bucket = ssq_cache_hash(entry->server, entry->kind) & (bucket_count - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets      = buckets;
+    cache->bucket_count = bucket_count;
+    return true;
+}
+
+/* Returns the entry of the key, added if there is none, or NULL if it could not be. */
+static SSQ_CACHE_ENTRY *ssq_cache_entry(SSQ_CACHE *cache, SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    SSQ_CACHE_ENTRY **link = ssq_cache_find(cache, server, kind);
+    if (*link != NULL)
+        return *link;
+    // Pruning once the table is full leaves at least half of it free before the next time.
+    if (cache->entry_count >= cache->bucket_count) {
+        ssq_cache_prune(cache);
+        if (cache->entry_count >= cache->bucket_count / 2 && !ssq_cache_grow(cache))
+            return NULL;
+        link = ssq_cache_find(cache, server, kind);
+    }
+    SSQ_CACHE_ENTRY *entry = calloc(1, sizeof (*entry));
+    if (entry == NULL)
+        return NULL;
+    entry->server = server;
+    entry->kind   = kind;
+    *link = entry;
+    ++cache->entry_count;
+    return entry;
+}
+
+/* Records the outcome of the query of an entry; the entry takes over the reference to `result'. */
+static void ssq_cache_complete(SSQ_CACHE *cache, SSQ_CACHE_ENTRY *entry, SSQ_RESULT *result, const SSQ_CALL *call) {
+    if (result != NULL) {
+        ssq_result_free(entry->result);
+        entry->result   = result;
+        entry->received = ssq_helper_clock_millis();
+    }
+    entry->call = *call;
+    ++entry->queries;
+    entry->in_flight = false;
+    ssq_cond_broadcast(&cache->done_cond);
+}
+
+/* Refresh threads */
+
+static void ssq_cache_queue(SSQ_CACHE *cache, SSQ_CACHE_ENTRY *entry) {
+    entry->in_flight  = true;
+    entry->queued     = true;
+    entry->next_stale = NULL;
+    if (cache->stale_tail != NULL)
+        cache->stale_tail->next_stale = entry;
+    else
+        cache->stale_head = entry;
+    cache->stale_tail = entry;
+    ssq_cond_signal(&cache->work_cond);
+}
+
+static void ssq_cache_dequeue(SSQ_CACHE *cache, SSQ_CACHE_ENTRY *entry) {
+    SSQ_CACHE_ENTRY *prev = NULL;
+    SSQ_CACHE_ENTRY **link = &cache->stale_head;
+    while (*link != entry) {
+        prev = *link;
+        link = &prev->next_stale;
+    }
+    *link = entry->next_stale;
+    if (cache->stale_tail == entry)
+        cache->stale_tail = prev;
+    entry->queued    = false;
+    entry->in_flight = false;
+    ssq_cond_broadcast(&cache->done_cond);
+}
+
+static void ssq_cache_thread(void *arg) {
+    SSQ_CACHE *cache = arg;
+    ssq_mutex_lock(&cache->mutex);
+    for (;;) {
+        while (cache->stale_head == NULL && !cache->stopping)
+            ssq_cond_wait(&cache->work_cond, &cache->mutex);
+        if (cache->stopping)
+            break;
+        SSQ_CACHE_ENTRY *entry = cache->stale_head;
+        cache->stale_head = entry->next_stale;
+        if (cache->stale_head == NULL)
+            cache->stale_tail = NULL;
+        entry->queued = false;
+        ssq_mutex_unlock(&cache->mutex);
+        SSQ_CALL call;
+        SSQ_RESULT *result = ssq_call_result(entry->server, entry->kind, &call);
+        ssq_mutex_lock(&cache->mutex);
+        // A failed refresh leaves the stale result in place until it expires.
+        ssq_cache_complete(cache, entry, result, &call);
+    }
+    ssq_mutex_unlock(&cache->mutex);
+}
+
+/* Lifecycle */
+
+SSQ_CACHE *ssq_cache_new(uint64_t ttl_in_ms, uint64_t stale_in_ms, size_t thread_count) {
+    SSQ_CACHE *cache = calloc(1, sizeof (*cache));
+    if (cache == NULL)
+        return NULL;
+    if (thread_count == 0)
+        thread_count = SSQ_CACHE_THREADS_DEFAULT;
+    cache->ttl          = ttl_in_ms;
+    cache->expiry       = (stale_in_ms > UINT64_MAX - ttl_in_ms) ? UINT64_MAX : ttl_in_ms + stale_in_ms;
+    cache->bucket_count = SSQ_CACHE_BUCKETS_MIN;
+    cache->buckets      = calloc(cache->bucket_count, sizeof (*cache->buckets));
+    cache->threads      = calloc(thread_count, sizeof (*cache->threads));
+    if (cache->buckets == NULL || cache->threads == NULL) {
+        free(cache->threads);
+        free(cache->buckets);
+        free(cache);
+        return NULL;
+    }
+    ssq_mutex_init(&cache->mutex);
+    ssq_cond_init(&cache->work_cond);
+    ssq_cond_init(&cache->done_cond);
+    if (stale_in_ms == 0)
+        return cache;
+    while (cache->thread_count < thread_count && ssq_thread_start(&cache->threads[cache->thread_count], ssq_cache_thread, cache))
+        ++cache->thread_count;
+    if (cache->thread_count == 0) {
+        ssq_cache_free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void ssq_cache_free(SSQ_CACHE *cache) {
+    if (cache == NULL)
+        return;
+    ssq_mutex_lock(&cache->mutex);
+    cache->stopping = true;
+    ssq_cond_broadcast(&cache->work_cond);
+    ssq_mutex_unlock(&cache->mutex);
+    for (size_t i = 0; i < cache->thread_count; ++i)
+        ssq_thread_join(cache->threads[i]);
+    for (size_t i = 0; i < cache->bucket_count; ++i) {
+        SSQ_CACHE_ENTRY *entry = cache->buckets[i];
+        while (entry != NULL) {
+            SSQ_CACHE_ENTRY *next = entry->next;
+            ssq_cache_entry_free(entry);
+            entry = next;
+        }
+    }
+    ssq_cond_destroy(&cache->done_cond);
+    ssq_cond_destroy(&cache->work_cond);
+    ssq_mutex_destroy(&cache->mutex);
+    free(cache->buckets);
+    free(cache->threads);
+    free(cache);
+}
+
+/* Lookups */
+
+SSQ_RESULT *ssq_cache_get(SSQ_CACHE *cache, SSQ_SERVER *server, A2S_QUERY_KIND kind, SSQ_CALL *call) {
+    ssq_mutex_lock(&cache->mutex);
+    SSQ_CACHE_ENTRY *entry = ssq_cache_entry(cache, server, kind);
+    if (entry == NULL) {
+        ssq_mutex_unlock(&cache->mutex);
+        SSQ_ERROR error;
+        ssq_error_set_from_errno(&error);
+        call->code = error.code;
+        memcpy(call->message, error.message, SSQ_CALL_MESSAGE_SIZE);
+        return NULL;
+    }
+    ++entry->users;
+    SSQ_RESULT *result = NULL;
+    for (;;) {
+        uint64_t age = ssq_helper_clock_millis() - entry->received;
+        if (entry->result != NULL && age < cache->expiry) {
+            // Stale results are refreshed by a thread of the cache, one query at a time.
+            if (age >= cache->ttl && !entry->in_flight)
+                ssq_cache_queue(cache, entry);
+            result = ssq_result_ref(entry->result);
+            call->code       = SSQE_OK;
+            call->message[0] = '\0';
+            break;
+        }
+        if (!entry->in_flight) {
+            entry->in_flight = true;
+            ssq_mutex_unlock(&cache->mutex);
+            result = ssq_call_result(server, kind, call);
+            ssq_mutex_lock(&cache->mutex);
+            ssq_cache_complete(cache, entry, (result != NULL) ? ssq_result_ref(result) : NULL, call);
+            break;
+        }
+        // The outcome of the query in flight is everyone's, failures included. A refresh still
+        // queued may be called off by an eviction instead.
+        uint64_t queries = entry->queries;
+        while (entry->queries == queries && entry->in_flight)
+            ssq_cond_wait(&cache->done_cond, &cache->mutex);
+        if (entry->queries != queries) {
+            if (entry->call.code == SSQE_OK && entry->result != NULL)
+                result = ssq_result_ref(entry->result);
+            *call = entry->call;
+            break;
+        }
+    }
+    if (--entry->users == 0 && entry->evicted)
+        ssq_cond_broadcast(&cache->done_cond);
+    ssq_mutex_unlock(&cache->mutex);
+    return result;
+}
+
+void ssq_cache_evict(SSQ_CACHE *cache, const SSQ_SERVER *server) {
+    SSQ_CACHE_ENTRY *evicted[SSQ_SERVER_KIND_COUNT];
+    size_t evicted_count = 0;
+    ssq_mutex_lock(&cache->mutex);
+    for (int kind = A2S_QUERY_INFO; kind <= A2S_QUERY_RULES; ++kind) {
+        SSQ_CACHE_ENTRY **link = ssq_cache_find(cache, server, (A2S_QUERY_KIND)kind);
+        SSQ_CACHE_ENTRY *entry = *link;
+        if (entry == NULL)
+            continue;
+        *link = entry->next;
+        --cache->entry_count;
+        entry->evicted = true;
+        if (entry->queued)
+            ssq_cache_dequeue(cache, entry);
+        evicted[evicted_count++] = entry;
+    }
+    for (size_t i = 0; i < evicted_count; ++i) {
+        while (!ssq_cache_entry_idle(evicted[i]))
+            ssq_cond_wait(&cache->done_cond, &cache->mutex);
+        ssq_cache_entry_free(evicted[i]);
+    }
+    ssq_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,64 @@
+#include "ssq/call.h"
+
+#include <string.h>
+
+#include "error.h"
+#include "server.h"
+
+/* The message of a call holds any message of the library. */
+typedef char ssq_call_message_size_check[(SSQ_CALL_MESSAGE_SIZE == SSQ_ERROR_MESSAGE_SIZE) ? 1 : -1];
+
+/* Every call runs on a view of the server, whose last error is the call's own. */
+static void ssq_call_end(SSQ_SERVER *server, const SSQ_SERVER *view, const SSQ_SERVER_LEARNT *learnt, SSQ_CALL *call) {
+    ssq_server_publish(server, view, learnt);
+    call->code = view->last_error.code;
+    memcpy(call->message, view->last_error.message, SSQ_CALL_MESSAGE_SIZE);
+}
+
+A2S_INFO *ssq_call_info(SSQ_SERVER *server, SSQ_CALL *call) {
+    SSQ_SERVER view;
+    SSQ_SERVER_LEARNT learnt;
+    ssq_server_view(&view, server, &learnt);
+    A2S_INFO *info = ssq_info(&view);
+    ssq_call_end(server, &view, &learnt, call);
+    return info;
+}
+
+A2S_PLAYER *ssq_call_player(SSQ_SERVER *server, uint8_t *player_count, SSQ_CALL *call) {
+    SSQ_SERVER view;
+    SSQ_SERVER_LEARNT learnt;
+    ssq_server_view(&view, server, &learnt);
+    A2S_PLAYER *players = ssq_player(&view, player_count);
+    ssq_call_end(server, &view, &learnt, call);
+    return players;
+}
+
+A2S_RULES *ssq_call_rules(SSQ_SERVER *server, uint16_t *rule_count, SSQ_CALL *call) {
+    SSQ_SERVER view;
+    SSQ_SERVER_LEARNT learnt;
+    ssq_server_view(&view, server, &learnt);
+    A2S_RULES *rules = ssq_rules(&view, rule_count);
+    ssq_call_end(server, &view, &learnt, call);
+    return rules;
+}
+
+SSQ_RESULT *ssq_call_result(SSQ_SERVER *server, A2S_QUERY_KIND kind, SSQ_CALL *call) {
+    SSQ_SERVER view;
+    SSQ_SERVER_LEARNT learnt;
+    ssq_server_view(&view, server, &learnt);
+    SSQ_RESULT *result = ssq_result_new(&view, kind);
+    ssq_call_end(server, &view, &learnt, call);
+    return result;
+}
+
+SSQ_RESULT *ssq_call_result_if_changed(SSQ_SERVER *server, A2S_QUERY_KIND kind, uint64_t *fingerprint, bool *unchanged, SSQ_CALL *call) {
+    SSQ_SERVER view;
+    SSQ_SERVER_LEARNT learnt;
+    ssq_server_view(&view, server, &learnt);
+    // The view compares the response with the fingerprint of the caller and learns into it.
+    view.fingerprints[kind] = *fingerprint;
+    SSQ_RESULT *result = ssq_result_if_changed(&view, kind, unchanged);
+    *fingerprint = view.fingerprints[kind];
+    ssq_call_end(server, &view, &learnt, call);
+    return result;
+}
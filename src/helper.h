@@ -6,8 +6,10 @@
 #include <string.h>
 #ifdef _WIN32
 # include <winsock2.h>
+# include <windows.h>
 #else /* !_WIN32 */
 # include <sys/time.h>
+# include <time.h>
 #endif /* _WIN32 */
 
 #define SSQ_PORT_LEN  5
@@ -17,6 +19,10 @@ static inline size_t ssq_helper_minz(size_t x, size_t y) {
     return (x < y) ? x : y;
 }
 
+static inline size_t ssq_helper_maxz(size_t x, size_t y) {
+    return (x > y) ? x : y;
+}
+
 static inline void ssq_helper_strncpy(char dest[], const char src[], size_t len) {
 #ifdef _WIN32
     strncpy_s(dest, len + 1, src, len);
@@ -38,6 +44,35 @@ static inline void ssq_helper_millis_to_timeval(time_t value_in_ms, struct timev
     tv->tv_sec = value_in_ms / 1000;
     tv->tv_usec = value_in_ms % 1000 * 1000;
 }
+
+static inline uint64_t ssq_helper_timeval_to_millis(const struct timeval *tv) {
+    return (uint64_t)tv->tv_sec * 1000 + (uint64_t)tv->tv_usec / 1000;
+}
 #endif /* !_WIN32 */
 
+/* Milliseconds elapsed on a monotonic clock since an unspecified point in time. */
+static inline uint64_t ssq_helper_clock_millis(void) {
+#ifdef _WIN32
+    return GetTickCount64();
+#else /* !_WIN32 */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif /* _WIN32 */
+}
+
+/* Nanoseconds elapsed on a monotonic clock since an unspecified point in time. */
+static inline uint64_t ssq_helper_clock_nanos(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else /* !_WIN32 */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif /* _WIN32 */
+}
+
 #endif /* !HELPER_H */
@@ -0,0 +1,107 @@
+#include "ssq/master.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packet.h"
+#include "query.h"
+#include "response.h"
+#include "server.h"
+#include "stream.h"
+
+#define A2M_HEADER_GET_SERVERS 0x31
+#define M2A_HEADER_SERVERS     0x66
+#define M2A_HEADER_SERVERS_EOL 0x0A
+
+/* Length of an IPv4 address and port record in a listing. */
+#define M2A_RECORD_LEN 6
+
+/* The seed of the first page and the record marking the end of the list. */
+#define SSQ_MASTER_SEED_FIRST "0.0.0.0:0"
+#define SSQ_MASTER_SEED_SIZE  sizeof ("255.255.255.255:65535")
+
+static size_t ssq_master_payload(SSQ_MASTER_REGION region, const char seed[], const char filter[], uint8_t payload[], size_t payload_size) {
+    size_t seed_size   = strlen(seed) + 1;
+    size_t filter_size = strlen(filter) + 1;
+    size_t payload_len = 2 + seed_size + filter_size;
+    if (payload_len > payload_size)
+        return 0;
+    payload[0] = A2M_HEADER_GET_SERVERS;
+    payload[1] = (uint8_t)region;
+    memcpy(payload + 2, seed, seed_size);
+    memcpy(payload + 2 + seed_size, filter, filter_size);
+    return payload_len;
+}
+
+static void ssq_master_seed(const struct sockaddr_in *addr, char seed[SSQ_MASTER_SEED_SIZE]) {
+    const uint8_t *ip = (const uint8_t *)&addr->sin_addr;
+    const uint8_t *port = (const uint8_t *)&addr->sin_port;
+    snprintf(seed, SSQ_MASTER_SEED_SIZE, "%u.%u.%u.%u:%u", ip[0], ip[1], ip[2], ip[3], (unsigned)((port[0] << 8) | port[1]));
+}
+
+/* Hands the records of a page over. Returns false once the listing is over. */
+static bool ssq_master_page(SSQ_SERVER *master, const uint8_t response[], size_t response_len, SSQ_MASTER_CALLBACK callback, void *data, size_t *count, struct sockaddr_in *last) {
+    SSQ_STREAM stream;
+    ssq_stream_wrap(&stream, response, response_len);
+    if (ssq_response_is_truncated(response, response_len))
+        ssq_stream_advance(&stream, SSQ_PACKET_HEADER_LEN);
+    if (ssq_stream_remaining(&stream) < 2 || ssq_stream_read_uint8_t(&stream) != M2A_HEADER_SERVERS || ssq_stream_read_uint8_t(&stream) != M2A_HEADER_SERVERS_EOL) {
+        ssq_error_set(&master->last_error, SSQE_INVALID_RESPONSE, "Invalid master server response header");
+        return false;
+    }
+    bool listed_any = false;
+    while (ssq_stream_remaining(&stream) >= M2A_RECORD_LEN) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof (addr));
+        addr.sin_family = AF_INET;
+        // Both the address and the port are already in network byte order.
+        ssq_stream_read(&stream, &addr.sin_addr, sizeof (addr.sin_addr));
+        ssq_stream_read(&stream, &addr.sin_port, sizeof (addr.sin_port));
+        if (addr.sin_addr.s_addr == 0 && addr.sin_port == 0)
+            return false;
+        listed_any = true;
+        *last = addr;
+        ++*count;
+        if (!callback((const struct sockaddr *)&addr, sizeof (addr), data))
+            return false;
+    }
+    return listed_any;
+}
+
+size_t ssq_master_list(SSQ_SERVER *master, SSQ_MASTER_REGION region, const char filter[], SSQ_MASTER_CALLBACK callback, void *data) {
+    size_t count = 0;
+    char seed[SSQ_MASTER_SEED_SIZE] = SSQ_MASTER_SEED_FIRST;
+    for (;;) {
+        uint8_t payload[SSQ_PACKET_SIZE];
+        size_t payload_len = ssq_master_payload(region, seed, filter, payload, sizeof (payload));
+        if (payload_len == 0) {
+            ssq_error_set(&master->last_error, SSQE_INVALID_ARGUMENT, "Filter too long");
+            break;
+        }
+        size_t response_len;
+        uint8_t *response = ssq_query(master, payload, payload_len, &response_len);
+        if (response == NULL)
+            break;
+        struct sockaddr_in last;
+        memset(&last, 0, sizeof (last));
+        bool more = ssq_master_page(master, response, response_len, callback, data, &count, &last);
+        free(response);
+        if (!more)
+            break;
+        char next_seed[SSQ_MASTER_SEED_SIZE];
+        ssq_master_seed(&last, next_seed);
+        if (strcmp(next_seed, seed) == 0)
+            break; // The master server keeps answering with the same page.
+        memcpy(seed, next_seed, sizeof (seed));
+    }
+    return count;
+}
+
+static bool ssq_master_add_to_registry(const struct sockaddr *addr, size_t addr_len, void *data) {
+    return ssq_registry_add(data, addr, addr_len) != NULL;
+}
+
+size_t ssq_master_list_into(SSQ_SERVER *master, SSQ_MASTER_REGION region, const char filter[], SSQ_REGISTRY *registry) {
+    return ssq_master_list(master, region, filter, ssq_master_add_to_registry, registry);
+}
@@ -0,0 +1,89 @@
+#include "ssq/metrics.h"
+
+#include <stdlib.h>
+
+#include "metrics.h"
+
+volatile uint64_t ssq_metrics_enabled = 0;
+
+static SSQ_METRICS_BLOCK ssq_metrics_global;
+
+/* Recording (on the querying threads) */
+
+void ssq_metrics_add(SSQ_METRICS_BLOCK *block, SSQ_METRICS_COUNTER counter, uint64_t n) {
+    if (block != NULL)
+        ssq_atomic_add(&block->counters[counter], n);
+    if (ssq_atomic_load(&ssq_metrics_enabled) != 0)
+        ssq_atomic_add(&ssq_metrics_global.counters[counter], n);
+}
+
+void ssq_metrics_add_failure(SSQ_METRICS_BLOCK *block, const SSQ_ERROR *error) {
+    switch (error->code) {
+        case SSQE_TIMEOUT:          ssq_metrics_add(block, SSQ_METRICS_TIMEOUTS, 1);          break;
+        case SSQE_INVALID_RESPONSE: ssq_metrics_add(block, SSQ_METRICS_INVALID_RESPONSES, 1); break;
+        case SSQE_SYSTEM:           ssq_metrics_add(block, SSQ_METRICS_SYSTEM_ERRORS, 1);     break;
+        default:                    break;
+    }
+}
+
+void ssq_metrics_add_rtt(SSQ_METRICS_BLOCK *block, uint64_t sample_in_ms) {
+    size_t bucket = 0;
+    while (sample_in_ms != 0 && bucket < SSQ_METRICS_RTT_BUCKETS - 1) {
+        sample_in_ms >>= 1;
+        ++bucket;
+    }
+    ssq_metrics_add(block, (SSQ_METRICS_COUNTER)(SSQ_METRICS_RTT + bucket), 1);
+}
+
+/* Snapshots */
+
+static void ssq_metrics_read(const SSQ_METRICS_BLOCK *block, SSQ_METRICS *metrics) {
+    metrics->queries           = ssq_atomic_load(&block->counters[SSQ_METRICS_QUERIES]);
+    metrics->challenges        = ssq_atomic_load(&block->counters[SSQ_METRICS_CHALLENGES]);
+    metrics->retransmits       = ssq_atomic_load(&block->counters[SSQ_METRICS_RETRANSMITS]);
+    metrics->fragments         = ssq_atomic_load(&block->counters[SSQ_METRICS_FRAGMENTS]);
+    metrics->bytes             = ssq_atomic_load(&block->counters[SSQ_METRICS_BYTES]);
+    metrics->timeouts          = ssq_atomic_load(&block->counters[SSQ_METRICS_TIMEOUTS]);
+    metrics->invalid_responses = ssq_atomic_load(&block->counters[SSQ_METRICS_INVALID_RESPONSES]);
+    metrics->system_errors     = ssq_atomic_load(&block->counters[SSQ_METRICS_SYSTEM_ERRORS]);
+    for (size_t i = 0; i < SSQ_METRICS_RTT_BUCKETS; ++i)
+        metrics->rtt[i] = ssq_atomic_load(&block->counters[SSQ_METRICS_RTT + i]);
+}
+
+/* Counters are cleared one by one: queries ending meanwhile may only be partly cleared. */
+static void ssq_metrics_clear(SSQ_METRICS_BLOCK *block) {
+    for (size_t i = 0; i < SSQ_METRICS_COUNTER_COUNT; ++i)
+        ssq_atomic_store(&block->counters[i], 0);
+}
+
+void ssq_metrics_enable(bool enable) {
+    ssq_atomic_store(&ssq_metrics_enabled, enable ? 1 : 0);
+}
+
+void ssq_metrics_get(SSQ_METRICS *metrics) {
+    ssq_metrics_read(&ssq_metrics_global, metrics);
+}
+
+void ssq_metrics_reset(void) {
+    ssq_metrics_clear(&ssq_metrics_global);
+}
+
+bool ssq_server_metrics_enable(SSQ_SERVER *server, bool enable) {
+    if (!enable) {
+        free(server->metrics);
+        server->metrics = NULL;
+    } else if (server->metrics == NULL) {
+        server->metrics = calloc(1, sizeof (*server->metrics));
+    }
+    return !enable || server->metrics != NULL;
+}
+
+void ssq_server_metrics_get(const SSQ_SERVER *server, SSQ_METRICS *metrics) {
+    static const SSQ_METRICS_BLOCK none;
+    ssq_metrics_read((server->metrics != NULL) ? server->metrics : &none, metrics);
+}
+
+void ssq_server_metrics_reset(SSQ_SERVER *server) {
+    if (server->metrics != NULL)
+        ssq_metrics_clear(server->metrics);
+}
@@ -0,0 +1,74 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "ssq/metrics.h"
+
+#include "error.h"
+#include "server.h"
+#include "thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Indices of the counters of a block, in the order of the members of SSQ_METRICS. */
+typedef enum ssq_metrics_counter {
+    SSQ_METRICS_QUERIES,
+    SSQ_METRICS_CHALLENGES,
+    SSQ_METRICS_RETRANSMITS,
+    SSQ_METRICS_FRAGMENTS,
+    SSQ_METRICS_BYTES,
+    SSQ_METRICS_TIMEOUTS,
+    SSQ_METRICS_INVALID_RESPONSES,
+    SSQ_METRICS_SYSTEM_ERRORS,
+    SSQ_METRICS_RTT, /* First bucket of the round-trip time histogram. */
+    SSQ_METRICS_COUNTER_COUNT = SSQ_METRICS_RTT + SSQ_METRICS_RTT_BUCKETS
+} SSQ_METRICS_COUNTER;
+
+struct ssq_metrics_block {
+    volatile uint64_t counters[SSQ_METRICS_COUNTER_COUNT];
+};
+
+/* Whether the global counters are enabled. */
+extern volatile uint64_t ssq_metrics_enabled;
+
+/* Adds `n' to the counter of `block' (NULL if the server has none) and to the global one if enabled. */
+void ssq_metrics_add(SSQ_METRICS_BLOCK *block, SSQ_METRICS_COUNTER counter, uint64_t n);
+
+/* The hooks of the queries: everything past the first test is out of line. */
+static inline bool ssq_metrics_on(const SSQ_SERVER *server) {
+    return server->metrics != NULL || ssq_atomic_load(&ssq_metrics_enabled) != 0;
+}
+
+static inline void ssq_metrics_count(const SSQ_SERVER *server, SSQ_METRICS_COUNTER counter) {
+    if (ssq_metrics_on(server))
+        ssq_metrics_add(server->metrics, counter, 1);
+}
+
+static inline void ssq_metrics_received(const SSQ_SERVER *server, long bytes_received) {
+    if (bytes_received >= 0 && ssq_metrics_on(server)) {
+        ssq_metrics_add(server->metrics, SSQ_METRICS_FRAGMENTS, 1);
+        ssq_metrics_add(server->metrics, SSQ_METRICS_BYTES, (uint64_t)bytes_received);
+    }
+}
+
+/* Counts the query as failed if `error' is one of the codes counted. */
+void ssq_metrics_add_failure(SSQ_METRICS_BLOCK *block, const SSQ_ERROR *error);
+static inline void ssq_metrics_failed(const SSQ_SERVER *server, const SSQ_ERROR *error) {
+    if (error->code != SSQE_OK && ssq_metrics_on(server))
+        ssq_metrics_add_failure(server->metrics, error);
+}
+
+void ssq_metrics_add_rtt(SSQ_METRICS_BLOCK *block, uint64_t sample_in_ms);
+static inline void ssq_metrics_rtt(const SSQ_SERVER *server, uint64_t sample_in_ms) {
+    if (ssq_metrics_on(server))
+        ssq_metrics_add_rtt(server->metrics, sample_in_ms);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !METRICS_H */
@@ -2,98 +2,348 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifdef SSQ_HAVE_BZIP2
+# include <bzlib.h>
+#endif /* SSQ_HAVE_BZIP2 */
 
 #include "helper.h"
 #include "stream.h"
 
-static void ssq_packet_init_payload(SSQ_PACKET *packet, SSQ_STREAM *stream, SSQ_ERROR *error) {
-    packet->payload = malloc(packet->payload_len);
-    if (packet->payload != NULL)
-        ssq_stream_read(stream, packet->payload, packet->payload_len);
-    else
-        ssq_error_set_from_errno(error);
+/* Largest payload kept from a packet of a split response: the rest of the datagram is discarded. */
+#define SSQ_PACKET_MULTI_PAYLOAD_MAX (SSQ_PACKET_SIZE - SSQ_PACKET_MULTI_HEADER_LEN)
+
+/* Parses the header of a datagram of `datagram_len' bytes out of its first bytes in `header'. */
+bool ssq_packet_parse(SSQ_PACKET *packet, const uint8_t header[], size_t datagram_len, SSQ_ERROR *error) {
+    memset(packet, 0, sizeof (*packet));
+    if (datagram_len < SSQ_PACKET_HEADER_LEN) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet header");
+        return false;
+    }
+    SSQ_STREAM header_stream;
+    ssq_stream_wrap(&header_stream, header, ssq_helper_minz(datagram_len, SSQ_PACKET_MULTI_HEADER_LEN));
+    packet->header = ssq_stream_read_int32_t(&header_stream);
+    if (packet->header == SSQ_PACKET_HEADER_SINGLE) {
+        packet->total       = 1;
+        packet->number      = 0;
+        packet->payload_len = ssq_helper_minz(datagram_len, SSQ_PACKET_SIZE) - SSQ_PACKET_HEADER_LEN;
+        return true;
+    }
+    if (packet->header != SSQ_PACKET_HEADER_MULTI || datagram_len < SSQ_PACKET_MULTI_HEADER_LEN) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet header");
+        return false;
+    }
+    packet->id          = ssq_stream_read_int32_t(&header_stream);
+    packet->total       = ssq_stream_read_uint8_t(&header_stream);
+    packet->number      = ssq_stream_read_uint8_t(&header_stream);
+    packet->size        = ssq_stream_read_uint16_t(&header_stream);
+    packet->payload_len = ssq_helper_minz(datagram_len, SSQ_PACKET_SIZE) - SSQ_PACKET_MULTI_HEADER_LEN;
+    if (packet->id & SSQ_PACKET_FLAG_COMPRESSION) {
+#ifdef SSQ_HAVE_BZIP2
+        // The whole payload is kept: the first packet also carries the decompressed size and CRC32.
+        return true;
+#else /* !SSQ_HAVE_BZIP2 */
+        ssq_error_set(error, SSQE_UNSUPPORTED, "Cannot process packet: decompression is not supported");
+        return false;
+#endif /* SSQ_HAVE_BZIP2 */
+    }
+    packet->payload_len = ssq_helper_minz(packet->size, packet->payload_len);
+    return true;
 }
 
-static void ssq_packet_init_single(SSQ_PACKET *packet, SSQ_STREAM *stream, SSQ_ERROR *error) {
-    packet->total       = 1;
-    packet->number      = 0;
-    packet->payload_len = ssq_stream_remaining(stream);
-    ssq_packet_init_payload(packet, stream, error);
+static inline bool ssq_reassembly_seen(const SSQ_REASSEMBLY *reassembly, uint8_t number) {
+    return (reassembly->seen[number / 32] >> (number % 32)) & 1;
 }
 
-static void ssq_packet_init_multi(SSQ_PACKET *packet, SSQ_STREAM *stream, SSQ_ERROR *error) {
-    packet->id          = ssq_stream_read_int32_t(stream);
-    packet->total       = ssq_stream_read_uint8_t(stream);
-    packet->number      = ssq_stream_read_uint8_t(stream);
-    packet->size        = ssq_stream_read_uint16_t(stream);
-    packet->payload_len = ssq_helper_minz(packet->size, ssq_stream_remaining(stream));
-    if (packet->id & SSQ_PACKET_FLAG_COMPRESSION)
-        ssq_error_set(error, SSQE_UNSUPPORTED, "Cannot process packet: decompression is not supported");
-    else
-        ssq_packet_init_payload(packet, stream, error);
+void ssq_reassembly_init(SSQ_REASSEMBLY *reassembly) {
+    memset(reassembly, 0, sizeof (*reassembly));
 }
 
-SSQ_PACKET *ssq_packet_from_datagram(const uint8_t datagram[], uint16_t datagram_len, SSQ_ERROR *error) {
-    SSQ_PACKET *packet = malloc(sizeof (*packet));
-    if (packet == NULL) {
+/* Offset and capacity of the region the payload of the next datagram should be received into. */
+static bool ssq_reassembly_landing(SSQ_REASSEMBLY *reassembly, size_t *offset, size_t *capacity, SSQ_ERROR *error) {
+    if (reassembly->total != 0) {
+        *offset   = (size_t)reassembly->next * reassembly->stride;
+        *capacity = reassembly->stride;
+        return true;
+    }
+    if (reassembly->response == NULL) {
+        // Large enough for a whole single-packet response and its terminator.
+        reassembly->response = malloc(SSQ_PACKET_SIZE + 1);
+        if (reassembly->response == NULL) {
+            ssq_error_set_from_errno(error);
+            return false;
+        }
+    }
+    *offset   = 0;
+    *capacity = SSQ_PACKET_MULTI_PAYLOAD_MAX;
+    return true;
+}
+
+/* Lays the buffer out for the response the first packet belongs to. */
+static bool ssq_reassembly_start(SSQ_REASSEMBLY *reassembly, const SSQ_PACKET *packet, SSQ_ERROR *error) {
+    if (packet->header == SSQ_PACKET_HEADER_SINGLE) {
+        if (reassembly->response == NULL) {
+            reassembly->response = malloc(SSQ_PACKET_SIZE + 1);
+            if (reassembly->response == NULL) {
+                ssq_error_set_from_errno(error);
+                return false;
+            }
+        }
+        reassembly->stride = (uint16_t)packet->payload_len;
+        reassembly->total  = 1;
+        return true;
+    }
+    if (packet->total == 0) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet count");
+        return false;
+    }
+    bool compressed = (packet->id & SSQ_PACKET_FLAG_COMPRESSION);
+    if (packet->size == 0 && !compressed) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet size");
+        return false;
+    }
+    if (packet->number >= packet->total) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet number");
+        return false;
+    }
+    // Compressed payloads are never moved together, so their slots are simply made large enough.
+    uint16_t stride = compressed ? SSQ_PACKET_MULTI_PAYLOAD_MAX : (uint16_t)ssq_helper_minz(packet->size, SSQ_PACKET_MULTI_PAYLOAD_MAX);
+    // The terminator guarantees that a string cut short by the end of the response is still terminated.
+    uint8_t *response = realloc(reassembly->response, (size_t)packet->total * stride + 1);
+    if (response == NULL) {
         ssq_error_set_from_errno(error);
-        return NULL;
+        return false;
     }
-    memset(packet, 0, sizeof (*packet));
-    SSQ_STREAM datagram_stream;
-    ssq_stream_wrap(&datagram_stream, datagram, datagram_len);
-    packet->header = ssq_stream_read_int32_t(&datagram_stream);
-    if (packet->header == SSQ_PACKET_HEADER_SINGLE)
-        ssq_packet_init_single(packet, &datagram_stream, error);
-    else if (packet->header == SSQ_PACKET_HEADER_MULTI)
-        ssq_packet_init_multi(packet, &datagram_stream, error);
-    else
-        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet header");
-    if (error->code != SSQE_OK) {
-        free(packet->payload);
-        free(packet);
-        packet = NULL;
+    reassembly->response = response;
+    reassembly->lens     = calloc(packet->total, sizeof (*reassembly->lens));
+    if (reassembly->lens == NULL) {
+        ssq_error_set_from_errno(error);
+        return false;
     }
-    return packet;
+    reassembly->id         = packet->id;
+    reassembly->stride     = stride;
+    reassembly->total      = packet->total;
+    reassembly->compressed = compressed;
+    return true;
 }
 
-void ssq_packet_free(SSQ_PACKET *packet) {
-    free(packet->payload);
-    free(packet);
+/* Returns the final offset of the packet's payload, or -1 if the packet must be dropped. */
+static long ssq_reassembly_accept(SSQ_REASSEMBLY *reassembly, const SSQ_PACKET *packet, SSQ_ERROR *error) {
+    if (reassembly->total == 0)
+        return ssq_reassembly_start(reassembly, packet, error) ? (long)packet->number * reassembly->stride : -1;
+    if (packet->header != SSQ_PACKET_HEADER_MULTI || packet->id != reassembly->id)
+        return -1; // Stray packet belonging to another response (e.g. of an earlier query).
+    if (packet->number >= reassembly->total) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet number");
+        return -1;
+    }
+    if (ssq_reassembly_seen(reassembly, packet->number))
+        return -1;
+    if (packet->payload_len > reassembly->stride) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet size");
+        return -1;
+    }
+    return (long)packet->number * reassembly->stride;
 }
 
-bool ssq_packets_check_integrity(const SSQ_PACKET *const packets[], uint8_t packet_count) {
-    for (uint8_t i = 1; i < packet_count; ++i)
-        if (packets[i]->id != packets[0]->id)
-            return false;
-    return true;
+void ssq_reassembly_renew(SSQ_REASSEMBLY *reassembly) {
+    reassembly->renewable = !ssq_reassembly_done(reassembly);
 }
 
-static size_t ssq_packets_payload_len_sum(const SSQ_PACKET *const packets[], uint8_t packet_count) {
-    size_t len = 0;
-    for (uint8_t i = 0; i < packet_count; ++i)
-        len += packets[i]->payload_len;
-    return len;
+/* Whether the packet belongs to the response the request was sent again for, under a new id. */
+static inline bool ssq_reassembly_renews(const SSQ_REASSEMBLY *reassembly, const SSQ_PACKET *packet) {
+    return reassembly->renewable && reassembly->total != 0 && !ssq_reassembly_done(reassembly) && packet->header == SSQ_PACKET_HEADER_MULTI && packet->id != reassembly->id;
 }
 
-uint8_t *ssq_packets_to_response(const SSQ_PACKET *const packets[], uint8_t packet_count, size_t *response_len, SSQ_ERROR *error) {
-    *response_len = ssq_packets_payload_len_sum(packets, packet_count);
-    uint8_t *response = malloc(*response_len);
+/* Drops the packets held, keeping the buffer for the next response. */
+static void ssq_reassembly_restart(SSQ_REASSEMBLY *reassembly) {
+    uint8_t *response = reassembly->response;
+    free(reassembly->lens);
+    ssq_reassembly_init(reassembly);
+    reassembly->response = response;
+}
+
+static void ssq_reassembly_mark(SSQ_REASSEMBLY *reassembly, const SSQ_PACKET *packet) {
+    reassembly->seen[packet->number / 32] |= (uint32_t)1 << (packet->number % 32);
+    if (reassembly->lens != NULL)
+        reassembly->lens[packet->number] = (uint16_t)packet->payload_len;
+    ++reassembly->received;
+    while (reassembly->next < reassembly->total && ssq_reassembly_seen(reassembly, reassembly->next))
+        ++reassembly->next;
+}
+
+long ssq_reassembly_recv(SSQ_REASSEMBLY *reassembly, SOCKET sockfd, SSQ_ERROR *error) {
+    size_t offset, capacity;
+    if (!ssq_reassembly_landing(reassembly, &offset, &capacity, error))
+        return SOCKET_ERROR;
+    // The payload lands right where the next missing packet belongs: in-order packets are never copied.
+    uint8_t header[SSQ_PACKET_MULTI_HEADER_LEN];
+    uint8_t overflow[SSQ_PACKET_MULTI_PAYLOAD_MAX];
+    uint8_t *const bufs[] = { header, reassembly->response + offset, overflow };
+    const size_t buf_sizes[] = { sizeof (header), capacity, SSQ_PACKET_MULTI_PAYLOAD_MAX - capacity };
+    long bytes_received = ssq_socket_recv_scatter(sockfd, bufs, buf_sizes, 3, error);
+    if (bytes_received == SOCKET_ERROR)
+        return SOCKET_ERROR;
+    SSQ_PACKET packet;
+    if (!ssq_packet_parse(&packet, header, (size_t)bytes_received, error))
+        return bytes_received;
+    if (ssq_reassembly_renews(reassembly, &packet)) {
+        // The payload landed according to the layout of the response replaced: it is put back together first.
+        uint8_t datagram[SSQ_PACKET_SIZE];
+        size_t payload_len = (size_t)bytes_received - SSQ_PACKET_MULTI_HEADER_LEN;
+        size_t landed_len = ssq_helper_minz(payload_len, capacity);
+        memcpy(datagram, header, SSQ_PACKET_MULTI_HEADER_LEN);
+        memcpy(datagram + SSQ_PACKET_MULTI_HEADER_LEN, reassembly->response + offset, landed_len);
+        memcpy(datagram + SSQ_PACKET_MULTI_HEADER_LEN + landed_len, overflow, payload_len - landed_len);
+        ssq_reassembly_add(reassembly, datagram, (size_t)bytes_received, error);
+        return bytes_received;
+    }
+    long final_offset = ssq_reassembly_accept(reassembly, &packet, error);
+    if (final_offset == -1)
+        return bytes_received;
+    uint8_t *landed = reassembly->response + offset;
+    if (packet.header == SSQ_PACKET_HEADER_SINGLE) {
+        // The first bytes of the payload were received along with the header.
+        size_t head_len = ssq_helper_minz(packet.payload_len, SSQ_PACKET_MULTI_HEADER_LEN - SSQ_PACKET_HEADER_LEN);
+        memmove(landed + head_len, landed, packet.payload_len - head_len);
+        memcpy(landed, header + SSQ_PACKET_HEADER_LEN, head_len);
+    } else if ((size_t)final_offset != offset) {
+        memmove(reassembly->response + final_offset, landed, packet.payload_len);
+    }
+    ssq_reassembly_mark(reassembly, &packet);
+    return bytes_received;
+}
+
+void ssq_reassembly_add(SSQ_REASSEMBLY *reassembly, const uint8_t datagram[], size_t datagram_len, SSQ_ERROR *error) {
+    SSQ_PACKET packet;
+    if (!ssq_packet_parse(&packet, datagram, datagram_len, error))
+        return;
+    if (ssq_reassembly_renews(reassembly, &packet))
+        ssq_reassembly_restart(reassembly);
+    long final_offset = ssq_reassembly_accept(reassembly, &packet, error);
+    if (final_offset == -1)
+        return;
+    size_t header_len = (packet.header == SSQ_PACKET_HEADER_SINGLE) ? SSQ_PACKET_HEADER_LEN : SSQ_PACKET_MULTI_HEADER_LEN;
+    memcpy(reassembly->response + final_offset, datagram + header_len, packet.payload_len);
+    ssq_reassembly_mark(reassembly, &packet);
+}
+
+/* Whether the datagram is a packet of the split response already being reassembled. */
+bool ssq_reassembly_owns(const SSQ_REASSEMBLY *reassembly, const uint8_t datagram[], size_t datagram_len) {
+    if (reassembly->lens == NULL || datagram_len < SSQ_PACKET_MULTI_HEADER_LEN)
+        return false;
+    SSQ_STREAM datagram_stream;
+    ssq_stream_wrap(&datagram_stream, datagram, SSQ_PACKET_MULTI_HEADER_LEN);
+    int32_t header = ssq_stream_read_int32_t(&datagram_stream);
+    int32_t id     = ssq_stream_read_int32_t(&datagram_stream);
+    return header == SSQ_PACKET_HEADER_MULTI && id == reassembly->id;
+}
+
+bool ssq_reassembly_done(const SSQ_REASSEMBLY *reassembly) {
+    return reassembly->total != 0 && reassembly->received == reassembly->total;
+}
+
+#ifdef SSQ_HAVE_BZIP2
+/* Standard (reflected) CRC32, as computed by the server over the decompressed response. */
+static uint32_t ssq_packet_crc32(const uint8_t data[], size_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+/* Decompresses the payloads one packet at a time, straight into a buffer of the announced size. */
+static uint8_t *ssq_reassembly_decompress(const SSQ_REASSEMBLY *reassembly, size_t *response_len, SSQ_ERROR *error) {
+    if (reassembly->lens[0] < SSQ_PACKET_COMPRESSION_HEADER_LEN) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid compressed response header");
+        return NULL;
+    }
+    SSQ_STREAM header_stream;
+    ssq_stream_wrap(&header_stream, reassembly->response, SSQ_PACKET_COMPRESSION_HEADER_LEN);
+    uint32_t decompressed_len = (uint32_t)ssq_stream_read_int32_t(&header_stream);
+    uint32_t crc32            = (uint32_t)ssq_stream_read_int32_t(&header_stream);
+    if (decompressed_len > SSQ_PACKET_DECOMPRESSED_MAX) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid compressed response header");
+        return NULL;
+    }
+    // Room for the terminator, just like uncompressed responses.
+    uint8_t *response = malloc((size_t)decompressed_len + 1);
     if (response == NULL) {
         ssq_error_set_from_errno(error);
         return NULL;
     }
-    size_t copy_offset = 0;
-    for (uint8_t i = 0; i < packet_count; ++i) {
-        memcpy(response + copy_offset, packets[i]->payload, packets[i]->payload_len);
-        copy_offset += packets[i]->payload_len;
+    bz_stream bz;
+    memset(&bz, 0, sizeof (bz));
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) {
+        free(response);
+        ssq_error_set(error, SSQE_SYSTEM, "Could not initialize the decompression");
+        return NULL;
+    }
+    bz.next_out  = (char *)response;
+    bz.avail_out = decompressed_len;
+    int status = BZ_OK;
+    for (uint8_t i = 0; i < reassembly->total && status == BZ_OK; ++i) {
+        size_t skip = (i == 0) ? SSQ_PACKET_COMPRESSION_HEADER_LEN : 0;
+        bz.next_in  = (char *)reassembly->response + (size_t)i * reassembly->stride + skip;
+        bz.avail_in = reassembly->lens[i] - (unsigned int)skip;
+        // Input is fed even once the output is full: the last packets may only hold the end of the stream.
+        while (bz.avail_in != 0 && status == BZ_OK) {
+            unsigned int avail_in  = bz.avail_in;
+            unsigned int avail_out = bz.avail_out;
+            status = BZ2_bzDecompress(&bz);
+            if (status == BZ_OK && bz.avail_in == avail_in && bz.avail_out == avail_out)
+                status = BZ_DATA_ERROR; // Stuck: the response is longer than announced.
+        }
+    }
+    BZ2_bzDecompressEnd(&bz);
+    if (status != BZ_STREAM_END || bz.avail_out != 0) {
+        free(response);
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Could not decompress the response");
+        return NULL;
+    }
+    if (ssq_packet_crc32(response, decompressed_len) != crc32) {
+        free(response);
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Decompressed response checksum mismatch");
+        return NULL;
+    }
+    response[decompressed_len] = '\0';
+    *response_len = decompressed_len;
+    return response;
+}
+#endif /* SSQ_HAVE_BZIP2 */
+
+uint8_t *ssq_reassembly_to_response(SSQ_REASSEMBLY *reassembly, size_t *response_len, SSQ_ERROR *error) {
+#ifdef SSQ_HAVE_BZIP2
+    if (reassembly->compressed)
+        return ssq_reassembly_decompress(reassembly, response_len, error);
+#else /* !SSQ_HAVE_BZIP2 */
+    (void)error;
+#endif /* SSQ_HAVE_BZIP2 */
+    uint8_t *response = reassembly->response;
+    size_t len = reassembly->stride; // A single-packet response spans exactly one stride.
+    if (reassembly->lens != NULL) {
+        // Close the gaps left by packets shorter than the stride, if any.
+        len = 0;
+        for (uint8_t i = 0; i < reassembly->total; ++i) {
+            size_t offset = (size_t)i * reassembly->stride;
+            if (len != offset)
+                memmove(response + len, response + offset, reassembly->lens[i]);
+            len += reassembly->lens[i];
+        }
     }
+    response[len] = '\0';
+    *response_len = len;
+    reassembly->response = NULL;
     return response;
 }
 
-void ssq_packets_free(SSQ_PACKET *packets[], uint8_t packet_count) {
-    for (uint8_t i = 0; i < packet_count; ++i)
-        if (packets[i] != NULL)
-            ssq_packet_free(packets[i]);
-    free(packets);
+void ssq_reassembly_clear(SSQ_REASSEMBLY *reassembly) {
+    free(reassembly->response);
+    free(reassembly->lens);
+    ssq_reassembly_init(reassembly);
 }
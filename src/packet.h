@@ -6,6 +6,7 @@
 #include <stdint.h>
 
 #include "error.h"
+#include "socket.h"
 
 #define SSQ_PACKET_SIZE 1400
 
@@ -13,6 +14,15 @@
 #define SSQ_PACKET_HEADER_SINGLE 0xFFFFFFFF
 #define SSQ_PACKET_HEADER_MULTI  0xFFFFFFFE
 
+/* Length of the full header of a packet belonging to a split response. */
+#define SSQ_PACKET_MULTI_HEADER_LEN 12
+
+/* Length of the decompressed size and CRC32 leading the first packet of a compressed response. */
+#define SSQ_PACKET_COMPRESSION_HEADER_LEN 8
+
+/* Upper bound on the announced size of a decompressed response. */
+#define SSQ_PACKET_DECOMPRESSED_MAX (4 * 1024 * 1024)
+
 #define SSQ_PACKET_FLAG_COMPRESSION 0x80000000
 
 #ifdef __cplusplus
@@ -25,16 +35,37 @@ typedef struct ssq_packet {
     uint8_t  total;       /* The total number of packets in the response.    */
     uint8_t  number;      /* The number of the packet.                       */
     uint16_t size;        /* Maximum size of packet before switching occurs. */
-    uint8_t *payload;     /* The packet's payload.                           */
     size_t   payload_len; /* Length of the packet's payload.                 */
 } SSQ_PACKET;
 
-SSQ_PACKET *ssq_packet_from_datagram(const uint8_t *datagram, uint16_t datagram_len, SSQ_ERROR *error);
-void        ssq_packet_free(SSQ_PACKET *packet);
+typedef struct ssq_reassembly {
+    uint8_t  *response;   /* Payloads received so far, each one at its final offset.     */
+    uint16_t *lens;       /* Payload length of each packet of a split response.          */
+    uint32_t  seen[8];    /* Bitmap of the packet numbers received so far.               */
+    int32_t   id;         /* Unique number of the response being reassembled.            */
+    uint16_t  stride;     /* Offset between the payloads of two consecutive packets.     */
+    uint8_t   total;      /* The total number of packets in the response.                */
+    uint8_t   received;   /* The number of distinct packets received so far.             */
+    uint8_t   next;       /* Lowest packet number not received yet.                      */
+    bool      compressed; /* Whether the payloads form a single bzip2 stream.            */
+    bool      renewable;  /* Whether a response with another id replaces this one.       */
+} SSQ_REASSEMBLY;
+
+bool     ssq_packet_parse(SSQ_PACKET *packet, const uint8_t *header, size_t datagram_len, SSQ_ERROR *error);
 
-bool        ssq_packets_check_integrity(const SSQ_PACKET *const *packets, uint8_t packet_count);
-uint8_t    *ssq_packets_to_response(const SSQ_PACKET *const *packets, uint8_t packet_count, size_t *response_len, SSQ_ERROR *error);
-void        ssq_packets_free(SSQ_PACKET **packets, uint8_t packet_count);
+void     ssq_reassembly_init(SSQ_REASSEMBLY *reassembly);
+long     ssq_reassembly_recv(SSQ_REASSEMBLY *reassembly, SOCKET sockfd, SSQ_ERROR *error);
+void     ssq_reassembly_add(SSQ_REASSEMBLY *reassembly, const uint8_t *datagram, size_t datagram_len, SSQ_ERROR *error);
+/*
+ * To be called when the request was sent again to recover lost packets. Packets of the new
+ * response are merged with the ones held if the server kept the id of the response; otherwise, the
+ * first of them replaces the response being reassembled.
+ */
+void     ssq_reassembly_renew(SSQ_REASSEMBLY *reassembly);
+bool     ssq_reassembly_owns(const SSQ_REASSEMBLY *reassembly, const uint8_t *datagram, size_t datagram_len);
+bool     ssq_reassembly_done(const SSQ_REASSEMBLY *reassembly);
+uint8_t *ssq_reassembly_to_response(SSQ_REASSEMBLY *reassembly, size_t *response_len, SSQ_ERROR *error);
+void     ssq_reassembly_clear(SSQ_REASSEMBLY *reassembly);
 
 #ifdef __cplusplus
 }
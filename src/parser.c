@@ -0,0 +1,524 @@
+#include "ssq/parser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "a2s.h"
+#include "helper.h"
+#include "metrics.h"
+#include "packet.h"
+#include "query.h"
+#include "response.h"
+#include "server.h"
+#include "socket.h"
+#include "stream.h"
+#include "trace.h"
+
+/* Most string fields in a record (the name and the value of a rule). */
+#define SSQ_PARSER_STRING_MAX 2
+
+/* Largest fixed-size field (the score or the duration of a player). */
+#define SSQ_PARSER_FIXED_MAX 4
+
+typedef enum ssq_parser_state {
+    SSQ_PARSER_HEADER,  /* Expecting the header of the response, possibly after 0xFFFFFFFF. */
+    SSQ_PARSER_COUNT,   /* Reading the number of records.                                */
+    SSQ_PARSER_RECORD,  /* Reading the fields of a record.                               */
+    SSQ_PARSER_DONE,    /* Every record announced was delivered.                         */
+    SSQ_PARSER_STOPPED, /* The response is invalid or the callback stopped the decoding. */
+} SSQ_PARSER_STATE;
+
+typedef enum ssq_parser_field {
+    SSQ_PARSER_FIELD_UINT8,
+    SSQ_PARSER_FIELD_INT32,
+    SSQ_PARSER_FIELD_FLOAT,
+    SSQ_PARSER_FIELD_STRING,
+} SSQ_PARSER_FIELD;
+
+static const SSQ_PARSER_FIELD ssq_parser_player_fields[] = {
+    SSQ_PARSER_FIELD_UINT8, SSQ_PARSER_FIELD_STRING, SSQ_PARSER_FIELD_INT32, SSQ_PARSER_FIELD_FLOAT,
+};
+
+static const SSQ_PARSER_FIELD ssq_parser_rules_fields[] = {
+    SSQ_PARSER_FIELD_STRING, SSQ_PARSER_FIELD_STRING,
+};
+
+/* A string is read straight from the bytes fed, unless it has to outlive them. */
+typedef struct ssq_parser_string {
+    const char *str;     /* The string once complete.                           */
+    size_t      len;     /* Length of the string, or of its part read so far.   */
+    char       *buf;     /* Storage of the string when carried over.            */
+    size_t      cap;     /* Capacity of `buf'.                                  */
+    bool        carried; /* Whether the part read so far was copied into `buf'. */
+} SSQ_PARSER_STRING;
+
+struct ssq_parser {
+    A2S_QUERY_KIND          kind;                           /* A2S_QUERY_PLAYER or A2S_QUERY_RULES.      */
+    SSQ_PLAYER_CALLBACK     on_player;                      /* Callback of A2S_PLAYER responses.         */
+    SSQ_RULES_CALLBACK      on_rule;                        /* Callback of A2S_RULES responses.          */
+    void                   *data;                           /* Passed along to the callback.             */
+    const SSQ_PARSER_FIELD *fields;                         /* Layout of a record.                       */
+    size_t                  field_count;                    /* Number of fields in a record.             */
+    SSQ_PARSER_STATE        state;                          /* What the next bytes are.                  */
+    uint8_t                 prefix_len;                     /* Number of 0xFF bytes skipped so far.      */
+    uint16_t                record_count;                   /* Number of records announced.              */
+    uint16_t                delivered;                      /* Number of records delivered so far.       */
+    uint16_t                skip;                           /* Records decoded again, not delivered.     */
+    size_t                  field;                          /* Field of the record being read.           */
+    size_t                  string;                         /* String of the record being read.          */
+    uint8_t                 fixed[SSQ_PARSER_FIXED_MAX];    /* Fixed-size field cut by the end of bytes. */
+    size_t                  fixed_len;                      /* Number of bytes in `fixed'.               */
+    SSQ_PARSER_STRING       strings[SSQ_PARSER_STRING_MAX]; /* Strings of the record being read.         */
+    A2S_PLAYER              player;                         /* Fixed-size fields of the player.          */
+    SSQ_ERROR               last_error;                     /* Why the decoding stopped, if it failed.   */
+};
+
+static void ssq_parser_init(SSQ_PARSER *parser, A2S_QUERY_KIND kind, void *data) {
+    memset(parser, 0, sizeof (*parser));
+    parser->kind = kind;
+    parser->data = data;
+    if (kind == A2S_QUERY_PLAYER) {
+        parser->fields      = ssq_parser_player_fields;
+        parser->field_count = sizeof (ssq_parser_player_fields) / sizeof (*ssq_parser_player_fields);
+    } else {
+        parser->fields      = ssq_parser_rules_fields;
+        parser->field_count = sizeof (ssq_parser_rules_fields) / sizeof (*ssq_parser_rules_fields);
+    }
+    ssq_parser_eclr(parser);
+}
+
+static void ssq_parser_clear(SSQ_PARSER *parser) {
+    for (size_t i = 0; i < SSQ_PARSER_STRING_MAX; ++i)
+        free(parser->strings[i].buf);
+}
+
+SSQ_PARSER *ssq_parser_new_player(SSQ_PLAYER_CALLBACK callback, void *data) {
+    SSQ_PARSER *parser = malloc(sizeof (*parser));
+    if (parser == NULL)
+        return NULL;
+    ssq_parser_init(parser, A2S_QUERY_PLAYER, data);
+    parser->on_player = callback;
+    return parser;
+}
+
+SSQ_PARSER *ssq_parser_new_rules(SSQ_RULES_CALLBACK callback, void *data) {
+    SSQ_PARSER *parser = malloc(sizeof (*parser));
+    if (parser == NULL)
+        return NULL;
+    ssq_parser_init(parser, A2S_QUERY_RULES, data);
+    parser->on_rule = callback;
+    return parser;
+}
+
+void ssq_parser_free(SSQ_PARSER *parser) {
+    if (parser == NULL)
+        return;
+    ssq_parser_clear(parser);
+    free(parser);
+}
+
+static void ssq_parser_fail(SSQ_PARSER *parser, SSQ_ERROR_CODE code, const char message[]) {
+    ssq_error_set(&parser->last_error, code, message);
+    parser->state = SSQ_PARSER_STOPPED;
+}
+
+/* Returns the `size' bytes of a fixed-size field, or NULL if the bytes fed end before the field does. */
+static const uint8_t *ssq_parser_fixed(SSQ_PARSER *parser, const uint8_t bytes[], size_t len, size_t *pos, size_t size) {
+    if (parser->fixed_len == 0 && len - *pos >= size) {
+        const uint8_t *value = bytes + *pos;
+        *pos += size;
+        return value;
+    }
+    size_t n = ssq_helper_minz(size - parser->fixed_len, len - *pos);
+    memcpy(parser->fixed + parser->fixed_len, bytes + *pos, n);
+    parser->fixed_len += n;
+    *pos += n;
+    if (parser->fixed_len < size)
+        return NULL;
+    parser->fixed_len = 0;
+    return parser->fixed;
+}
+
+static bool ssq_parser_append(SSQ_PARSER *parser, SSQ_PARSER_STRING *string, const void *bytes, size_t n) {
+    size_t len = string->carried ? string->len : 0;
+    if (len + n + 1 > string->cap) {
+        size_t cap = ssq_helper_maxz(2 * string->cap, len + n + 1);
+        char *buf = realloc(string->buf, cap);
+        if (buf == NULL) {
+            ssq_error_set_from_errno(&parser->last_error);
+            parser->state = SSQ_PARSER_STOPPED;
+            return false;
+        }
+        string->buf = buf;
+        string->cap = cap;
+    }
+    memcpy(string->buf + len, bytes, n);
+    string->buf[len + n] = '\0';
+    string->len     = len + n;
+    string->str     = string->buf;
+    string->carried = true;
+    return true;
+}
+
+/* Returns whether the string is complete. */
+static bool ssq_parser_read_string(SSQ_PARSER *parser, SSQ_PARSER_STRING *string, const uint8_t bytes[], size_t len, size_t *pos) {
+    const uint8_t *start = bytes + *pos;
+    const uint8_t *nul = memchr(start, '\0', len - *pos);
+    size_t n = (nul != NULL) ? (size_t)(nul - start) : len - *pos;
+    *pos += (nul != NULL) ? n + 1 : n;
+    if (nul != NULL && !string->carried) {
+        string->str = (const char *)start;
+        string->len = n;
+        return true;
+    }
+    return ssq_parser_append(parser, string, start, n) && nul != NULL;
+}
+
+static void ssq_parser_deliver(SSQ_PARSER *parser) {
+    bool go_on = true;
+    if (parser->skip != 0) {
+        --parser->skip;
+    } else if (parser->kind == A2S_QUERY_PLAYER) {
+        A2S_PLAYER player = parser->player;
+        player.name     = (char *)parser->strings[0].str;
+        player.name_len = parser->strings[0].len;
+        go_on = parser->on_player(&player, parser->data);
+        ++parser->delivered;
+    } else {
+        A2S_RULES rule;
+        rule.name      = (char *)parser->strings[0].str;
+        rule.name_len  = parser->strings[0].len;
+        rule.value     = (char *)parser->strings[1].str;
+        rule.value_len = parser->strings[1].len;
+        go_on = parser->on_rule(&rule, parser->data);
+        ++parser->delivered;
+    }
+    parser->field  = 0;
+    parser->string = 0;
+    for (size_t i = 0; i < SSQ_PARSER_STRING_MAX; ++i) {
+        parser->strings[i].str     = NULL;
+        parser->strings[i].len     = 0;
+        parser->strings[i].carried = false;
+    }
+    if (!go_on)
+        parser->state = SSQ_PARSER_STOPPED;
+    else if (parser->skip == 0 && parser->delivered == parser->record_count)
+        parser->state = SSQ_PARSER_DONE;
+}
+
+static void ssq_parser_read_field(SSQ_PARSER *parser, const uint8_t bytes[], size_t len, size_t *pos) {
+    SSQ_PARSER_FIELD field = parser->fields[parser->field];
+    if (field == SSQ_PARSER_FIELD_STRING) {
+        if (!ssq_parser_read_string(parser, &parser->strings[parser->string], bytes, len, pos))
+            return;
+        ++parser->string;
+    } else {
+        size_t size = (field == SSQ_PARSER_FIELD_UINT8) ? sizeof (uint8_t) : sizeof (int32_t);
+        const uint8_t *value = ssq_parser_fixed(parser, bytes, len, pos, size);
+        if (value == NULL)
+            return;
+        SSQ_STREAM stream;
+        ssq_stream_wrap(&stream, value, size);
+        switch (field) {
+            case SSQ_PARSER_FIELD_UINT8: parser->player.index    = ssq_stream_read_uint8_t(&stream); break;
+            case SSQ_PARSER_FIELD_INT32: parser->player.score    = ssq_stream_read_int32_t(&stream); break;
+            case SSQ_PARSER_FIELD_FLOAT: parser->player.duration = ssq_stream_read_float(&stream);   break;
+            default: break;
+        }
+    }
+    if (++parser->field == parser->field_count)
+        ssq_parser_deliver(parser);
+}
+
+/* The strings of the record cut by the end of the bytes fed must not point into them anymore. */
+static void ssq_parser_carry(SSQ_PARSER *parser) {
+    for (size_t i = 0; i < parser->string; ++i) {
+        SSQ_PARSER_STRING *string = &parser->strings[i];
+        if (!string->carried && !ssq_parser_append(parser, string, string->str, string->len))
+            return;
+    }
+}
+
+bool ssq_parser_feed(SSQ_PARSER *parser, const uint8_t bytes[], size_t len) {
+    size_t pos = 0;
+    while (pos < len && parser->state != SSQ_PARSER_DONE && parser->state != SSQ_PARSER_STOPPED) {
+        if (parser->state == SSQ_PARSER_HEADER) {
+            uint8_t header = bytes[pos++];
+            if (header == 0xFF && parser->prefix_len < SSQ_PACKET_HEADER_LEN) {
+                ++parser->prefix_len;
+            } else if (header != ((parser->kind == A2S_QUERY_PLAYER) ? S2A_HEADER_PLAYER : S2A_HEADER_RULES)) {
+                ssq_parser_fail(parser, SSQE_INVALID_RESPONSE, (parser->kind == A2S_QUERY_PLAYER) ? "Invalid A2S_PLAYER response header" : "Invalid A2S_RULES response header");
+            } else {
+                parser->state = SSQ_PARSER_COUNT;
+            }
+        } else if (parser->state == SSQ_PARSER_COUNT) {
+            size_t size = (parser->kind == A2S_QUERY_PLAYER) ? sizeof (uint8_t) : sizeof (uint16_t);
+            const uint8_t *value = ssq_parser_fixed(parser, bytes, len, &pos, size);
+            if (value == NULL)
+                break;
+            SSQ_STREAM stream;
+            ssq_stream_wrap(&stream, value, size);
+            parser->record_count = (size == sizeof (uint8_t)) ? ssq_stream_read_uint8_t(&stream) : ssq_stream_read_uint16_t(&stream);
+            parser->state = (parser->record_count != 0) ? SSQ_PARSER_RECORD : SSQ_PARSER_DONE;
+        } else {
+            ssq_parser_read_field(parser, bytes, len, &pos);
+        }
+    }
+    if (parser->state == SSQ_PARSER_RECORD)
+        ssq_parser_carry(parser);
+    return parser->state != SSQ_PARSER_STOPPED;
+}
+
+bool ssq_parser_done(const SSQ_PARSER *parser) {
+    return parser->state == SSQ_PARSER_DONE;
+}
+
+uint16_t ssq_parser_count(const SSQ_PARSER *parser) {
+    return parser->delivered;
+}
+
+/*
+ * Decodes another copy of the response from its start, without delivering the records again:
+ * the ones already delivered are taken to be the first records of the copy.
+ */
+static void ssq_parser_restart(SSQ_PARSER *parser) {
+    parser->state        = SSQ_PARSER_HEADER;
+    parser->prefix_len   = 0;
+    parser->record_count = 0;
+    parser->skip         = parser->delivered;
+    parser->field        = 0;
+    parser->string       = 0;
+    parser->fixed_len    = 0;
+    for (size_t i = 0; i < SSQ_PARSER_STRING_MAX; ++i) {
+        parser->strings[i].str     = NULL;
+        parser->strings[i].len     = 0;
+        parser->strings[i].carried = false;
+    }
+}
+
+/* Query */
+
+/* Payloads of the packets of a split response that arrived before the ones preceding them. */
+typedef struct ssq_parser_packets {
+    int32_t  id;                    /* Unique number of the response.                   */
+    uint8_t  total;                 /* Number of packets in the response, 0 if unknown. */
+    uint8_t  next;                  /* Number of the next packet to decode.             */
+    bool     renewable;             /* Whether a response with another id replaces it.  */
+    uint8_t *early[UINT8_MAX];      /* Payloads of the packets past `next', if any.     */
+    uint16_t early_lens[UINT8_MAX]; /* Length of each payload in `early'.               */
+} SSQ_PARSER_PACKETS;
+
+static void ssq_parser_packets_clear(SSQ_PARSER_PACKETS *packets) {
+    for (size_t i = 0; i < packets->total; ++i)
+        free(packets->early[i]);
+}
+
+/* Same as `ssq_parser_feed', telling the tracing callback of the server queried. */
+static bool ssq_parser_feed_traced(SSQ_PARSER *parser, const SSQ_SERVER *server, const uint8_t bytes[], size_t len) {
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, len);
+    bool go_on = ssq_parser_feed(parser, bytes, len);
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    return go_on;
+}
+
+/*
+ * Decodes the payload of a packet of a split response once the packets before it were decoded.
+ * Returns whether the packet was not received yet.
+ */
+static bool ssq_parser_on_packet(SSQ_PARSER *parser, const SSQ_SERVER *server, SSQ_PARSER_PACKETS *packets, const SSQ_PACKET *packet, const uint8_t payload[], SSQ_ERROR *error) {
+    // A copy of the response sent after a re-request replaces the packets held so far.
+    if (packets->total != 0 && packet->id != packets->id && packets->renewable) {
+        ssq_parser_packets_clear(packets);
+        memset(packets, 0, sizeof (*packets));
+        ssq_parser_restart(parser);
+    }
+    if (packets->total == 0) {
+        if (packet->total == 0 || packet->size == 0 || packet->number >= packet->total) {
+            ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet header");
+            return false;
+        }
+        packets->id    = packet->id;
+        packets->total = packet->total;
+    } else if (packet->id != packets->id) {
+        return false; // Stray packet belonging to another response (e.g. of an earlier query).
+    } else if (packet->number >= packets->total) {
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Invalid packet number");
+        return false;
+    }
+    if (packet->number < packets->next || packets->early[packet->number] != NULL)
+        return false; // Duplicate.
+    if (packet->number > packets->next) {
+        uint8_t *early = malloc(ssq_helper_maxz(packet->payload_len, 1));
+        if (early == NULL) {
+            ssq_error_set_from_errno(error);
+            return false;
+        }
+        memcpy(early, payload, packet->payload_len);
+        packets->early[packet->number]      = early;
+        packets->early_lens[packet->number] = (uint16_t)packet->payload_len;
+        return true;
+    }
+    bool go_on = ssq_parser_feed_traced(parser, server, payload, packet->payload_len);
+    for (++packets->next; go_on && packets->next < packets->total && packets->early[packets->next] != NULL; ++packets->next) {
+        go_on = ssq_parser_feed_traced(parser, server, packets->early[packets->next], packets->early_lens[packets->next]);
+        free(packets->early[packets->next]);
+        packets->early[packets->next] = NULL;
+    }
+    return true;
+}
+
+#ifdef SSQ_HAVE_BZIP2
+/* Compressed payloads form a single bzip2 stream: they are decompressed and decoded all at once. */
+static bool ssq_parser_on_compressed(SSQ_PARSER *parser, const SSQ_SERVER *server, SSQ_REASSEMBLY *reassembly, const uint8_t datagram[], size_t datagram_len, SSQ_ERROR *error) {
+    ssq_reassembly_add(reassembly, datagram, datagram_len, error);
+    if (error->code != SSQE_OK || !ssq_reassembly_done(reassembly))
+        return false;
+    size_t response_len;
+    uint8_t *response = ssq_reassembly_to_response(reassembly, &response_len, error);
+    if (response == NULL)
+        return false;
+    SSQ_TRACE(server, SSQ_TRACE_REASSEMBLED, response_len);
+    ssq_parser_feed_traced(parser, server, response, response_len);
+    free(response);
+    return true;
+}
+#endif /* SSQ_HAVE_BZIP2 */
+
+/* Receives the response to the query just sent; returns false if the server sent a challenge instead. */
+static bool ssq_parser_recv(SSQ_PARSER *parser, SSQ_SERVER *server, SOCKET sockfd, const uint8_t payload[], size_t payload_len, int32_t *chall, SSQ_ERROR *error) {
+    SSQ_QUERY_WAIT wait;
+    ssq_query_wait_init(&wait, server);
+    SSQ_PARSER_PACKETS packets;
+    memset(&packets, 0, sizeof (packets));
+#ifdef SSQ_HAVE_BZIP2
+    SSQ_REASSEMBLY reassembly;
+    ssq_reassembly_init(&reassembly);
+#endif /* SSQ_HAVE_BZIP2 */
+    bool answered = false;
+    bool finished = false;
+    while (!finished && parser->state != SSQ_PARSER_STOPPED && error->code == SSQE_OK) {
+        unsigned sends = wait.sends;
+        if (!ssq_query_wait_next(&wait, server, sockfd, payload, payload_len, error))
+            break;
+        if (wait.sends != sends) {
+            packets.renewable = true;
+#ifdef SSQ_HAVE_BZIP2
+            ssq_reassembly_renew(&reassembly);
+#endif /* SSQ_HAVE_BZIP2 */
+        }
+        uint8_t datagram[SSQ_PACKET_SIZE];
+        long bytes_received = ssq_socket_recv(sockfd, datagram, sizeof (datagram), error);
+        ssq_metrics_received(server, bytes_received);
+        if (bytes_received == SOCKET_ERROR) {
+            if (error->code != SSQE_OK)
+                break;
+            continue;
+        }
+        SSQ_TRACE(server, SSQ_TRACE_RECV, (size_t)bytes_received);
+        SSQ_PACKET packet;
+        if (!ssq_packet_parse(&packet, datagram, (size_t)bytes_received, error))
+            break;
+        if (packet.header == SSQ_PACKET_HEADER_SINGLE) {
+            if (packets.total != 0)
+                continue; // Stray packet: a split response is already being decoded.
+            ssq_query_wait_progress(&wait, server);
+            const uint8_t *single = datagram + SSQ_PACKET_HEADER_LEN;
+            if (ssq_response_has_challenge(single, packet.payload_len)) {
+                *chall = ssq_response_get_challenge(single, packet.payload_len);
+                break;
+            }
+            ssq_parser_feed_traced(parser, server, single, packet.payload_len);
+            answered = finished = true;
+#ifdef SSQ_HAVE_BZIP2
+        } else if (packet.id & SSQ_PACKET_FLAG_COMPRESSION) {
+            answered = true;
+            uint8_t received = reassembly.received;
+            int32_t id = reassembly.id;
+            finished = ssq_parser_on_compressed(parser, server, &reassembly, datagram, (size_t)bytes_received, error);
+            if (reassembly.received != received || reassembly.id != id)
+                ssq_query_wait_progress(&wait, server);
+#endif /* SSQ_HAVE_BZIP2 */
+        } else {
+            answered = true;
+            if (ssq_parser_on_packet(parser, server, &packets, &packet, datagram + SSQ_PACKET_MULTI_HEADER_LEN, error))
+                ssq_query_wait_progress(&wait, server);
+            finished = (packets.total != 0 && packets.next == packets.total);
+        }
+    }
+    ssq_parser_packets_clear(&packets);
+#ifdef SSQ_HAVE_BZIP2
+    ssq_reassembly_clear(&reassembly);
+#endif /* SSQ_HAVE_BZIP2 */
+    if (finished && parser->state != SSQ_PARSER_DONE && parser->state != SSQ_PARSER_STOPPED)
+        ssq_error_set(error, SSQE_INVALID_RESPONSE, "Response ended before its last record");
+    return answered || error->code != SSQE_OK;
+}
+
+static size_t ssq_parser_query(SSQ_SERVER *server, SSQ_PARSER *parser) {
+    if (!ssq_server_answers(server, parser->kind, &server->last_error))
+        return 0;
+    ssq_metrics_count(server, SSQ_METRICS_QUERIES);
+    SOCKET sockfd = ssq_query_acquire_socket(server);
+    if (sockfd == INVALID_SOCKET) {
+        ssq_metrics_failed(server, &server->last_error);
+        return 0;
+    }
+    int32_t cached;
+    const int32_t *cached_chall = ssq_server_chall(server, parser->kind, &cached);
+    bool challenged = (cached_chall != NULL);
+    uint8_t payload[A2S_PAYLOAD_SIZE];
+    size_t payload_len = ssq_a2s_payload(parser->kind, payload, cached_chall);
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    for (;;) {
+        if (!ssq_socket_send(sockfd, payload, payload_len, &error))
+            break;
+        SSQ_TRACE(server, SSQ_TRACE_SEND, payload_len);
+        int32_t chall;
+        if (ssq_parser_recv(parser, server, sockfd, payload, payload_len, &chall, &error))
+            break;
+        ssq_server_learn_chall(server, parser->kind, chall);
+        ssq_metrics_count(server, SSQ_METRICS_CHALLENGES);
+        SSQ_TRACE(server, SSQ_TRACE_CHALLENGE, 0);
+        payload_len = ssq_a2s_payload(parser->kind, payload, &chall);
+        challenged = true;
+    }
+    if (error.code == SSQE_OK && !ssq_parser_eok(parser))
+        error = parser->last_error;
+    if (error.code != SSQE_OK)
+        server->last_error = error;
+    ssq_metrics_failed(server, &error);
+    if (error.code == SSQE_OK)
+        ssq_server_learn_answer(server, parser->kind);
+    else if (challenged && error.code == SSQE_TIMEOUT)
+        ssq_server_learn_timeout(server, parser->kind);
+    ssq_query_release_socket(server, sockfd);
+    return parser->delivered;
+}
+
+size_t ssq_player_each(SSQ_SERVER *server, SSQ_PLAYER_CALLBACK callback, void *data) {
+    SSQ_PARSER parser;
+    ssq_parser_init(&parser, A2S_QUERY_PLAYER, data);
+    parser.on_player = callback;
+    size_t player_count = ssq_parser_query(server, &parser);
+    ssq_parser_clear(&parser);
+    return player_count;
+}
+
+size_t ssq_rules_each(SSQ_SERVER *server, SSQ_RULES_CALLBACK callback, void *data) {
+    SSQ_PARSER parser;
+    ssq_parser_init(&parser, A2S_QUERY_RULES, data);
+    parser.on_rule = callback;
+    size_t rule_count = ssq_parser_query(server, &parser);
+    ssq_parser_clear(&parser);
+    return rule_count;
+}
+
+bool           ssq_parser_eok(const SSQ_PARSER *parser)   { return ssq_parser_ecode(parser) == SSQE_OK; }
+SSQ_ERROR_CODE ssq_parser_ecode(const SSQ_PARSER *parser) { return parser->last_error.code; }
+const char    *ssq_parser_emsg(const SSQ_PARSER *parser)  { return parser->last_error.message; }
+
+void ssq_parser_eclr(SSQ_PARSER *parser) {
+    parser->last_error.code = SSQE_OK;
+    parser->last_error.message[0] = '\0';
+}
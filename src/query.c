@@ -2,16 +2,14 @@
 
 #include <stdlib.h>
 
+#include "a2s.h"
+#include "helper.h"
+#include "metrics.h"
 #include "packet.h"
+#include "response.h"
 #include "server.h"
-
-#ifndef _WIN32
-# include <unistd.h>
-# define INVALID_SOCKET (-1)
-# define SOCKET_ERROR   (-1)
-# define closesocket    close
-typedef int SOCKET;
-#endif /* !_WIN32 */
+#include "socket.h"
+#include "trace.h"
 
 static bool ssq_query_init_socket_timeout(SOCKET sockfd, const SSQ_TIMEOUT *value) {
     if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&value->recv, sizeof (value->recv)) == SOCKET_ERROR)
@@ -22,105 +20,186 @@ static bool ssq_query_init_socket_timeout(SOCKET sockfd, const SSQ_TIMEOUT *valu
 }
 
 static SOCKET ssq_query_init_socket(SSQ_SERVER *server) {
-    SOCKET sockfd = INVALID_SOCKET;
-    for (struct addrinfo *addr = server->addr_list; addr != NULL; addr = addr->ai_next) {
-        sockfd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-        if (sockfd == INVALID_SOCKET)
-            continue;
-#ifdef _WIN32
-        if (connect(sockfd, addr->ai_addr, (int)addr->ai_addrlen) != SOCKET_ERROR)
-#else /* !_WIN32 */
-        if (connect(sockfd, addr->ai_addr, addr->ai_addrlen) != SOCKET_ERROR)
-#endif /* _WIN32 */
-            break;
-        closesocket(sockfd);
-        sockfd = INVALID_SOCKET;
-    }
-    if (sockfd == INVALID_SOCKET) {
-        ssq_error_set(&server->last_error, SSQE_NO_SOCKET, "Could not create an endpoint for communication");
+    SOCKET sockfd = ssq_socket_open(server->addr_list, &server->last_error);
+    if (sockfd == INVALID_SOCKET)
         return INVALID_SOCKET;
-    }
     if (!ssq_query_init_socket_timeout(sockfd, &server->timeout)) {
-#ifdef _WIN32
-        ssq_error_set_from_wsa(&server->last_error);
-#else /* !_WIN32 */
-        ssq_error_set_from_errno(&server->last_error);
-#endif /* _WIN32 */
+        ssq_socket_set_error(&server->last_error);
         closesocket(sockfd);
-        sockfd = INVALID_SOCKET;
+        return INVALID_SOCKET;
     }
+    SSQ_TRACE(server, SSQ_TRACE_SOCKET, 0);
     return sockfd;
 }
 
-static void ssq_query_send(SOCKET sockfd, const uint8_t payload[], size_t payload_len, SSQ_ERROR *error) {
-#ifdef _WIN32
-    if (send(sockfd, (const char *)payload, (int)payload_len, 0) == SOCKET_ERROR)
-        ssq_error_set_from_wsa(error);
-#else /* !_WIN32 */
-    if (send(sockfd, payload, payload_len, 0) == SOCKET_ERROR)
-        ssq_error_set_from_errno(error);
-#endif /* _WIN32 */
+SOCKET ssq_query_acquire_socket(SSQ_SERVER *server) {
+    if (!server->reuse_socket)
+        return ssq_query_init_socket(server);
+    if (server->sockfd == INVALID_SOCKET)
+        server->sockfd = ssq_query_init_socket(server);
+    else
+        ssq_socket_drain(server->sockfd); // Late answers to earlier queries that timed out.
+    return server->sockfd;
 }
 
-static SSQ_PACKET **ssq_query_recv(SOCKET sockfd, uint8_t *packet_count, SSQ_ERROR *error) {
-    *packet_count = 1;
-    SSQ_PACKET **packets = NULL;
-    for (uint8_t packets_received = 0; packets_received < *packet_count; ++packets_received) {
-        uint8_t datagram[SSQ_PACKET_SIZE];
-#ifdef _WIN32
-        int bytes_received = recv(sockfd, (char *)datagram, SSQ_PACKET_SIZE, 0);
-#else /* !_WIN32 */
-        ssize_t bytes_received = recv(sockfd, datagram, SSQ_PACKET_SIZE, 0);
-#endif /* _WIN32 */
-        if (bytes_received == SOCKET_ERROR) {
-#ifdef _WIN32
-            ssq_error_set_from_wsa(error);
-#else /* !_WIN32 */
-            ssq_error_set_from_errno(error);
-#endif /* _WIN32 */
-            break;
+void ssq_query_release_socket(SSQ_SERVER *server, SOCKET sockfd) {
+    if (sockfd != server->sockfd) {
+        closesocket(sockfd);
+    } else if (ssq_server_ecode(server) == SSQE_SYSTEM) {
+        closesocket(sockfd);
+        server->sockfd = INVALID_SOCKET;
+    }
+}
+
+/* A receive timeout of 0 waits forever, as it does for SO_RCVTIMEO. */
+static inline uint64_t ssq_query_deadline(const SSQ_QUERY_WAIT *wait, uint64_t now) {
+    return (wait->timeout != 0) ? now + wait->timeout : UINT64_MAX;
+}
+
+void ssq_query_wait_init(SSQ_QUERY_WAIT *wait, const SSQ_SERVER *server) {
+    wait->sent     = ssq_helper_clock_millis();
+    wait->timeout  = ssq_server_recv_timeout(server);
+    wait->deadline = ssq_query_deadline(wait, wait->sent);
+    wait->rto      = ssq_server_rto(server);
+    wait->resend   = wait->sent + wait->rto;
+    wait->sends    = 1;
+    wait->resends  = 0;
+    wait->answered = false;
+}
+
+bool ssq_query_wait_next(SSQ_QUERY_WAIT *wait, SSQ_SERVER *server, SOCKET sockfd, const uint8_t payload[], size_t payload_len, SSQ_ERROR *error) {
+    for (;;) {
+        uint64_t now = ssq_helper_clock_millis();
+        bool may_resend = (wait->resends < server->retransmits && wait->resend < wait->deadline);
+        uint64_t until = may_resend ? wait->resend : wait->deadline;
+        int ready = ssq_socket_poll(sockfd, (until > now) ? until - now : 0);
+        if (ready == SOCKET_ERROR) {
+            ssq_socket_set_error(error);
+            return false;
         }
-        SSQ_PACKET *packet = ssq_packet_from_datagram(datagram, bytes_received, error);
-        if (error->code != SSQE_OK)
-            break;
-        bool is_first_packet = (packets == NULL);
-        if (is_first_packet) {
-            *packet_count = packet->total;
-            packets = calloc(*packet_count, sizeof (*packets));
-            if (packets == NULL) {
-                ssq_packet_free(packet);
-                ssq_error_set_from_errno(error);
-                break;
-            }
+        if (ready > 0)
+            return true;
+        now = ssq_helper_clock_millis();
+        if (now >= wait->deadline) {
+            ssq_error_set(error, SSQE_TIMEOUT, "Timed out waiting for a response");
+            return false;
+        }
+        if (may_resend && now >= wait->resend) {
+            if (!ssq_socket_send(sockfd, payload, payload_len, error))
+                return false;
+            ssq_metrics_count(server, SSQ_METRICS_RETRANSMITS);
+            SSQ_TRACE(server, SSQ_TRACE_SEND, payload_len);
+            ++wait->sends;
+            ++wait->resends;
+            wait->rto   *= 2;
+            wait->resend = now + wait->rto;
         }
-        packets[packet->number] = packet;
     }
-    if (error->code != SSQE_OK && packets != NULL) {
-        ssq_packets_free(packets, *packet_count);
-        packets = NULL;
+}
+
+void ssq_query_wait_progress(SSQ_QUERY_WAIT *wait, SSQ_SERVER *server) {
+    uint64_t now = ssq_helper_clock_millis();
+    // Which of the requests a response answers is unknown once one was sent again (Karn's algorithm).
+    if (!wait->answered && wait->sends == 1) {
+        ssq_server_learn_rtt(server, now - wait->sent);
+        ssq_metrics_rtt(server, now - wait->sent);
+    }
+    wait->answered = true;
+    wait->deadline = ssq_query_deadline(wait, now);
+    wait->rto      = ssq_server_rto(server);
+    wait->resend   = now + ssq_server_gap(server);
+    wait->resends  = 0;
+}
+
+static void ssq_query_recv(SSQ_SERVER *server, SOCKET sockfd, const uint8_t payload[], size_t payload_len, SSQ_REASSEMBLY *reassembly) {
+    SSQ_QUERY_WAIT wait;
+    ssq_query_wait_init(&wait, server);
+    while (!ssq_reassembly_done(reassembly)) {
+        unsigned sends = wait.sends;
+        if (!ssq_query_wait_next(&wait, server, sockfd, payload, payload_len, &server->last_error))
+            break;
+        if (wait.sends != sends)
+            ssq_reassembly_renew(reassembly);
+        uint8_t received = reassembly->received;
+        int32_t id = reassembly->id;
+        long bytes_received = ssq_reassembly_recv(reassembly, sockfd, &server->last_error);
+        ssq_metrics_received(server, bytes_received);
+        if (bytes_received != SOCKET_ERROR)
+            SSQ_TRACE(server, SSQ_TRACE_RECV, (size_t)bytes_received);
+        if (!ssq_server_eok(server))
+            break;
+        if (reassembly->received != received || reassembly->id != id)
+            ssq_query_wait_progress(&wait, server);
     }
-    return packets;
 }
 
 uint8_t *ssq_query(SSQ_SERVER *server, const uint8_t payload[], size_t payload_len, size_t *response_len) {
-    SOCKET sockfd = ssq_query_init_socket(server);
-    if (!ssq_server_eok(server))
+    SOCKET sockfd = ssq_query_acquire_socket(server);
+    if (sockfd == INVALID_SOCKET)
         return NULL;
-    ssq_query_send(sockfd, payload, payload_len, &server->last_error);
-    if (!ssq_server_eok(server))
-        goto end;
-    uint8_t packet_count = 0;
-    SSQ_PACKET **packets = ssq_query_recv(sockfd, &packet_count, &server->last_error);
-    if (!ssq_server_eok(server))
-        goto end;
-    const SSQ_PACKET *const *packets_readonly = (const SSQ_PACKET *const *)packets;
     uint8_t *response = NULL;
-    if (ssq_packets_check_integrity(packets_readonly, packet_count))
-        response = ssq_packets_to_response(packets_readonly, packet_count, response_len, &server->last_error);
-    else
-        ssq_error_set(&server->last_error, SSQE_INVALID_RESPONSE, "Packet ID mismatch");
-    ssq_packets_free(packets, packet_count);
+    if (!ssq_socket_send(sockfd, payload, payload_len, &server->last_error))
+        goto end;
+    SSQ_TRACE(server, SSQ_TRACE_SEND, payload_len);
+    SSQ_REASSEMBLY reassembly;
+    ssq_reassembly_init(&reassembly);
+    ssq_query_recv(server, sockfd, payload, payload_len, &reassembly);
+    if (ssq_server_eok(server))
+        response = ssq_reassembly_to_response(&reassembly, response_len, &server->last_error);
+    if (response != NULL)
+        SSQ_TRACE(server, SSQ_TRACE_REASSEMBLED, *response_len);
+    ssq_reassembly_clear(&reassembly);
 end:
-    closesocket(sockfd);
+    ssq_query_release_socket(server, sockfd);
     return response;
 }
+
+uint8_t *ssq_query_a2s(SSQ_SERVER *server, A2S_QUERY_KIND kind, size_t *response_len) {
+    if (!ssq_server_answers(server, kind, &server->last_error))
+        return NULL;
+    int32_t cached;
+    const int32_t *cached_chall = ssq_server_chall(server, kind, &cached);
+    bool challenged = (cached_chall != NULL);
+    uint8_t payload[A2S_PAYLOAD_SIZE];
+    size_t payload_len = ssq_a2s_payload(kind, payload, cached_chall);
+    ssq_metrics_count(server, SSQ_METRICS_QUERIES);
+    uint8_t *response = ssq_query(server, payload, payload_len, response_len);
+    while (response != NULL && ssq_response_has_challenge(response, *response_len)) {
+        int32_t chall = ssq_response_get_challenge(response, *response_len);
+        ssq_server_learn_chall(server, kind, chall);
+        ssq_metrics_count(server, SSQ_METRICS_CHALLENGES);
+        SSQ_TRACE(server, SSQ_TRACE_CHALLENGE, 0);
+        payload_len = ssq_a2s_payload(kind, payload, &chall);
+        free(response);
+        challenged = true;
+        response = ssq_query(server, payload, payload_len, response_len);
+    }
+    if (response != NULL)
+        ssq_server_learn_answer(server, kind);
+    else if (challenged && ssq_server_ecode(server) == SSQE_TIMEOUT)
+        ssq_server_learn_timeout(server, kind);
+    if (response == NULL)
+        ssq_metrics_failed(server, &server->last_error);
+    return response;
+}
+
+uint8_t *ssq_query_a2s_changed(SSQ_SERVER *server, A2S_QUERY_KIND kind, size_t *response_len, uint64_t *fingerprint, bool *unchanged) {
+    *unchanged = false;
+    uint8_t *response = ssq_query_a2s(server, kind, response_len);
+    if (response == NULL)
+        return NULL;
+    *fingerprint = ssq_response_fingerprint(response, *response_len);
+    if (*fingerprint == ssq_server_fingerprint(server, kind)) {
+        free(response);
+        *unchanged = true;
+        return NULL;
+    }
+    return response;
+}
+
+void ssq_query_decoded(SSQ_SERVER *server, const SSQ_ERROR *error) {
+    if (error->code == SSQE_OK)
+        return;
+    server->last_error = *error;
+    ssq_metrics_failed(server, error);
+}
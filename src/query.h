@@ -1,15 +1,59 @@
 #ifndef QUERY_H
 #define QUERY_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
+#include "ssq/a2s.h"
 #include "ssq/server.h"
 
+#include "socket.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+SOCKET   ssq_query_acquire_socket(SSQ_SERVER *server);
+void     ssq_query_release_socket(SSQ_SERVER *server, SOCKET sockfd);
+
+/*
+ * Paces the wait for the packets of the response to a request. The request is sent again when the
+ * first packet is late (after the retransmission timeout of the server, doubled each time) and when
+ * a later packet is (after the gap timeout of the server): in the latter case, the server answers
+ * anew and the packets missing are taken from the new response.
+ */
+typedef struct ssq_query_wait {
+    uint64_t sent;     /* When the request was first sent.                                */
+    uint64_t timeout;  /* Receive timeout of the server, 0 for none.                      */
+    uint64_t deadline; /* When to give up, unless a packet arrives first.                 */
+    uint64_t resend;   /* When to send the request again.                                 */
+    uint64_t rto;      /* How long to wait after sending the request again.               */
+    unsigned sends;    /* Number of times the request was sent.                           */
+    unsigned resends;  /* Number of times it was sent again since the last packet.        */
+    bool     answered; /* Whether a packet of the response arrived.                       */
+} SSQ_QUERY_WAIT;
+
+/* To be called right after the request was sent. */
+void     ssq_query_wait_init(SSQ_QUERY_WAIT *wait, const SSQ_SERVER *server);
+/*
+ * Waits until a datagram is ready to be received, sending the request again when due. Returns
+ * false if the receive timeout of the server expired first or the request could not be sent again.
+ */
+bool     ssq_query_wait_next(SSQ_QUERY_WAIT *wait, SSQ_SERVER *server, SOCKET sockfd, const uint8_t *payload, size_t payload_len, SSQ_ERROR *error);
+/* To be called when a datagram brought a packet of the response not received yet. */
+void     ssq_query_wait_progress(SSQ_QUERY_WAIT *wait, SSQ_SERVER *server);
+
 uint8_t *ssq_query(SSQ_SERVER *server, const uint8_t *payload, size_t payload_len, size_t *response_len);
+uint8_t *ssq_query_a2s(SSQ_SERVER *server, A2S_QUERY_KIND kind, size_t *response_len);
+/*
+ * Same as `ssq_query_a2s', except that NULL is also returned, with `unchanged' set, when the
+ * response has the fingerprint of the last response of its kind decoded from the server. The
+ * fingerprint is stored in `fingerprint', to be learnt once the response was decoded.
+ */
+uint8_t *ssq_query_a2s_changed(SSQ_SERVER *server, A2S_QUERY_KIND kind, size_t *response_len, uint64_t *fingerprint, bool *unchanged);
+/* To be called once a response was decoded: a failure becomes the last error of the server and is counted. */
+void     ssq_query_decoded(SSQ_SERVER *server, const SSQ_ERROR *error);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,182 @@
+#include "registry.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+# include <windows.h>
+#else /* !_WIN32 */
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif /* _WIN32 */
+
+static const uint8_t ssq_registry_ipv4_mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+SSQ_REGISTRY *ssq_registry_new(void) {
+    SSQ_REGISTRY *registry = malloc(sizeof (*registry));
+    if (registry == NULL)
+        return NULL;
+    registry->blocks      = NULL;
+    registry->block_count = 0;
+    registry->servers     = NULL;
+    registry->count       = 0;
+    registry->capacity    = 0;
+    ssq_registry_eclr(registry);
+    return registry;
+}
+
+void ssq_registry_free(SSQ_REGISTRY *registry) {
+    if (registry == NULL)
+        return;
+    for (size_t i = 0; i < registry->count; ++i)
+        ssq_server_fini(registry->servers[i]);
+    for (size_t i = 0; i < registry->block_count; ++i)
+        free(registry->blocks[i]);
+    free(registry->blocks);
+    free(registry->servers);
+    free(registry);
+}
+
+static bool ssq_registry_reserve(SSQ_REGISTRY *registry, size_t count) {
+    if (count > registry->capacity) {
+        size_t capacity = (registry->capacity > 0) ? registry->capacity : SSQ_REGISTRY_BLOCK_LEN;
+        while (capacity < count)
+            capacity *= 2;
+        SSQ_SERVER **servers = realloc(registry->servers, capacity * sizeof (*servers));
+        if (servers == NULL) {
+            ssq_error_set_from_errno(&registry->error);
+            return false;
+        }
+        registry->servers  = servers;
+        registry->capacity = capacity;
+    }
+    size_t block_count = (count + SSQ_REGISTRY_BLOCK_LEN - 1) / SSQ_REGISTRY_BLOCK_LEN;
+    if (block_count > registry->block_count) {
+        SSQ_SERVER **blocks = realloc(registry->blocks, block_count * sizeof (*blocks));
+        if (blocks == NULL) {
+            ssq_error_set_from_errno(&registry->error);
+            return false;
+        }
+        registry->blocks = blocks;
+        while (registry->block_count < block_count) {
+            SSQ_SERVER *block = malloc(SSQ_REGISTRY_BLOCK_LEN * sizeof (*block));
+            if (block == NULL) {
+                ssq_error_set_from_errno(&registry->error);
+                return false;
+            }
+            registry->blocks[registry->block_count++] = block;
+        }
+    }
+    return true;
+}
+
+SSQ_SERVER *ssq_registry_add(SSQ_REGISTRY *registry, const struct sockaddr *addr, size_t addr_len) {
+    if (!ssq_registry_reserve(registry, registry->count + 1))
+        return NULL;
+    size_t index = registry->count;
+    SSQ_SERVER *server = &registry->blocks[index / SSQ_REGISTRY_BLOCK_LEN][index % SSQ_REGISTRY_BLOCK_LEN];
+    if (!ssq_server_init_numeric(server, addr, addr_len, &registry->error))
+        return NULL;
+    registry->servers[registry->count++] = server;
+    return server;
+}
+
+static size_t ssq_registry_record_to_addr(const uint8_t record[], struct sockaddr_storage *addr) {
+    memset(addr, 0, sizeof (*addr));
+    if (memcmp(record, ssq_registry_ipv4_mapped_prefix, sizeof (ssq_registry_ipv4_mapped_prefix)) == 0) {
+        struct sockaddr_in *addr_in = (struct sockaddr_in *)addr;
+        addr_in->sin_family = AF_INET;
+        memcpy(&addr_in->sin_addr, record + 12, 4);
+        memcpy(&addr_in->sin_port, record + 16, 2);
+        return sizeof (*addr_in);
+    }
+    struct sockaddr_in6 *addr_in6 = (struct sockaddr_in6 *)addr;
+    addr_in6->sin6_family = AF_INET6;
+    memcpy(&addr_in6->sin6_addr, record, 16);
+    memcpy(&addr_in6->sin6_port, record + 16, 2);
+    return sizeof (*addr_in6);
+}
+
+bool ssq_registry_add_records(SSQ_REGISTRY *registry, const uint8_t records[], size_t record_count) {
+    if (!ssq_registry_reserve(registry, registry->count + record_count))
+        return false;
+    for (size_t i = 0; i < record_count; ++i) {
+        struct sockaddr_storage addr;
+        size_t addr_len = ssq_registry_record_to_addr(records + i * SSQ_REGISTRY_RECORD_SIZE, &addr);
+        if (ssq_registry_add(registry, (const struct sockaddr *)&addr, addr_len) == NULL)
+            return false;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+static void ssq_registry_load_file(SSQ_REGISTRY *registry, const char path[]) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        ssq_error_set(&registry->error, SSQE_SYSTEM, "Could not open the target file");
+        return;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        ssq_error_set(&registry->error, SSQE_SYSTEM, "Could not get the size of the target file");
+    } else if (file_size.QuadPart % SSQ_REGISTRY_RECORD_SIZE != 0) {
+        ssq_error_set(&registry->error, SSQE_INVALID_ARGUMENT, "Invalid target file size");
+    } else if (file_size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        const uint8_t *records = (mapping != NULL) ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (records != NULL) {
+            ssq_registry_add_records(registry, records, (size_t)(file_size.QuadPart / SSQ_REGISTRY_RECORD_SIZE));
+            UnmapViewOfFile(records);
+        } else {
+            ssq_error_set(&registry->error, SSQE_SYSTEM, "Could not map the target file");
+        }
+        if (mapping != NULL)
+            CloseHandle(mapping);
+    }
+    CloseHandle(file);
+}
+#else /* !_WIN32 */
+static void ssq_registry_load_file(SSQ_REGISTRY *registry, const char path[]) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        ssq_error_set_from_errno(&registry->error);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ssq_error_set_from_errno(&registry->error);
+    } else if (st.st_size % SSQ_REGISTRY_RECORD_SIZE != 0) {
+        ssq_error_set(&registry->error, SSQE_INVALID_ARGUMENT, "Invalid target file size");
+    } else if (st.st_size > 0) {
+        void *records = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (records != MAP_FAILED) {
+            ssq_registry_add_records(registry, records, (size_t)st.st_size / SSQ_REGISTRY_RECORD_SIZE);
+            munmap(records, (size_t)st.st_size);
+        } else {
+            ssq_error_set_from_errno(&registry->error);
+        }
+    }
+    close(fd);
+}
+#endif /* _WIN32 */
+
+SSQ_REGISTRY *ssq_registry_load(const char path[]) {
+    SSQ_REGISTRY *registry = ssq_registry_new();
+    if (registry != NULL)
+        ssq_registry_load_file(registry, path);
+    return registry;
+}
+
+size_t             ssq_registry_count(const SSQ_REGISTRY *registry)                 { return registry->count;          }
+SSQ_SERVER        *ssq_registry_server(const SSQ_REGISTRY *registry, size_t index)  { return registry->servers[index]; }
+SSQ_SERVER *const *ssq_registry_servers(const SSQ_REGISTRY *registry)               { return registry->servers;        }
+
+bool           ssq_registry_eok(const SSQ_REGISTRY *registry)   { return ssq_registry_ecode(registry) == SSQE_OK; }
+SSQ_ERROR_CODE ssq_registry_ecode(const SSQ_REGISTRY *registry) { return registry->error.code; }
+const char    *ssq_registry_emsg(const SSQ_REGISTRY *registry)  { return registry->error.message; }
+
+void ssq_registry_eclr(SSQ_REGISTRY *registry) {
+    registry->error.code = SSQE_OK;
+    registry->error.message[0] = '\0';
+}
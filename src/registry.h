@@ -0,0 +1,31 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+
+#include "ssq/registry.h"
+
+#include "error.h"
+#include "server.h"
+
+/* Number of servers allocated at once: servers never move once added. */
+#define SSQ_REGISTRY_BLOCK_LEN 1024
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct ssq_registry {
+    SSQ_SERVER **blocks;      /* Blocks of SSQ_REGISTRY_BLOCK_LEN servers.      */
+    size_t       block_count; /* Number of blocks allocated.                    */
+    SSQ_SERVER **servers;     /* Pointer to each server, in the order added.    */
+    size_t       count;       /* Number of servers added.                       */
+    size_t       capacity;    /* Number of entries allocated for `servers'.     */
+    SSQ_ERROR    error;       /* The last error of a registry operation.        */
+};
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !REGISTRY_H */
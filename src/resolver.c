@@ -0,0 +1,436 @@
+#include "resolver.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SSQ_RESOLVER_HOSTS_LINE_SIZE 1024
+
+static char *ssq_resolver_strdup(const char str[]) {
+    size_t size = strlen(str) + 1;
+    char *dup = malloc(size);
+    if (dup != NULL)
+        memcpy(dup, str, size);
+    return dup;
+}
+
+/* Resolution (on the resolving threads) */
+
+static const char *ssq_resolver_hosts_lookup(const SSQ_RESOLVER *resolver, const char hostname[]) {
+    for (size_t i = 0; i < resolver->host_count; ++i)
+        if (strcmp(resolver->hosts[i].name, hostname) == 0)
+            return resolver->hosts[i].addr;
+    return NULL;
+}
+
+static void ssq_resolver_resolve(const SSQ_RESOLVER *resolver, SSQ_RESOLVER_JOB *job) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof (hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    const char *node = job->hostname;
+    if (resolver->use_hosts) {
+        node = ssq_resolver_hosts_lookup(resolver, job->hostname);
+        if (node == NULL) {
+            job->addr_list = NULL;
+            job->gai_ecode = EAI_NONAME;
+            return;
+        }
+        hints.ai_flags = AI_NUMERICHOST;
+    } else {
+        hints.ai_flags = AI_ADDRCONFIG;
+    }
+    job->gai_ecode = getaddrinfo(node, job->port_str, &hints, &job->addr_list);
+    if (job->gai_ecode != 0)
+        job->addr_list = NULL;
+}
+
+static void ssq_resolver_thread(void *arg) {
+    SSQ_RESOLVER *resolver = arg;
+    ssq_mutex_lock(&resolver->mutex);
+    for (;;) {
+        while (resolver->pending_count == 0 && !resolver->stopping)
+            ssq_cond_wait(&resolver->work_cond, &resolver->mutex);
+        if (resolver->stopping)
+            break;
+        SSQ_RESOLVER_JOB job = resolver->pending[resolver->pending_head];
+        resolver->pending_head = (resolver->pending_head + 1) % resolver->job_size;
+        --resolver->pending_count;
+        ssq_mutex_unlock(&resolver->mutex);
+        ssq_resolver_resolve(resolver, &job);
+        ssq_mutex_lock(&resolver->mutex);
+        // Room for every job in flight is reserved when it is queued.
+        resolver->done[resolver->done_count++] = job;
+        ssq_cond_broadcast(&resolver->done_cond);
+    }
+    ssq_mutex_unlock(&resolver->mutex);
+}
+
+/* Lifecycle */
+
+SSQ_RESOLVER *ssq_resolver_new(size_t thread_count) {
+    SSQ_RESOLVER *resolver = calloc(1, sizeof (*resolver));
+    if (resolver == NULL)
+        return NULL;
+    if (thread_count == 0)
+        thread_count = SSQ_RESOLVER_THREADS_DEFAULT;
+    resolver->ttl          = SSQ_RESOLVER_TTL_DEFAULT;
+    resolver->negative_ttl = SSQ_RESOLVER_NEGATIVE_TTL_DEFAULT;
+    resolver->threads      = malloc(thread_count * sizeof (*resolver->threads));
+    if (resolver->threads == NULL) {
+        free(resolver);
+        return NULL;
+    }
+    ssq_mutex_init(&resolver->mutex);
+    ssq_cond_init(&resolver->work_cond);
+    ssq_cond_init(&resolver->done_cond);
+    while (resolver->thread_count < thread_count) {
+        if (!ssq_thread_start(&resolver->threads[resolver->thread_count], ssq_resolver_thread, resolver))
+            break;
+        ++resolver->thread_count;
+    }
+    if (resolver->thread_count == 0) {
+        ssq_resolver_free(resolver);
+        return NULL;
+    }
+    ssq_resolver_eclr(resolver);
+    return resolver;
+}
+
+void ssq_resolver_free(SSQ_RESOLVER *resolver) {
+    if (resolver == NULL)
+        return;
+    ssq_mutex_lock(&resolver->mutex);
+    resolver->stopping = true;
+    ssq_cond_broadcast(&resolver->work_cond);
+    ssq_mutex_unlock(&resolver->mutex);
+    for (size_t i = 0; i < resolver->thread_count; ++i)
+        ssq_thread_join(resolver->threads[i]);
+    for (size_t i = 0; i < resolver->done_count; ++i)
+        if (resolver->done[i].addr_list != NULL)
+            freeaddrinfo(resolver->done[i].addr_list);
+    for (size_t i = 0; i < resolver->entry_count; ++i) {
+        SSQ_RESOLVER_ENTRY *entry = &resolver->entries[i];
+        for (size_t j = 0; j < entry->server_count; ++j) {
+            entry->servers[j]->addr_list = NULL; // Owned by the entry.
+            ssq_server_free(entry->servers[j]);
+        }
+        if (entry->addr_list != NULL)
+            freeaddrinfo(entry->addr_list);
+        free(entry->servers);
+        free(entry->hostname);
+    }
+    for (size_t i = 0; i < resolver->host_count; ++i) {
+        free(resolver->hosts[i].name);
+        free(resolver->hosts[i].addr);
+    }
+    ssq_cond_destroy(&resolver->done_cond);
+    ssq_cond_destroy(&resolver->work_cond);
+    ssq_mutex_destroy(&resolver->mutex);
+    free(resolver->hosts);
+    free(resolver->entries);
+    free(resolver->table);
+    free(resolver->pending);
+    free(resolver->done);
+    free(resolver->threads);
+    free(resolver);
+}
+
+void ssq_resolver_ttl(SSQ_RESOLVER *resolver, uint64_t ttl_in_ms, uint64_t negative_ttl_in_ms) {
+    resolver->ttl          = ttl_in_ms;
+    resolver->negative_ttl = negative_ttl_in_ms;
+}
+
+/* Hosts file */
+
+static bool ssq_resolver_hosts_add(SSQ_RESOLVER *resolver, size_t *host_size, const char name[], const char addr[]) {
+    if (ssq_resolver_hosts_lookup(resolver, name) != NULL)
+        return true;
+    if (resolver->host_count == *host_size) {
+        size_t size = (*host_size > 0) ? *host_size * 2 : 16;
+        SSQ_RESOLVER_HOST *hosts = realloc(resolver->hosts, size * sizeof (*hosts));
+        if (hosts == NULL)
+            return false;
+        resolver->hosts = hosts;
+        *host_size      = size;
+    }
+    SSQ_RESOLVER_HOST *host = &resolver->hosts[resolver->host_count];
+    host->name = ssq_resolver_strdup(name);
+    host->addr = ssq_resolver_strdup(addr);
+    if (host->name == NULL || host->addr == NULL) {
+        free(host->name);
+        free(host->addr);
+        return false;
+    }
+    ++resolver->host_count;
+    return true;
+}
+
+static char *ssq_resolver_hosts_token(char **cursor) {
+    char *token = *cursor;
+    while (*token != '\0' && isspace((unsigned char)*token))
+        ++token;
+    if (*token == '\0')
+        return NULL;
+    char *end = token;
+    while (*end != '\0' && !isspace((unsigned char)*end))
+        ++end;
+    *cursor = (*end != '\0') ? end + 1 : end;
+    *end = '\0';
+    return token;
+}
+
+bool ssq_resolver_hosts_file(SSQ_RESOLVER *resolver, const char path[]) {
+    if (resolver->entry_count != 0) {
+        ssq_error_set(&resolver->error, SSQE_INVALID_ARGUMENT, "The hosts file must be set before adding servers");
+        return false;
+    }
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        ssq_error_set_from_errno(&resolver->error);
+        return false;
+    }
+    size_t host_size = resolver->host_count;
+    bool ok = true;
+    char line[SSQ_RESOLVER_HOSTS_LINE_SIZE];
+    while (ok && fgets(line, sizeof (line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        char *cursor = line;
+        const char *addr = ssq_resolver_hosts_token(&cursor);
+        if (addr == NULL)
+            continue;
+        for (const char *name; ok && (name = ssq_resolver_hosts_token(&cursor)) != NULL;)
+            ok = ssq_resolver_hosts_add(resolver, &host_size, name, addr);
+    }
+    fclose(file);
+    if (!ok) {
+        ssq_error_set_from_errno(&resolver->error);
+        return false;
+    }
+    resolver->use_hosts = true;
+    return true;
+}
+
+/* Entries */
+
+static size_t ssq_resolver_hash(const char hostname[], uint16_t port) {
+    uint64_t hash = 0xCBF29CE484222325; // FNV-1a
+    for (const char *c = hostname; *c != '\0'; ++c)
+        hash = (hash ^ (uint8_t)*c) * 0x100000001B3;
+    hash = (hash ^ (port & 0xFF)) * 0x100000001B3;
+    hash = (hash ^ (port >> 8)) * 0x100000001B3;
+    return (size_t)hash;
+}
+
+static void ssq_resolver_table_insert(SSQ_RESOLVER *resolver, size_t index) {
+    const SSQ_RESOLVER_ENTRY *entry = &resolver->entries[index];
+    size_t i = ssq_resolver_hash(entry->hostname, entry->port) & resolver->table_mask;
+    while (resolver->table[i] != 0)
+        i = (i + 1) & resolver->table_mask;
+    resolver->table[i] = index + 1;
+}
+
+static SSQ_RESOLVER_ENTRY *ssq_resolver_find(const SSQ_RESOLVER *resolver, const char hostname[], uint16_t port) {
+    if (resolver->table == NULL)
+        return NULL;
+    for (size_t i = ssq_resolver_hash(hostname, port) & resolver->table_mask; resolver->table[i] != 0; i = (i + 1) & resolver->table_mask) {
+        SSQ_RESOLVER_ENTRY *entry = &resolver->entries[resolver->table[i] - 1];
+        if (entry->port == port && strcmp(entry->hostname, hostname) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static bool ssq_resolver_grow(SSQ_RESOLVER *resolver) {
+    if (resolver->entry_count == resolver->entry_size) {
+        size_t size = (resolver->entry_size > 0) ? resolver->entry_size * 2 : 16;
+        SSQ_RESOLVER_ENTRY *entries = realloc(resolver->entries, size * sizeof (*entries));
+        if (entries == NULL)
+            return false;
+        resolver->entries    = entries;
+        resolver->entry_size = size;
+    }
+    // The table is kept at most half full.
+    if (2 * (resolver->entry_count + 1) > resolver->table_mask + 1 || resolver->table == NULL) {
+        size_t table_size = (resolver->table != NULL) ? 2 * (resolver->table_mask + 1) : 32;
+        size_t *table = calloc(table_size, sizeof (*table));
+        if (table == NULL)
+            return false;
+        free(resolver->table);
+        resolver->table      = table;
+        resolver->table_mask = table_size - 1;
+        for (size_t i = 0; i < resolver->entry_count; ++i)
+            ssq_resolver_table_insert(resolver, i);
+    }
+    return true;
+}
+
+static SSQ_RESOLVER_ENTRY *ssq_resolver_entry(SSQ_RESOLVER *resolver, const char hostname[], uint16_t port) {
+    SSQ_RESOLVER_ENTRY *entry = ssq_resolver_find(resolver, hostname, port);
+    if (entry != NULL)
+        return entry;
+    if (!ssq_resolver_grow(resolver)) {
+        ssq_error_set_from_errno(&resolver->error);
+        return NULL;
+    }
+    entry = &resolver->entries[resolver->entry_count];
+    memset(entry, 0, sizeof (*entry));
+    entry->hostname = ssq_resolver_strdup(hostname);
+    if (entry->hostname == NULL) {
+        ssq_error_set_from_errno(&resolver->error);
+        return NULL;
+    }
+    entry->port = port;
+    ssq_resolver_table_insert(resolver, resolver->entry_count++);
+    return entry;
+}
+
+/* Jobs (on the calling thread) */
+
+static bool ssq_resolver_reserve_jobs(SSQ_RESOLVER *resolver, size_t job_count) {
+    if (job_count <= resolver->job_size)
+        return true;
+    size_t size = (resolver->job_size > 0) ? resolver->job_size * 2 : 16;
+    while (size < job_count)
+        size *= 2;
+    SSQ_RESOLVER_JOB *pending = malloc(size * sizeof (*pending));
+    SSQ_RESOLVER_JOB *done    = realloc(resolver->done, size * sizeof (*done));
+    if (done != NULL)
+        resolver->done = done;
+    if (pending == NULL || done == NULL) {
+        free(pending);
+        return false;
+    }
+    for (size_t i = 0; i < resolver->pending_count; ++i)
+        pending[i] = resolver->pending[(resolver->pending_head + i) % resolver->job_size];
+    free(resolver->pending);
+    resolver->pending      = pending;
+    resolver->pending_head = 0;
+    resolver->job_size     = size;
+    return true;
+}
+
+static void ssq_resolver_submit(SSQ_RESOLVER *resolver, size_t index) {
+    SSQ_RESOLVER_ENTRY *entry = &resolver->entries[index];
+    ssq_mutex_lock(&resolver->mutex);
+    if (ssq_resolver_reserve_jobs(resolver, resolver->in_flight + 1)) {
+        SSQ_RESOLVER_JOB *job = &resolver->pending[(resolver->pending_head + resolver->pending_count) % resolver->job_size];
+        job->entry     = index;
+        job->hostname  = entry->hostname;
+        job->addr_list = NULL;
+        job->gai_ecode = 0;
+        ssq_helper_port_to_str(entry->port, job->port_str);
+        ++resolver->pending_count;
+        ++resolver->in_flight;
+        entry->in_flight = true;
+        ssq_cond_signal(&resolver->work_cond);
+    } else {
+        ssq_error_set_from_errno(&resolver->error);
+    }
+    ssq_mutex_unlock(&resolver->mutex);
+}
+
+static bool ssq_resolver_same_addr(const struct addrinfo *a, const struct addrinfo *b) {
+    return a != NULL && b != NULL && a->ai_addrlen == b->ai_addrlen && memcmp(a->ai_addr, b->ai_addr, a->ai_addrlen) == 0;
+}
+
+static void ssq_resolver_hand_over(SSQ_SERVER *server, struct addrinfo *addr_list) {
+    if (server->addr_list != NULL && !ssq_resolver_same_addr(server->addr_list, addr_list)) {
+        // The server moved: its connected socket and what was learnt about it no longer apply.
+        bool reuse_socket = server->reuse_socket;
+        ssq_server_reuse_socket(server, false);
+        ssq_server_reuse_socket(server, reuse_socket);
+        ssq_server_forget(server);
+    }
+    server->addr_list = addr_list;
+    if (ssq_server_ecode(server) == SSQE_GAI)
+        ssq_server_eclr(server);
+}
+
+static void ssq_resolver_apply(SSQ_RESOLVER *resolver, const SSQ_RESOLVER_JOB *job, uint64_t now) {
+    SSQ_RESOLVER_ENTRY *entry = &resolver->entries[job->entry];
+    entry->in_flight = false;
+    entry->gai_ecode = job->gai_ecode;
+    if (job->gai_ecode == 0) {
+        struct addrinfo *old_addr_list = entry->addr_list;
+        entry->addr_list = job->addr_list;
+        entry->expires   = now + resolver->ttl;
+        for (size_t i = 0; i < entry->server_count; ++i)
+            ssq_resolver_hand_over(entry->servers[i], entry->addr_list);
+        // No query on the servers runs meanwhile (see resolver.h): nothing still points to it.
+        if (old_addr_list != NULL)
+            freeaddrinfo(old_addr_list);
+        return;
+    }
+    // A failure never takes a previous answer away: it is kept until a resolution succeeds again.
+    entry->expires = now + resolver->negative_ttl;
+    if (entry->addr_list == NULL)
+        for (size_t i = 0; i < entry->server_count; ++i)
+            ssq_error_set(&entry->servers[i]->last_error, SSQE_GAI, gai_strerror(job->gai_ecode));
+}
+
+size_t ssq_resolver_update(SSQ_RESOLVER *resolver) {
+    uint64_t now = ssq_helper_clock_millis();
+    ssq_mutex_lock(&resolver->mutex);
+    size_t done_count = resolver->done_count;
+    for (size_t i = 0; i < done_count; ++i)
+        ssq_resolver_apply(resolver, &resolver->done[i], now);
+    resolver->done_count = 0;
+    resolver->in_flight -= done_count;
+    ssq_mutex_unlock(&resolver->mutex);
+    for (size_t i = 0; i < resolver->entry_count; ++i) {
+        const SSQ_RESOLVER_ENTRY *entry = &resolver->entries[i];
+        if (!entry->in_flight && entry->expires <= now)
+            ssq_resolver_submit(resolver, i);
+    }
+    return done_count;
+}
+
+size_t ssq_resolver_wait(SSQ_RESOLVER *resolver) {
+    ssq_mutex_lock(&resolver->mutex);
+    while (resolver->done_count < resolver->in_flight)
+        ssq_cond_wait(&resolver->done_cond, &resolver->mutex);
+    ssq_mutex_unlock(&resolver->mutex);
+    return ssq_resolver_update(resolver);
+}
+
+SSQ_SERVER *ssq_resolver_add(SSQ_RESOLVER *resolver, const char hostname[], uint16_t port) {
+    SSQ_RESOLVER_ENTRY *entry = ssq_resolver_entry(resolver, hostname, port);
+    if (entry == NULL)
+        return NULL;
+    if (entry->server_count == entry->server_size) {
+        size_t size = (entry->server_size > 0) ? entry->server_size * 2 : 1;
+        SSQ_SERVER **servers = realloc(entry->servers, size * sizeof (*servers));
+        if (servers == NULL) {
+            ssq_error_set_from_errno(&resolver->error);
+            return NULL;
+        }
+        entry->servers     = servers;
+        entry->server_size = size;
+    }
+    SSQ_SERVER *server = malloc(sizeof (*server));
+    if (server == NULL) {
+        ssq_error_set_from_errno(&resolver->error);
+        return NULL;
+    }
+    ssq_server_init(server);
+    server->addr_list = entry->addr_list;
+    if (entry->addr_list == NULL && entry->gai_ecode != 0)
+        ssq_error_set(&server->last_error, SSQE_GAI, gai_strerror(entry->gai_ecode));
+    entry->servers[entry->server_count++] = server;
+    if (!entry->in_flight && entry->addr_list == NULL && entry->gai_ecode == 0)
+        ssq_resolver_submit(resolver, (size_t)(entry - resolver->entries));
+    return server;
+}
+
+bool           ssq_resolver_eok(const SSQ_RESOLVER *resolver)   { return ssq_resolver_ecode(resolver) == SSQE_OK; }
+SSQ_ERROR_CODE ssq_resolver_ecode(const SSQ_RESOLVER *resolver) { return resolver->error.code; }
+const char    *ssq_resolver_emsg(const SSQ_RESOLVER *resolver)  { return resolver->error.message; }
+
+void ssq_resolver_eclr(SSQ_RESOLVER *resolver) {
+    resolver->error.code = SSQE_OK;
+    resolver->error.message[0] = '\0';
+}
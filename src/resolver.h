@@ -0,0 +1,76 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssq/resolver.h"
+
+#include "error.h"
+#include "helper.h"
+#include "server.h"
+#include "thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct ssq_resolver_host {
+    char *name; /* Hostname listed in the hosts file. */
+    char *addr; /* Numeric address it maps to.        */
+} SSQ_RESOLVER_HOST;
+
+typedef struct ssq_resolver_entry {
+    char            *hostname;     /* The hostname to resolve.                       */
+    uint16_t         port;         /* The port the servers listen on.                */
+    struct addrinfo *addr_list;    /* Last successful answer, shared by the servers. */
+    int              gai_ecode;    /* Outcome of the last resolution.                */
+    bool             in_flight;    /* Whether a resolution is in progress.           */
+    uint64_t         expires;      /* When the entry is due for resolution again.    */
+    SSQ_SERVER     **servers;      /* Servers using this hostname and port.          */
+    size_t           server_count; /* Number of servers in `servers'.                */
+    size_t           server_size;  /* Number of entries allocated for `servers'.     */
+} SSQ_RESOLVER_ENTRY;
+
+typedef struct ssq_resolver_job {
+    size_t           entry;                   /* Index of the entry being resolved.                 */
+    const char      *hostname;                /* The entry's hostname (entries may move meanwhile). */
+    char             port_str[SSQ_PORT_SIZE]; /* The entry's port.                                  */
+    struct addrinfo *addr_list;               /* Result of the resolution.                          */
+    int              gai_ecode;               /* Outcome of the resolution.                         */
+} SSQ_RESOLVER_JOB;
+
+struct ssq_resolver {
+    SSQ_RESOLVER_ENTRY *entries;      /* Every hostname and port ever added.               */
+    size_t              entry_count;  /* Number of entries in `entries'.                   */
+    size_t              entry_size;   /* Number of entries allocated for `entries'.        */
+    size_t             *table;        /* Open-addressing index of the entries (index + 1). */
+    size_t              table_mask;   /* Size of `table' minus one.                        */
+    SSQ_RESOLVER_HOST  *hosts;        /* Entries of the hosts file, if any.                */
+    size_t              host_count;   /* Number of entries in `hosts'.                     */
+    bool                use_hosts;    /* Whether to resolve from the hosts file.           */
+    uint64_t            ttl;          /* How long answers are cached, in milliseconds.     */
+    uint64_t            negative_ttl; /* How long failures are cached, in milliseconds.    */
+    SSQ_ERROR           error;        /* The last error of a resolver operation.           */
+
+    SSQ_MUTEX           mutex;         /* Protects every member below.                  */
+    SSQ_COND            work_cond;     /* Signaled when a job is queued or on shutdown. */
+    SSQ_COND            done_cond;     /* Signaled when a job completes.                */
+    SSQ_RESOLVER_JOB   *pending;       /* Ring of jobs waiting for a thread.            */
+    size_t              pending_head;  /* Index of the oldest job in `pending'.         */
+    size_t              pending_count; /* Number of jobs in `pending'.                  */
+    SSQ_RESOLVER_JOB   *done;          /* Completed jobs not handed over yet.           */
+    size_t              done_count;    /* Number of jobs in `done'.                     */
+    size_t              job_size;      /* Number of jobs allocated for both arrays.     */
+    size_t              in_flight;     /* Number of jobs queued, running or done.       */
+    bool                stopping;      /* Whether the threads must exit.                */
+    SSQ_THREAD         *threads;       /* The resolving threads.                        */
+    size_t              thread_count;  /* Number of threads started.                    */
+};
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !RESOLVER_H */
@@ -1,5 +1,7 @@
 #include "response.h"
 
+#include <string.h>
+
 #include "packet.h"
 #include "stream.h"
 
@@ -23,3 +25,84 @@ bool ssq_response_is_truncated(const uint8_t response[], size_t response_len) {
     int32_t first_bytes = ssq_stream_read_int32_t(&stream);
     return first_bytes == SSQ_PACKET_HEADER_SINGLE;
 }
+
+uint8_t ssq_response_get_header(const uint8_t response[], size_t response_len) {
+    SSQ_STREAM stream;
+    ssq_stream_wrap(&stream, response, response_len);
+    if (ssq_response_is_truncated(response, response_len))
+        ssq_stream_advance(&stream, SSQ_PACKET_HEADER_LEN);
+    return ssq_stream_read_uint8_t(&stream);
+}
+
+/* Fingerprints follow XXH64 (with a seed of 0), which hashes several bytes per cycle. */
+#define SSQ_FINGERPRINT_PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define SSQ_FINGERPRINT_PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define SSQ_FINGERPRINT_PRIME3 UINT64_C(0x165667B19E3779F9)
+#define SSQ_FINGERPRINT_PRIME4 UINT64_C(0x85EBCA77C2B2AE63)
+#define SSQ_FINGERPRINT_PRIME5 UINT64_C(0x27D4EB2F165667C5)
+
+static inline uint64_t ssq_fingerprint_rotl(uint64_t x, unsigned r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t ssq_fingerprint_read64(const uint8_t bytes[]) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof (word));
+    return word;
+}
+
+static inline uint32_t ssq_fingerprint_read32(const uint8_t bytes[]) {
+    uint32_t word;
+    memcpy(&word, bytes, sizeof (word));
+    return word;
+}
+
+static inline uint64_t ssq_fingerprint_round(uint64_t acc, uint64_t word) {
+    return ssq_fingerprint_rotl(acc + word * SSQ_FINGERPRINT_PRIME2, 31) * SSQ_FINGERPRINT_PRIME1;
+}
+
+static inline uint64_t ssq_fingerprint_merge(uint64_t hash, uint64_t acc) {
+    return (hash ^ ssq_fingerprint_round(0, acc)) * SSQ_FINGERPRINT_PRIME1 + SSQ_FINGERPRINT_PRIME4;
+}
+
+uint64_t ssq_response_fingerprint(const uint8_t response[], size_t response_len) {
+    const uint8_t *p   = response;
+    const uint8_t *end = response + response_len;
+    uint64_t hash;
+    if (response_len >= 32) {
+        // Four independent lanes keep the multipliers busy.
+        uint64_t acc1 = SSQ_FINGERPRINT_PRIME1 + SSQ_FINGERPRINT_PRIME2;
+        uint64_t acc2 = SSQ_FINGERPRINT_PRIME2;
+        uint64_t acc3 = 0;
+        uint64_t acc4 = (uint64_t)0 - SSQ_FINGERPRINT_PRIME1;
+        for (; end - p >= 32; p += 32) {
+            acc1 = ssq_fingerprint_round(acc1, ssq_fingerprint_read64(p));
+            acc2 = ssq_fingerprint_round(acc2, ssq_fingerprint_read64(p + 8));
+            acc3 = ssq_fingerprint_round(acc3, ssq_fingerprint_read64(p + 16));
+            acc4 = ssq_fingerprint_round(acc4, ssq_fingerprint_read64(p + 24));
+        }
+        hash = ssq_fingerprint_rotl(acc1, 1) + ssq_fingerprint_rotl(acc2, 7) + ssq_fingerprint_rotl(acc3, 12) + ssq_fingerprint_rotl(acc4, 18);
+        hash = ssq_fingerprint_merge(hash, acc1);
+        hash = ssq_fingerprint_merge(hash, acc2);
+        hash = ssq_fingerprint_merge(hash, acc3);
+        hash = ssq_fingerprint_merge(hash, acc4);
+    } else {
+        hash = SSQ_FINGERPRINT_PRIME5;
+    }
+    hash += (uint64_t)response_len;
+    for (; end - p >= 8; p += 8)
+        hash = ssq_fingerprint_rotl(hash ^ ssq_fingerprint_round(0, ssq_fingerprint_read64(p)), 27) * SSQ_FINGERPRINT_PRIME1 + SSQ_FINGERPRINT_PRIME4;
+    if (end - p >= 4) {
+        hash = ssq_fingerprint_rotl(hash ^ ssq_fingerprint_read32(p) * SSQ_FINGERPRINT_PRIME1, 23) * SSQ_FINGERPRINT_PRIME2 + SSQ_FINGERPRINT_PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        hash = ssq_fingerprint_rotl(hash ^ *p * SSQ_FINGERPRINT_PRIME5, 11) * SSQ_FINGERPRINT_PRIME1;
+    hash ^= hash >> 33;
+    hash *= SSQ_FINGERPRINT_PRIME2;
+    hash ^= hash >> 29;
+    hash *= SSQ_FINGERPRINT_PRIME3;
+    hash ^= hash >> 32;
+    // 0 stands for no fingerprint at all.
+    return (hash != 0) ? hash : 1;
+}
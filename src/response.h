@@ -5,7 +5,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define S2A_HEADER_CHALL 0x41
+#define S2A_HEADER_CHALL  0x41
+#define S2A_HEADER_INFO   0x49
+#define S2A_HEADER_PLAYER 0x44
+#define S2A_HEADER_RULES  0x45
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +17,10 @@ extern "C" {
 bool    ssq_response_has_challenge(const uint8_t *response, size_t response_len);
 int32_t ssq_response_get_challenge(const uint8_t *response, size_t response_len);
 bool    ssq_response_is_truncated(const uint8_t *response, size_t response_len);
+uint8_t ssq_response_get_header(const uint8_t *response, size_t response_len);
+
+/* Fast 64-bit hash of the bytes of a response, never 0. */
+uint64_t ssq_response_fingerprint(const uint8_t *response, size_t response_len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,119 @@
+#include "ssq/result.h"
+
+#include <stdlib.h>
+
+#include "a2s.h"
+#include "async.h"
+#include "metrics.h"
+#include "query.h"
+#include "server.h"
+#include "thread.h"
+#include "trace.h"
+
+struct ssq_result {
+    A2S_QUERY_KIND    kind;     /* The kind of query the result comes from.          */
+    uint8_t          *response; /* The response the strings of the result point to. */
+    uint16_t          count;    /* Number of players or rules.                       */
+    volatile uint64_t refs;     /* Number of references to the handle.               */
+};
+
+/* The result itself is laid out right after the handle, suitably aligned. */
+#define SSQ_RESULT_PREFIX ((sizeof (SSQ_RESULT) + 15) & ~(size_t)15)
+
+static inline void *ssq_result_value(const SSQ_RESULT *result) {
+    return (uint8_t *)result + SSQ_RESULT_PREFIX;
+}
+
+/* Takes ownership of `response', received from `server'. */
+static SSQ_RESULT *ssq_result_from_response(const SSQ_SERVER *server, A2S_QUERY_KIND kind, uint8_t response[], size_t response_len, SSQ_ERROR *error) {
+    SSQ_RESULT *result = NULL;
+    uint8_t player_count = 0;
+    uint16_t rule_count = 0;
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    switch (kind) {
+        case A2S_QUERY_INFO:
+            result = ssq_info_deserialize_borrowed(response, response_len, SSQ_RESULT_PREFIX, error);
+            break;
+        case A2S_QUERY_PLAYER:
+            result = ssq_player_deserialize_borrowed(response, response_len, SSQ_RESULT_PREFIX, &player_count, error);
+            break;
+        case A2S_QUERY_RULES:
+            result = ssq_rules_deserialize_borrowed(response, response_len, SSQ_RESULT_PREFIX, &rule_count, error);
+            break;
+    }
+    SSQ_TRACE(server, SSQ_TRACE_DECODE_END, 0);
+    if (result == NULL) {
+        ssq_metrics_failed(server, error);
+        free(response);
+        return NULL;
+    }
+    result->kind     = kind;
+    result->response = response;
+    result->count    = (kind == A2S_QUERY_PLAYER) ? player_count : rule_count;
+    result->refs     = 1;
+    return result;
+}
+
+SSQ_RESULT *ssq_result_new(SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    size_t response_len;
+    uint8_t *response = ssq_query_a2s(server, kind, &response_len);
+    if (response == NULL)
+        return NULL;
+    return ssq_result_from_response(server, kind, response, response_len, &server->last_error);
+}
+
+SSQ_RESULT *ssq_result_if_changed(SSQ_SERVER *server, A2S_QUERY_KIND kind, bool *unchanged) {
+    size_t response_len;
+    uint64_t fingerprint;
+    uint8_t *response = ssq_query_a2s_changed(server, kind, &response_len, &fingerprint, unchanged);
+    if (response == NULL)
+        return NULL;
+    SSQ_RESULT *result = ssq_result_from_response(server, kind, response, response_len, &server->last_error);
+    if (result != NULL)
+        ssq_server_learn_fingerprint(server, kind, fingerprint);
+    return result;
+}
+
+SSQ_RESULT *ssq_result_from_async(SSQ_ASYNC *async) {
+    if (async->status != SSQ_ASYNC_DONE || async->response == NULL)
+        return NULL;
+    uint8_t *response = async->response;
+    size_t response_len = async->response_len;
+    async->response     = NULL;
+    async->response_len = 0;
+    return ssq_result_from_response(async->server, async->kind, response, response_len, &async->error);
+}
+
+SSQ_RESULT *ssq_result_ref(SSQ_RESULT *result) {
+    ssq_atomic_add(&result->refs, 1);
+    return result;
+}
+
+void ssq_result_free(SSQ_RESULT *result) {
+    if (result == NULL || ssq_atomic_add(&result->refs, (uint64_t)-1) != 0)
+        return;
+    free(result->response);
+    free(result);
+}
+
+A2S_QUERY_KIND ssq_result_kind(const SSQ_RESULT *result) {
+    return result->kind;
+}
+
+const A2S_INFO *ssq_result_info(const SSQ_RESULT *result) {
+    return (result->kind == A2S_QUERY_INFO) ? ssq_result_value(result) : NULL;
+}
+
+const A2S_PLAYER *ssq_result_players(const SSQ_RESULT *result, uint8_t *player_count) {
+    if (result->kind != A2S_QUERY_PLAYER)
+        return NULL;
+    *player_count = (uint8_t)result->count;
+    return ssq_result_value(result);
+}
+
+const A2S_RULES *ssq_result_rules(const SSQ_RESULT *result, uint16_t *rule_count) {
+    if (result->kind != A2S_QUERY_RULES)
+        return NULL;
+    *rule_count = result->count;
+    return ssq_result_value(result);
+}
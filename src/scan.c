@@ -0,0 +1,156 @@
+#include "scan.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define SSQ_SCAN_SSE2
+# include <emmintrin.h>
+#endif /* __SSE2__ || _M_X64 || _M_IX86_FP >= 2 */
+
+/* AVX2 is only compiled in alongside SSE2, and only used if the CPU turns out to support it. */
+#if defined(SSQ_SCAN_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+# define SSQ_SCAN_AVX2
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define SSQ_SCAN_TARGET_AVX2
+# else /* !_MSC_VER */
+#  define SSQ_SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+# endif /* _MSC_VER */
+#endif /* SSQ_SCAN_SSE2 && (__GNUC__ || _MSC_VER) */
+
+#if !defined(SSQ_SCAN_SSE2) && (defined(__ARM_NEON) || defined(_M_ARM64))
+# define SSQ_SCAN_NEON
+# include <arm_neon.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif /* _MSC_VER */
+#endif /* !SSQ_SCAN_SSE2 && (__ARM_NEON || _M_ARM64) */
+
+static inline size_t ssq_scan_store(uint32_t offsets[], size_t cap, size_t count, size_t offset) {
+    if (count < cap)
+        offsets[count] = (uint32_t)offset;
+    return count + 1;
+}
+
+/* Portable path, also used for the bytes left over by the vector paths. */
+static size_t ssq_scan_nuls_scalar(const uint8_t data[], size_t len, size_t pos, uint32_t offsets[], size_t cap, size_t count) {
+    while (pos < len) {
+        const uint8_t *nul = memchr(data + pos, '\0', len - pos);
+        if (nul == NULL)
+            break;
+        pos = (size_t)(nul - data);
+        count = ssq_scan_store(offsets, cap, count, pos++);
+    }
+    return count;
+}
+
+#if defined(SSQ_SCAN_SSE2)
+static inline unsigned ssq_scan_ctz(uint32_t mask) {
+# ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+# else /* !_MSC_VER */
+    return (unsigned)__builtin_ctz(mask);
+# endif /* _MSC_VER */
+}
+
+/* Stores the offsets of the bits set in the comparison mask of the chunk at `pos'. */
+static inline size_t ssq_scan_store_mask(uint32_t offsets[], size_t cap, size_t count, size_t pos, uint32_t mask) {
+    for (; mask != 0; mask &= mask - 1)
+        count = ssq_scan_store(offsets, cap, count, pos + ssq_scan_ctz(mask));
+    return count;
+}
+
+static size_t ssq_scan_nuls_sse2(const uint8_t data[], size_t len, uint32_t offsets[], size_t cap) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t count = 0;
+    size_t pos = 0;
+    for (; len - pos >= sizeof (__m128i); pos += sizeof (__m128i)) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + pos));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+        count = ssq_scan_store_mask(offsets, cap, count, pos, mask);
+    }
+    return ssq_scan_nuls_scalar(data, len, pos, offsets, cap, count);
+}
+#endif /* SSQ_SCAN_SSE2 */
+
+#if defined(SSQ_SCAN_AVX2)
+static bool ssq_scan_has_avx2(void) {
+# ifdef _MSC_VER
+    static volatile int has_avx2 = -1;
+    if (has_avx2 < 0) {
+        int regs[4];
+        __cpuid(regs, 1);
+        bool avx = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)); // OSXSAVE and AVX.
+        bool avx2 = false;
+        if (avx && (_xgetbv(0) & 0x6) == 0x6) { // The OS saves the YMM registers.
+            __cpuidex(regs, 7, 0);
+            avx2 = (regs[1] & (1 << 5));
+        }
+        has_avx2 = avx2;
+    }
+    return has_avx2;
+# else /* !_MSC_VER */
+    return __builtin_cpu_supports("avx2");
+# endif /* _MSC_VER */
+}
+
+SSQ_SCAN_TARGET_AVX2
+static size_t ssq_scan_nuls_avx2(const uint8_t data[], size_t len, uint32_t offsets[], size_t cap) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t count = 0;
+    size_t pos = 0;
+    for (; len - pos >= sizeof (__m256i); pos += sizeof (__m256i)) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + pos));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, zero));
+        count = ssq_scan_store_mask(offsets, cap, count, pos, mask);
+    }
+    return ssq_scan_nuls_scalar(data, len, pos, offsets, cap, count);
+}
+#endif /* SSQ_SCAN_AVX2 */
+
+#if defined(SSQ_SCAN_NEON)
+static inline unsigned ssq_scan_ctz64(uint64_t mask) {
+# ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (unsigned)index;
+# else /* !_MSC_VER */
+    return (unsigned)__builtin_ctzll(mask);
+# endif /* _MSC_VER */
+}
+
+static size_t ssq_scan_nuls_neon(const uint8_t data[], size_t len, uint32_t offsets[], size_t cap) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    size_t count = 0;
+    size_t pos = 0;
+    for (; len - pos >= sizeof (uint8x16_t); pos += sizeof (uint8x16_t)) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(data + pos), zero);
+        // NEON has no movemask: narrowing each 16-bit lane by 4 leaves a nibble per byte instead.
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        while (mask != 0) {
+            unsigned bit = ssq_scan_ctz64(mask);
+            count = ssq_scan_store(offsets, cap, count, pos + bit / 4);
+            mask &= ~((uint64_t)0xF << bit);
+        }
+    }
+    return ssq_scan_nuls_scalar(data, len, pos, offsets, cap, count);
+}
+#endif /* SSQ_SCAN_NEON */
+
+size_t ssq_scan_nuls(const uint8_t data[], size_t len, uint32_t offsets[], size_t cap) {
+#if defined(SSQ_SCAN_AVX2)
+    if (ssq_scan_has_avx2())
+        return ssq_scan_nuls_avx2(data, len, offsets, cap);
+#endif /* SSQ_SCAN_AVX2 */
+#if defined(SSQ_SCAN_SSE2)
+    return ssq_scan_nuls_sse2(data, len, offsets, cap);
+#elif defined(SSQ_SCAN_NEON)
+    return ssq_scan_nuls_neon(data, len, offsets, cap);
+#else /* !SSQ_SCAN_SSE2 && !SSQ_SCAN_NEON */
+    return ssq_scan_nuls_scalar(data, len, 0, offsets, cap, 0);
+#endif /* SSQ_SCAN_SSE2 */
+}
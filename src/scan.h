@@ -0,0 +1,22 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Finds every NUL byte of `data' in a single sweep, with the widest vector instructions the CPU
+ * supports. Stores the offsets of the first `cap' ones in `offsets', in increasing order, and
+ * returns how many there are in total.
+ */
+size_t ssq_scan_nuls(const uint8_t *data, size_t len, uint32_t *offsets, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SCAN_H */
@@ -4,12 +4,32 @@
 #include <string.h>
 
 #include "helper.h"
+#include "metrics.h"
 #include "server.h"
 
 static void prepare_udp_hints(struct addrinfo *hints) {
     memset(hints, 0, sizeof (*hints));
-    hints->ai_family   = AF_INET;
+    hints->ai_family   = AF_UNSPEC;
     hints->ai_socktype = SOCK_DGRAM;
+    hints->ai_flags    = AI_ADDRCONFIG;
+}
+
+/* Moves the IPv4 addresses first: game servers listening on IPv6 too are still the exception. */
+static void prefer_ipv4(struct addrinfo **addr_list) {
+    struct addrinfo *ipv4 = NULL, **ipv4_tail = &ipv4;
+    struct addrinfo *other = NULL, **other_tail = &other;
+    for (struct addrinfo *addr = *addr_list; addr != NULL; addr = addr->ai_next) {
+        if (addr->ai_family == AF_INET) {
+            *ipv4_tail = addr;
+            ipv4_tail  = &addr->ai_next;
+        } else {
+            *other_tail = addr;
+            other_tail  = &addr->ai_next;
+        }
+    }
+    *other_tail = NULL;
+    *ipv4_tail  = other;
+    *addr_list  = ipv4;
 }
 
 static int resolve_address(struct addrinfo **dest, const char hostname[], uint16_t port) {
@@ -17,36 +37,96 @@ static int resolve_address(struct addrinfo **dest, const char hostname[], uint16
     ssq_helper_port_to_str(port, port_str);
     struct addrinfo hints;
     prepare_udp_hints(&hints);
-    return getaddrinfo(hostname, port_str, &hints, dest);
+    int gai_ecode = getaddrinfo(hostname, port_str, &hints, dest);
+    if (gai_ecode == 0)
+        prefer_ipv4(dest);
+    return gai_ecode;
+}
+
+void ssq_server_init(SSQ_SERVER *server) {
+    server->addr_list    = NULL;
+    server->metrics      = NULL;
+    server->trace        = NULL;
+    server->trace_data   = NULL;
+    server->reuse_socket = false;
+    server->retransmits  = SSQ_RETRANSMIT_DEFAULT;
+    server->sockfd       = INVALID_SOCKET;
+    ssq_server_forget(server);
+    ssq_server_eclr(server);
+    ssq_server_timeout(server, SSQ_TIMEOUT_RECV, SSQ_TIMEOUT_RECV_DEFAULT);
+    ssq_server_timeout(server, SSQ_TIMEOUT_SEND, SSQ_TIMEOUT_SEND_DEFAULT);
+}
+
+bool ssq_server_init_numeric(SSQ_SERVER *server, const struct sockaddr *addr, size_t addr_len, SSQ_ERROR *error) {
+    ssq_server_init(server);
+    size_t expected_len = 0;
+    if (addr->sa_family == AF_INET)
+        expected_len = sizeof (struct sockaddr_in);
+    else if (addr->sa_family == AF_INET6)
+        expected_len = sizeof (struct sockaddr_in6);
+    if (expected_len == 0 || addr_len < expected_len) {
+        ssq_error_set(error, SSQE_INVALID_ARGUMENT, "Expected an IPv4 or IPv6 socket address");
+        return false;
+    }
+    memset(&server->addr, 0, sizeof (server->addr));
+    memcpy(&server->addr_storage, addr, expected_len);
+    server->addr.ai_family   = addr->sa_family;
+    server->addr.ai_socktype = SOCK_DGRAM;
+    server->addr.ai_protocol = IPPROTO_UDP;
+    server->addr.ai_addrlen  = (socklen_t)expected_len;
+    server->addr.ai_addr     = (struct sockaddr *)&server->addr_storage;
+    server->addr_list        = &server->addr;
+    return true;
+}
+
+void ssq_server_fini(SSQ_SERVER *server) {
+    ssq_server_reuse_socket(server, false);
+    ssq_server_metrics_enable(server, false);
+    if (server->addr_list != NULL && server->addr_list != &server->addr)
+        freeaddrinfo(server->addr_list);
+    server->addr_list = NULL;
 }
 
 SSQ_SERVER *ssq_server_new(const char hostname[], uint16_t port) {
     SSQ_SERVER *server = malloc(sizeof (*server));
     if (server == NULL)
         return NULL;
-    server->addr_list = NULL;
-    ssq_server_eclr(server);
-    ssq_server_timeout(server, SSQ_TIMEOUT_RECV, SSQ_TIMEOUT_RECV_DEFAULT);
-    ssq_server_timeout(server, SSQ_TIMEOUT_SEND, SSQ_TIMEOUT_SEND_DEFAULT);
+    ssq_server_init(server);
     int gai_ecode = resolve_address(&server->addr_list, hostname, port);
     if (gai_ecode != 0)
         ssq_error_set(&server->last_error, SSQE_GAI, gai_strerror(gai_ecode));
     return server;
 }
 
+SSQ_SERVER *ssq_server_new_addr(const struct sockaddr *addr, size_t addr_len) {
+    SSQ_SERVER *server = malloc(sizeof (*server));
+    if (server != NULL)
+        ssq_server_init_numeric(server, addr, addr_len, &server->last_error);
+    return server;
+}
+
 void ssq_server_free(SSQ_SERVER *server) {
     if (server == NULL)
         return;
-    freeaddrinfo(server->addr_list);
+    ssq_server_fini(server);
     free(server);
 }
 
+static void ssq_server_close_socket(SSQ_SERVER *server) {
+    if (server->sockfd != INVALID_SOCKET) {
+        closesocket(server->sockfd);
+        server->sockfd = INVALID_SOCKET;
+    }
+}
+
 #ifdef _WIN32
 void ssq_server_timeout(SSQ_SERVER *server, SSQ_TIMEOUT_SELECTOR which, DWORD value_in_ms) {
     if (which & SSQ_TIMEOUT_RECV)
         server->timeout.recv = value_in_ms;
     if (which & SSQ_TIMEOUT_SEND)
         server->timeout.send = value_in_ms;
+    // The kept-alive socket is reopened with the new timeouts on the next query.
+    ssq_server_close_socket(server);
 }
 #else /* !_WIN32 */
 void ssq_server_timeout(SSQ_SERVER *server, SSQ_TIMEOUT_SELECTOR which, time_t value_in_ms) {
@@ -54,9 +134,192 @@ void ssq_server_timeout(SSQ_SERVER *server, SSQ_TIMEOUT_SELECTOR which, time_t v
         ssq_helper_millis_to_timeval(value_in_ms, &server->timeout.recv);
     if (which & SSQ_TIMEOUT_SEND)
         ssq_helper_millis_to_timeval(value_in_ms, &server->timeout.send);
+    // The kept-alive socket is reopened with the new timeouts on the next query.
+    ssq_server_close_socket(server);
 }
 #endif /* _WIN32 */
 
+uint64_t ssq_server_recv_timeout(const SSQ_SERVER *server) {
+#ifdef _WIN32
+    return server->timeout.recv;
+#else /* !_WIN32 */
+    return ssq_helper_timeval_to_millis(&server->timeout.recv);
+#endif /* _WIN32 */
+}
+
+void ssq_server_retransmit(SSQ_SERVER *server, unsigned max_retransmits) {
+    server->retransmits = max_retransmits;
+}
+
+void ssq_server_reuse_socket(SSQ_SERVER *server, bool reuse) {
+    server->reuse_socket = reuse;
+    if (!reuse)
+        ssq_server_close_socket(server);
+}
+
+void ssq_server_forget(SSQ_SERVER *server) {
+    ssq_atomic_store(&server->cache, 0);
+    ssq_atomic_store(&server->rtt, 0);
+    ssq_atomic_store(&server->rules, 0);
+    for (size_t i = 0; i < SSQ_SERVER_KIND_COUNT; ++i)
+        ssq_atomic_store(&server->fingerprints[i], 0);
+}
+
+static inline uint8_t ssq_server_behavior(uint64_t cache) {
+    return (uint8_t)(cache >> SSQ_SERVER_CACHE_BEHAVIOR_SHIFT);
+}
+
+const int32_t *ssq_server_chall(const SSQ_SERVER *server, A2S_QUERY_KIND kind, int32_t *chall) {
+    uint64_t cache = ssq_atomic_load(&server->cache);
+    if (!(cache & SSQ_SERVER_CACHE_HAS_CHALL))
+        return NULL;
+    if (kind == A2S_QUERY_INFO && !(ssq_server_behavior(cache) & SSQ_SERVER_INFO_CHALL))
+        return NULL;
+    *chall = (int32_t)(uint32_t)(cache & SSQ_SERVER_CACHE_CHALL);
+    return chall;
+}
+
+bool ssq_server_challenges(const SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    return kind != A2S_QUERY_INFO || (ssq_server_behavior(ssq_atomic_load(&server->cache)) & SSQ_SERVER_INFO_CHALL);
+}
+
+bool ssq_server_answers(const SSQ_SERVER *server, A2S_QUERY_KIND kind, SSQ_ERROR *error) {
+    if (kind != A2S_QUERY_RULES)
+        return true;
+    uint64_t until = SSQ_SERVER_RULES_UNTIL(ssq_atomic_load(&server->rules));
+    if (until != 0 && ssq_helper_clock_millis() < until) {
+        ssq_error_set(error, SSQE_UNSUPPORTED, "Server does not answer A2S_RULES queries");
+        return false;
+    }
+    return true;
+}
+
+/* Sets the behavior flags and, if `chall' is not NULL, the challenge, without losing concurrent updates. */
+static void ssq_server_learn(SSQ_SERVER *server, const int32_t *chall, uint8_t behavior) {
+    uint64_t cache, learnt;
+    do {
+        cache  = ssq_atomic_load(&server->cache);
+        learnt = cache | ((uint64_t)behavior << SSQ_SERVER_CACHE_BEHAVIOR_SHIFT);
+        if (chall != NULL)
+            learnt = (learnt & ~SSQ_SERVER_CACHE_CHALL) | SSQ_SERVER_CACHE_HAS_CHALL | (uint32_t)*chall;
+    } while (learnt != cache && !ssq_atomic_cas(&server->cache, cache, learnt));
+}
+
+void ssq_server_learn_chall(SSQ_SERVER *server, A2S_QUERY_KIND kind, int32_t chall) {
+    ssq_server_learn(server, &chall, (kind == A2S_QUERY_INFO) ? SSQ_SERVER_INFO_CHALL : 0);
+}
+
+/* The server is alive (it sent the challenge) but may ignore such queries. */
+void ssq_server_learn_timeout(SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    if (kind != A2S_QUERY_RULES)
+        return;
+    uint64_t rules, learnt;
+    do {
+        rules = ssq_atomic_load(&server->rules);
+        unsigned strikes = SSQ_SERVER_RULES_STRIKES(rules);
+        if (strikes < UINT8_MAX)
+            ++strikes;
+        uint64_t until = 0;
+        if (strikes >= SSQ_SERVER_NO_RULES_STRIKES) {
+            // Each failed probe doubles the wait.
+            uint64_t backoff = SSQ_SERVER_NO_RULES_BACKOFF;
+            for (unsigned i = SSQ_SERVER_NO_RULES_STRIKES; i < strikes && backoff < SSQ_SERVER_NO_RULES_BACKOFF_MAX; ++i)
+                backoff *= 2;
+            if (backoff > SSQ_SERVER_NO_RULES_BACKOFF_MAX)
+                backoff = SSQ_SERVER_NO_RULES_BACKOFF_MAX;
+            until = ssq_helper_clock_millis() + backoff;
+        }
+        learnt = (until << 8) | strikes;
+    } while (!ssq_atomic_cas(&server->rules, rules, learnt));
+}
+
+void ssq_server_learn_answer(SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    if (kind == A2S_QUERY_RULES && ssq_atomic_load(&server->rules) != 0)
+        ssq_atomic_store(&server->rules, 0);
+}
+
+/* Samples are at least a millisecond (the granularity of the clock) and at most a minute. */
+#define SSQ_SERVER_RTT_SAMPLE_MAX 60000
+
+void ssq_server_learn_rtt(SSQ_SERVER *server, uint64_t sample_in_ms) {
+    int64_t sample = (int64_t)((sample_in_ms < 1) ? 1 : (sample_in_ms > SSQ_SERVER_RTT_SAMPLE_MAX) ? SSQ_SERVER_RTT_SAMPLE_MAX : sample_in_ms);
+    uint64_t rtt, learnt;
+    do {
+        rtt = ssq_atomic_load(&server->rtt);
+        int64_t srtt   = SSQ_SERVER_RTT_SRTT(rtt);
+        int64_t rttvar = SSQ_SERVER_RTT_RTTVAR(rtt);
+        if (rtt == 0) {
+            srtt   = sample << 3;
+            rttvar = sample << 1;
+        } else {
+            // SRTT += (R - SRTT) / 8 and RTTVAR += (|R - SRTT| - RTTVAR) / 4, on the scaled values.
+            int64_t delta = sample - (srtt >> 3);
+            srtt   += delta;
+            rttvar += ((delta < 0) ? -delta : delta) - (rttvar >> 2);
+        }
+        learnt = ((uint64_t)rttvar << 32) | (uint64_t)srtt;
+    } while (learnt != rtt && !ssq_atomic_cas(&server->rtt, rtt, learnt));
+}
+
+uint64_t ssq_server_fingerprint(const SSQ_SERVER *server, A2S_QUERY_KIND kind) {
+    return ssq_atomic_load(&server->fingerprints[kind]);
+}
+
+void ssq_server_learn_fingerprint(SSQ_SERVER *server, A2S_QUERY_KIND kind, uint64_t fingerprint) {
+    ssq_atomic_store(&server->fingerprints[kind], fingerprint);
+}
+
+uint64_t ssq_server_rto(const SSQ_SERVER *server) {
+    uint64_t rtt = ssq_atomic_load(&server->rtt);
+    if (rtt == 0)
+        return SSQ_SERVER_RTO_INITIAL;
+    uint64_t rttvar = SSQ_SERVER_RTT_RTTVAR(rtt);
+    uint64_t rto = (SSQ_SERVER_RTT_SRTT(rtt) >> 3) + ((rttvar != 0) ? rttvar : 1);
+    return (rto < SSQ_SERVER_RTO_MIN) ? SSQ_SERVER_RTO_MIN : rto;
+}
+
+uint64_t ssq_server_gap(const SSQ_SERVER *server) {
+    // The packets of a response are sent back to back: only the jitter of the path separates them.
+    uint64_t rtt = ssq_atomic_load(&server->rtt);
+    uint64_t gap = (rtt != 0) ? SSQ_SERVER_RTT_RTTVAR(rtt) : SSQ_SERVER_RTO_MIN;
+    return (gap < SSQ_SERVER_GAP_MIN) ? SSQ_SERVER_GAP_MIN : (gap > SSQ_SERVER_RTO_MIN) ? SSQ_SERVER_RTO_MIN : gap;
+}
+
+void ssq_server_view(SSQ_SERVER *view, SSQ_SERVER *server, SSQ_SERVER_LEARNT *learnt) {
+    view->addr_list    = server->addr_list;
+    view->timeout      = server->timeout;
+    view->reuse_socket = false;
+    view->retransmits  = server->retransmits;
+    view->metrics      = server->metrics;
+    view->trace        = server->trace;
+    view->trace_data   = server->trace_data;
+    view->sockfd       = INVALID_SOCKET;
+    view->cache        = ssq_atomic_load(&server->cache);
+    view->rtt          = ssq_atomic_load(&server->rtt);
+    view->rules        = ssq_atomic_load(&server->rules);
+    // Fingerprints belong to whoever decoded the responses: the callers of a view bring their own.
+    for (size_t i = 0; i < SSQ_SERVER_KIND_COUNT; ++i)
+        view->fingerprints[i] = 0;
+    ssq_server_eclr(view);
+    learnt->cache = view->cache;
+    learnt->rtt   = view->rtt;
+    learnt->rules = view->rules;
+}
+
+void ssq_server_publish(SSQ_SERVER *server, const SSQ_SERVER *view, const SSQ_SERVER_LEARNT *learnt) {
+    // The estimates of the last call to take a sample win: they only smooth samples anyway.
+    if (view->rtt != learnt->rtt)
+        ssq_atomic_store(&server->rtt, view->rtt);
+    if (view->rules != learnt->rules)
+        ssq_atomic_store(&server->rules, view->rules);
+    if (view->cache == learnt->cache)
+        return; // Nothing new was learnt during the call.
+    const uint64_t chall_bits = SSQ_SERVER_CACHE_CHALL | SSQ_SERVER_CACHE_HAS_CHALL;
+    int32_t chall = (int32_t)(uint32_t)(view->cache & SSQ_SERVER_CACHE_CHALL);
+    bool new_chall = (view->cache & chall_bits) != (learnt->cache & chall_bits);
+    ssq_server_learn(server, new_chall ? &chall : NULL, ssq_server_behavior(view->cache));
+}
+
 bool           ssq_server_eok(const SSQ_SERVER *server)   { return ssq_server_ecode(server) == SSQE_OK; }
 SSQ_ERROR_CODE ssq_server_ecode(const SSQ_SERVER *server) { return server->last_error.code; }
 const char    *ssq_server_emsg(const SSQ_SERVER *server)  { return server->last_error.message; }
@@ -5,15 +5,61 @@
 # include <ws2tcpip.h>
 #else /* !_WIN32 */
 # include <netdb.h>
+# include <netinet/in.h>
 # include <sys/time.h>
 #endif /* _WIN32 */
 
+#include "ssq/a2s.h"
+#include "ssq/trace.h"
+
 #include "error.h"
+#include "socket.h"
+#include "thread.h"
+
+#define SSQ_SERVER_INFO_CHALL 0x01 /* The server requires a challenge for A2S_INFO queries. */
+
+/*
+ * What was learnt about a server is packed into a single word, so that threads sharing the server
+ * read and update it atomically: the challenge in the low 32 bits, then whether there is one, then
+ * the behavior flags.
+ */
+#define SSQ_SERVER_CACHE_CHALL          ((uint64_t)0xFFFFFFFF)
+#define SSQ_SERVER_CACHE_HAS_CHALL      ((uint64_t)1 << 32)
+#define SSQ_SERVER_CACHE_BEHAVIOR_SHIFT 40
+
+/*
+ * Round-trip time estimates (RFC 6298), in milliseconds: the smoothed round-trip time scaled by 8
+ * in the low 32 bits and its variance scaled by 4 in the high 32 bits, 0 until the first sample.
+ */
+#define SSQ_SERVER_RTT_SRTT(rtt)   ((uint32_t)(rtt))
+#define SSQ_SERVER_RTT_RTTVAR(rtt) ((uint32_t)((rtt) >> 32))
+
+#define SSQ_SERVER_RTO_INITIAL 1000 /* Retransmission timeout before any sample, in milliseconds. */
+#define SSQ_SERVER_RTO_MIN     200  /* Lower bound of the retransmission timeout.                */
+#define SSQ_SERVER_GAP_MIN     50   /* Lower bound of the gap timeout.                           */
+
+/*
+ * A server is taken for one ignoring A2S_RULES queries once several of them in a row timed out
+ * although they carried a challenge (a lost datagram is no proof). Such queries are then refused
+ * for a while, after which one is let through as a probe, the wait doubling each time it fails
+ * too. The number of timeouts in a row is kept in the low 8 bits of the word, and the point in
+ * time (in milliseconds) until which queries are refused above them, 0 if none.
+ */
+#define SSQ_SERVER_RULES_STRIKES(rules) ((uint8_t)(rules))
+#define SSQ_SERVER_RULES_UNTIL(rules)   ((rules) >> 8)
+
+#define SSQ_SERVER_NO_RULES_STRIKES     3       /* Timeouts in a row before A2S_RULES queries are refused. */
+#define SSQ_SERVER_NO_RULES_BACKOFF     60000   /* How long they are first refused, in milliseconds.       */
+#define SSQ_SERVER_NO_RULES_BACKOFF_MAX 1920000 /* Upper bound of the doubling wait.                       */
+
+#define SSQ_SERVER_KIND_COUNT (A2S_QUERY_RULES + 1) /* Number of kinds of A2S queries. */
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+typedef struct ssq_metrics_block SSQ_METRICS_BLOCK; /* See metrics.h. */
+
 typedef struct ssq_timeout {
 #ifdef _WIN32
     DWORD          recv;
@@ -25,11 +71,65 @@ typedef struct ssq_timeout {
 } SSQ_TIMEOUT;
 
 typedef struct ssq_server {
-    struct addrinfo *addr_list;
-    SSQ_ERROR        last_error;
-    SSQ_TIMEOUT      timeout;
+    struct addrinfo        *addr_list;
+    struct addrinfo         addr;         /* Sole entry of `addr_list' when built from a numeric address. */
+    struct sockaddr_storage addr_storage; /* The address of `addr'.                                         */
+    SSQ_ERROR               last_error;
+    SSQ_TIMEOUT             timeout;
+    bool                    reuse_socket;
+    unsigned                retransmits;  /* How many times a request may be sent again.                    */
+    SOCKET                  sockfd;
+    volatile uint64_t       cache;        /* Challenge and behavior learnt (see SSQ_SERVER_CACHE_*).        */
+    volatile uint64_t       rtt;          /* Round-trip time estimates (see SSQ_SERVER_RTT_*).              */
+    volatile uint64_t       rules;        /* A2S_RULES timeouts and refusal (see SSQ_SERVER_RULES_*).       */
+    SSQ_METRICS_BLOCK      *metrics;      /* Counters shared with the views of the server, NULL if off.     */
+    SSQ_TRACE_CALLBACK      trace;        /* Told about the phases of the queries, NULL if none.            */
+    void                   *trace_data;   /* User data passed to `trace'.                                   */
+    /* Fingerprint of the last response of each kind decoded (see `ssq_response_fingerprint'), 0 if none. */
+    volatile uint64_t       fingerprints[SSQ_SERVER_KIND_COUNT];
 } SSQ_SERVER;
 
+/* What was learnt about a server when a view of it was made. */
+typedef struct ssq_server_learnt {
+    uint64_t cache; /* See SSQ_SERVER_CACHE_*. */
+    uint64_t rtt;   /* See SSQ_SERVER_RTT_*.   */
+    uint64_t rules; /* See SSQ_SERVER_RULES_*. */
+} SSQ_SERVER_LEARNT;
+
+void           ssq_server_init(SSQ_SERVER *server);
+bool           ssq_server_init_numeric(SSQ_SERVER *server, const struct sockaddr *addr, size_t addr_len, SSQ_ERROR *error);
+void           ssq_server_fini(SSQ_SERVER *server);
+
+/* Stores the challenge to send along the query in `chall' and returns it, or returns NULL if none. */
+const int32_t *ssq_server_chall(const SSQ_SERVER *server, A2S_QUERY_KIND kind, int32_t *chall);
+/* Whether the server answers queries of the given kind sent without a challenge with one. */
+bool           ssq_server_challenges(const SSQ_SERVER *server, A2S_QUERY_KIND kind);
+bool           ssq_server_answers(const SSQ_SERVER *server, A2S_QUERY_KIND kind, SSQ_ERROR *error);
+void           ssq_server_learn_chall(SSQ_SERVER *server, A2S_QUERY_KIND kind, int32_t chall);
+/* To be called when a query timed out although it carried a challenge. */
+void           ssq_server_learn_timeout(SSQ_SERVER *server, A2S_QUERY_KIND kind);
+/* To be called when a query was answered. */
+void           ssq_server_learn_answer(SSQ_SERVER *server, A2S_QUERY_KIND kind);
+void           ssq_server_learn_rtt(SSQ_SERVER *server, uint64_t sample_in_ms);
+/* Fingerprint of the last response of the given kind decoded from the server, 0 if none. */
+uint64_t       ssq_server_fingerprint(const SSQ_SERVER *server, A2S_QUERY_KIND kind);
+void           ssq_server_learn_fingerprint(SSQ_SERVER *server, A2S_QUERY_KIND kind, uint64_t fingerprint);
+
+/* Receive timeout in milliseconds. */
+uint64_t       ssq_server_recv_timeout(const SSQ_SERVER *server);
+/* How long to wait for a response before sending the request again, in milliseconds. */
+uint64_t       ssq_server_rto(const SSQ_SERVER *server);
+/* How long to wait for the next packet of a split response before asking for the response again. */
+uint64_t       ssq_server_gap(const SSQ_SERVER *server);
+
+/*
+ * A view is a copy of the server for a single call: it shares the addresses of the server but has
+ * its own socket and last error, and no fingerprints. Stores what was learnt about the server when the view was made in
+ * `learnt', to be passed to `ssq_server_publish' along with the view once the call is over.
+ */
+void           ssq_server_view(SSQ_SERVER *view, SSQ_SERVER *server, SSQ_SERVER_LEARNT *learnt);
+void           ssq_server_publish(SSQ_SERVER *server, const SSQ_SERVER *view, const SSQ_SERVER_LEARNT *learnt);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
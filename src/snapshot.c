@@ -0,0 +1,307 @@
+#include "ssq/snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "a2s.h"
+#include "helper.h"
+#include "metrics.h"
+#include "packet.h"
+#include "query.h"
+#include "response.h"
+#include "server.h"
+#include "socket.h"
+#include "trace.h"
+
+#define SSQ_SNAPSHOT_QUERY_COUNT 3
+
+/* Responses reassembled at once: one per query, plus one for a late duplicate. */
+#define SSQ_SNAPSHOT_REASSEMBLY_COUNT (SSQ_SNAPSHOT_QUERY_COUNT + 1)
+
+typedef struct ssq_snapshot_query {
+    bool    pending;       /* Whether the response is still awaited.                    */
+    bool    challengeable; /* Whether a request without a challenge is answered by one. */
+    bool    challenged;    /* Whether the last request carried a challenge.             */
+    int32_t chall;         /* The challenge carried by the last request, if any.        */
+} SSQ_SNAPSHOT_QUERY;
+
+typedef struct ssq_snapshot_ctx {
+    SSQ_SERVER        *server;
+    SSQ_SNAPSHOT      *snapshot;
+    SSQ_ERROR          error;                                      /* First failure.                   */
+    SOCKET             sockfd;
+    SSQ_SNAPSHOT_QUERY queries[SSQ_SNAPSHOT_QUERY_COUNT];          /* Indexed by A2S_QUERY_KIND.       */
+    size_t             pending_count;                              /* Number of responses awaited.     */
+    size_t             owed;                                       /* Replies owed (see below).        */
+    bool               has_chall;                                  /* Whether `chall' is set.          */
+    int32_t            chall;                                      /* Last challenge received.         */
+    SSQ_REASSEMBLY     reassemblies[SSQ_SNAPSHOT_REASSEMBLY_COUNT];
+    size_t             evict;                                      /* Next reassembly to give up on.   */
+} SSQ_SNAPSHOT_CTX;
+
+static void ssq_snapshot_fail(SSQ_SNAPSHOT_CTX *ctx, A2S_QUERY_KIND kind, const SSQ_ERROR *error) {
+    if (ctx->error.code == SSQE_OK)
+        ctx->error = *error;
+    ctx->queries[kind].pending = false;
+    --ctx->pending_count;
+}
+
+static void ssq_snapshot_send(SSQ_SNAPSHOT_CTX *ctx, A2S_QUERY_KIND kind, const int32_t *chall) {
+    SSQ_SNAPSHOT_QUERY *query = &ctx->queries[kind];
+    uint8_t payload[A2S_PAYLOAD_SIZE];
+    size_t payload_len = ssq_a2s_payload(kind, payload, chall);
+    query->challenged = (chall != NULL);
+    query->chall      = (chall != NULL) ? *chall : 0;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    if (!ssq_socket_send(ctx->sockfd, payload, payload_len, &error)) {
+        ssq_metrics_failed(ctx->server, &error);
+        ssq_snapshot_fail(ctx, kind, &error);
+        return;
+    }
+    if (query->challengeable)
+        ++ctx->owed;
+    SSQ_TRACE(ctx->server, SSQ_TRACE_SEND, payload_len);
+}
+
+/*
+ * A challenge does not tell which request it answers. Every request of a challengeable kind gets
+ * exactly one reply, a challenge or the response: `owed' counts those not received yet. A reply
+ * coming when none is owed is thus a challenge given to the A2S_INFO request, which tells that the
+ * server wants one for such queries too.
+ */
+static void ssq_snapshot_on_reply(SSQ_SNAPSHOT_CTX *ctx) {
+    if (ctx->owed != 0) {
+        --ctx->owed;
+        return;
+    }
+    ctx->queries[A2S_QUERY_INFO].challengeable = true;
+}
+
+/*
+ * The server hands out the same challenge to every request coming from this socket: each pending
+ * request of a challengeable kind that did not carry it is sent again.
+ */
+static void ssq_snapshot_resend(SSQ_SNAPSHOT_CTX *ctx, int32_t chall) {
+    for (int kind = 0; kind < SSQ_SNAPSHOT_QUERY_COUNT; ++kind) {
+        const SSQ_SNAPSHOT_QUERY *query = &ctx->queries[kind];
+        if (query->pending && query->challengeable && !(query->challenged && query->chall == chall))
+            ssq_snapshot_send(ctx, (A2S_QUERY_KIND)kind, &chall);
+    }
+}
+
+static void ssq_snapshot_on_challenge(SSQ_SNAPSHOT_CTX *ctx, int32_t chall) {
+    ssq_metrics_count(ctx->server, SSQ_METRICS_CHALLENGES);
+    SSQ_TRACE(ctx->server, SSQ_TRACE_CHALLENGE, 0);
+    ctx->has_chall = true;
+    ctx->chall     = chall;
+    ssq_snapshot_on_reply(ctx);
+    ssq_snapshot_resend(ctx, chall);
+}
+
+static void ssq_snapshot_on_response(SSQ_SNAPSHOT_CTX *ctx, const uint8_t response[], size_t response_len) {
+    if (ssq_response_has_challenge(response, response_len)) {
+        ssq_snapshot_on_challenge(ctx, ssq_response_get_challenge(response, response_len));
+        return;
+    }
+    A2S_QUERY_KIND kind;
+    switch (ssq_response_get_header(response, response_len)) {
+        case S2A_HEADER_INFO:   kind = A2S_QUERY_INFO;   break;
+        case S2A_HEADER_PLAYER: kind = A2S_QUERY_PLAYER; break;
+        case S2A_HEADER_RULES:  kind = A2S_QUERY_RULES;  break;
+        default: return; // Not an answer to any of our queries.
+    }
+    SSQ_SNAPSHOT_QUERY *query = &ctx->queries[kind];
+    if (query->challengeable) {
+        bool challengeable = ctx->queries[A2S_QUERY_INFO].challengeable;
+        ssq_snapshot_on_reply(ctx);
+        if (!challengeable && ctx->queries[A2S_QUERY_INFO].challengeable)
+            ssq_snapshot_resend(ctx, ctx->chall);
+    }
+    if (!query->pending)
+        return; // Duplicate answer to a request that was sent again.
+    ssq_server_learn_answer(ctx->server, kind);
+    SSQ_SNAPSHOT *snapshot = ctx->snapshot;
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    SSQ_TRACE(ctx->server, SSQ_TRACE_DECODE_BEGIN, response_len);
+    switch (kind) {
+        case A2S_QUERY_INFO:
+            snapshot->info = ssq_info_deserialize(response, response_len, &error);
+            break;
+        case A2S_QUERY_PLAYER:
+            snapshot->players = ssq_player_deserialize(response, response_len, &snapshot->player_count, &error);
+            break;
+        case A2S_QUERY_RULES:
+            snapshot->rules = ssq_rules_deserialize(response, response_len, &snapshot->rule_count, &error);
+            break;
+    }
+    SSQ_TRACE(ctx->server, SSQ_TRACE_DECODE_END, 0);
+    if (error.code != SSQE_OK) {
+        ssq_metrics_failed(ctx->server, &error);
+        ssq_snapshot_fail(ctx, kind, &error);
+        return;
+    }
+    // Only the challengeable kinds are sent with a challenge: the response answers such a request.
+    if (query->challenged)
+        ssq_server_learn_chall(ctx->server, kind, query->chall);
+    query->pending = false;
+    --ctx->pending_count;
+}
+
+/* Finds the reassembly the datagram belongs to, or a fresh one if it starts another response. */
+static SSQ_REASSEMBLY *ssq_snapshot_route(SSQ_SNAPSHOT_CTX *ctx, const uint8_t datagram[], size_t datagram_len) {
+    SSQ_REASSEMBLY *fresh = NULL;
+    for (size_t i = 0; i < SSQ_SNAPSHOT_REASSEMBLY_COUNT; ++i) {
+        SSQ_REASSEMBLY *reassembly = &ctx->reassemblies[i];
+        if (ssq_reassembly_owns(reassembly, datagram, datagram_len))
+            return reassembly;
+        if (fresh == NULL && reassembly->total == 0)
+            fresh = reassembly;
+    }
+    if (fresh == NULL) {
+        // Every slot holds an incomplete response: give up on the one started the longest ago.
+        fresh = &ctx->reassemblies[ctx->evict];
+        ctx->evict = (ctx->evict + 1) % SSQ_SNAPSHOT_REASSEMBLY_COUNT;
+        ssq_reassembly_clear(fresh);
+    }
+    return fresh;
+}
+
+static void ssq_snapshot_on_datagram(SSQ_SNAPSHOT_CTX *ctx, const uint8_t datagram[], size_t datagram_len) {
+    SSQ_REASSEMBLY *reassembly = ssq_snapshot_route(ctx, datagram, datagram_len);
+    SSQ_ERROR error;
+    error.code = SSQE_OK;
+    ssq_reassembly_add(reassembly, datagram, datagram_len, &error);
+    if (error.code != SSQE_OK) {
+        // Malformed packet: the response it belongs to cannot be told, so it is merely dropped.
+        ssq_reassembly_clear(reassembly);
+        return;
+    }
+    if (!ssq_reassembly_done(reassembly))
+        return;
+    size_t response_len;
+    uint8_t *response = ssq_reassembly_to_response(reassembly, &response_len, &error);
+    ssq_reassembly_clear(reassembly);
+    if (response != NULL) {
+        SSQ_TRACE(ctx->server, SSQ_TRACE_REASSEMBLED, response_len);
+        ssq_snapshot_on_response(ctx, response, response_len);
+        free(response);
+    }
+}
+
+/*
+ * A challenge given to the A2S_INFO request goes unnoticed by the count of replies while another
+ * request is left unanswered (e.g. by a server ignoring A2S_RULES queries). An A2S_INFO request
+ * still pending at the timeout is thus sent once more with the challenge, if any came: had it been
+ * answered without one, its response would have arrived by now.
+ */
+static bool ssq_snapshot_retry_info(SSQ_SNAPSHOT_CTX *ctx) {
+    SSQ_SNAPSHOT_QUERY *query = &ctx->queries[A2S_QUERY_INFO];
+    if (!query->pending || query->challengeable || !ctx->has_chall)
+        return false;
+    query->challengeable = true;
+    ssq_snapshot_send(ctx, A2S_QUERY_INFO, &ctx->chall);
+    return query->pending;
+}
+
+/* Fails the queries still pending, on a timeout or an error of the socket. */
+static void ssq_snapshot_on_timeout(SSQ_SNAPSHOT_CTX *ctx, const SSQ_ERROR *error) {
+    for (int kind = 0; kind < SSQ_SNAPSHOT_QUERY_COUNT; ++kind) {
+        const SSQ_SNAPSHOT_QUERY *query = &ctx->queries[kind];
+        if (!query->pending)
+            continue;
+        if (query->challenged && error->code == SSQE_TIMEOUT)
+            ssq_server_learn_timeout(ctx->server, (A2S_QUERY_KIND)kind);
+        ssq_metrics_failed(ctx->server, error);
+        ssq_snapshot_fail(ctx, (A2S_QUERY_KIND)kind, error);
+    }
+}
+
+/* A receive timeout of 0 waits forever, as it does for SO_RCVTIMEO. */
+static inline uint64_t ssq_snapshot_deadline(uint64_t timeout) {
+    return (timeout != 0) ? ssq_helper_clock_millis() + timeout : UINT64_MAX;
+}
+
+void ssq_snapshot(SSQ_SERVER *server, SSQ_SNAPSHOT *snapshot) {
+    memset(snapshot, 0, sizeof (*snapshot));
+    SSQ_SNAPSHOT_CTX ctx;
+    memset(&ctx, 0, sizeof (ctx));
+    ctx.server     = server;
+    ctx.snapshot   = snapshot;
+    ctx.error.code = SSQE_OK;
+    ctx.sockfd     = ssq_query_acquire_socket(server);
+    if (ctx.sockfd == INVALID_SOCKET)
+        return;
+    for (int kind = 0; kind < SSQ_SNAPSHOT_QUERY_COUNT; ++kind) {
+        ctx.queries[kind].pending       = true;
+        ctx.queries[kind].challengeable = ssq_server_challenges(server, (A2S_QUERY_KIND)kind);
+        ++ctx.pending_count;
+    }
+    for (int kind = 0; kind < SSQ_SNAPSHOT_QUERY_COUNT; ++kind) {
+        SSQ_ERROR error;
+        error.code = SSQE_OK;
+        int32_t chall;
+        if (ssq_server_answers(server, (A2S_QUERY_KIND)kind, &error)) {
+            ssq_metrics_count(server, SSQ_METRICS_QUERIES);
+            ssq_snapshot_send(&ctx, (A2S_QUERY_KIND)kind, ssq_server_chall(server, (A2S_QUERY_KIND)kind, &chall));
+        } else {
+            ssq_snapshot_fail(&ctx, (A2S_QUERY_KIND)kind, &error);
+        }
+    }
+    for (size_t i = 0; i < SSQ_SNAPSHOT_REASSEMBLY_COUNT; ++i)
+        ssq_reassembly_init(&ctx.reassemblies[i]);
+    // The receive timeout of the server bounds the wait for the next query to end, not for the
+    // next datagram: stray datagrams cannot keep the snapshot waiting.
+    uint64_t timeout  = ssq_server_recv_timeout(server);
+    uint64_t deadline = ssq_snapshot_deadline(timeout);
+    while (ctx.pending_count != 0) {
+        SSQ_ERROR error;
+        error.code = SSQE_OK;
+        uint64_t now = ssq_helper_clock_millis();
+        int ready = (now < deadline) ? ssq_socket_poll(ctx.sockfd, deadline - now) : 0;
+        if (ready == SOCKET_ERROR) {
+            ssq_socket_set_error(&error);
+            ssq_snapshot_on_timeout(&ctx, &error);
+            break;
+        }
+        if (ready == 0) {
+            if (ssq_helper_clock_millis() < deadline)
+                continue;
+            if (ssq_snapshot_retry_info(&ctx)) {
+                deadline = ssq_snapshot_deadline(timeout);
+                continue;
+            }
+            ssq_error_set(&error, SSQE_TIMEOUT, "Timed out waiting for a response");
+            ssq_snapshot_on_timeout(&ctx, &error);
+            break;
+        }
+        // Responses are interleaved, so the payloads can only be placed once their packet was read.
+        uint8_t datagram[SSQ_PACKET_SIZE];
+        long bytes_received = ssq_socket_recv(ctx.sockfd, datagram, SSQ_PACKET_SIZE, &error);
+        ssq_metrics_received(server, bytes_received);
+        if (bytes_received == SOCKET_ERROR) {
+            if (error.code == SSQE_OK)
+                continue; // Readable but nothing to receive after all.
+            ssq_snapshot_on_timeout(&ctx, &error);
+            break;
+        }
+        SSQ_TRACE(server, SSQ_TRACE_RECV, (size_t)bytes_received);
+        size_t pending_count = ctx.pending_count;
+        ssq_snapshot_on_datagram(&ctx, datagram, (size_t)bytes_received);
+        if (ctx.pending_count != pending_count)
+            deadline = ssq_snapshot_deadline(timeout);
+    }
+    for (size_t i = 0; i < SSQ_SNAPSHOT_REASSEMBLY_COUNT; ++i)
+        ssq_reassembly_clear(&ctx.reassemblies[i]);
+    if (ctx.error.code != SSQE_OK)
+        server->last_error = ctx.error;
+    ssq_query_release_socket(server, ctx.sockfd);
+}
+
+void ssq_snapshot_free(SSQ_SNAPSHOT *snapshot) {
+    ssq_info_free(snapshot->info);
+    ssq_player_free(snapshot->players, snapshot->player_count);
+    ssq_rules_free(snapshot->rules, snapshot->rule_count);
+    memset(snapshot, 0, sizeof (*snapshot));
+}
@@ -0,0 +1,149 @@
+#include "socket.h"
+
+#include <errno.h>
+#include <string.h>
+#ifndef _WIN32
+# include <fcntl.h>
+# include <poll.h>
+#endif /* !_WIN32 */
+
+#include "packet.h"
+
+/* Upper bound on the number of datagrams discarded by a single drain. */
+#define SSQ_SOCKET_DRAIN_MAX 64
+
+SOCKET ssq_socket_open(const struct addrinfo *addr_list, SSQ_ERROR *error) {
+    SOCKET sockfd = INVALID_SOCKET;
+    for (const struct addrinfo *addr = addr_list; addr != NULL; addr = addr->ai_next) {
+        sockfd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (sockfd == INVALID_SOCKET)
+            continue;
+#ifdef _WIN32
+        if (connect(sockfd, addr->ai_addr, (int)addr->ai_addrlen) != SOCKET_ERROR)
+#else /* !_WIN32 */
+        if (connect(sockfd, addr->ai_addr, addr->ai_addrlen) != SOCKET_ERROR)
+#endif /* _WIN32 */
+            break;
+        closesocket(sockfd);
+        sockfd = INVALID_SOCKET;
+    }
+    if (sockfd == INVALID_SOCKET)
+        ssq_error_set(error, SSQE_NO_SOCKET, "Could not create an endpoint for communication");
+    return sockfd;
+}
+
+bool ssq_socket_set_nonblocking(SOCKET sockfd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sockfd, FIONBIO, &mode) != SOCKET_ERROR;
+#else /* !_WIN32 */
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    return flags != -1 && fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif /* _WIN32 */
+}
+
+bool ssq_socket_send(SOCKET sockfd, const uint8_t payload[], size_t payload_len, SSQ_ERROR *error) {
+#ifdef _WIN32
+    if (send(sockfd, (const char *)payload, (int)payload_len, 0) == SOCKET_ERROR) {
+#else /* !_WIN32 */
+    if (send(sockfd, payload, payload_len, 0) == SOCKET_ERROR) {
+#endif /* _WIN32 */
+        ssq_socket_set_error(error);
+        return false;
+    }
+    return true;
+}
+
+long ssq_socket_recv(SOCKET sockfd, uint8_t buf[], size_t buf_size, SSQ_ERROR *error) {
+#ifdef _WIN32
+    long bytes_received = recv(sockfd, (char *)buf, (int)buf_size, 0);
+#else /* !_WIN32 */
+    long bytes_received = (long)recv(sockfd, buf, buf_size, 0);
+#endif /* _WIN32 */
+    if (bytes_received == SOCKET_ERROR && !ssq_socket_would_block())
+        ssq_socket_set_error(error);
+    return bytes_received;
+}
+
+/* Longest single wait, so that the timeout always fits the system call. */
+#define SSQ_SOCKET_POLL_MAX 3600000 // ms
+
+int ssq_socket_poll(SOCKET sockfd, uint64_t timeout_in_ms) {
+    if (timeout_in_ms > SSQ_SOCKET_POLL_MAX)
+        timeout_in_ms = SSQ_SOCKET_POLL_MAX;
+#ifdef _WIN32
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(sockfd, &readfds);
+    struct timeval limit = { (long)(timeout_in_ms / 1000), (long)(timeout_in_ms % 1000) * 1000 };
+    int ready = select(0, &readfds, NULL, NULL, &limit);
+#else /* !_WIN32 */
+    struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+    int ready = poll(&pfd, 1, (int)timeout_in_ms);
+    if (ready == SOCKET_ERROR && errno == EINTR)
+        return 0;
+#endif /* _WIN32 */
+    return (ready > 0) ? 1 : ready;
+}
+
+static bool ssq_socket_readable(SOCKET sockfd) {
+    return ssq_socket_poll(sockfd, 0) > 0;
+}
+
+long ssq_socket_recv_scatter(SOCKET sockfd, uint8_t *const bufs[], const size_t buf_sizes[], size_t buf_count, SSQ_ERROR *error) {
+#ifdef _WIN32
+    WSABUF wsabufs[SSQ_SOCKET_SCATTER_MAX];
+    for (size_t i = 0; i < buf_count; ++i) {
+        wsabufs[i].buf = (char *)bufs[i];
+        wsabufs[i].len = (ULONG)buf_sizes[i];
+    }
+    DWORD received = 0;
+    DWORD flags = 0;
+    long bytes_received = SOCKET_ERROR;
+    if (WSARecv(sockfd, wsabufs, (DWORD)buf_count, &received, &flags, NULL, NULL) != SOCKET_ERROR)
+        bytes_received = (long)received;
+#else /* !_WIN32 */
+    struct iovec iovs[SSQ_SOCKET_SCATTER_MAX];
+    for (size_t i = 0; i < buf_count; ++i) {
+        iovs[i].iov_base = bufs[i];
+        iovs[i].iov_len  = buf_sizes[i];
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof (msg));
+    msg.msg_iov    = iovs;
+    msg.msg_iovlen = buf_count;
+    long bytes_received = (long)recvmsg(sockfd, &msg, 0);
+#endif /* _WIN32 */
+    if (bytes_received == SOCKET_ERROR && !ssq_socket_would_block())
+        ssq_socket_set_error(error);
+    return bytes_received;
+}
+
+void ssq_socket_drain(SOCKET sockfd) {
+    for (int i = 0; i < SSQ_SOCKET_DRAIN_MAX && ssq_socket_readable(sockfd); ++i) {
+        uint8_t datagram[SSQ_PACKET_SIZE];
+        // Pending errors (e.g. an ICMP port unreachable) are consumed as well.
+#ifdef _WIN32
+        recv(sockfd, (char *)datagram, SSQ_PACKET_SIZE, 0);
+#else /* !_WIN32 */
+        recv(sockfd, datagram, SSQ_PACKET_SIZE, 0);
+#endif /* _WIN32 */
+    }
+}
+
+bool ssq_socket_would_block(void) {
+#ifdef _WIN32
+    int ecode = WSAGetLastError();
+    return ecode == WSAEWOULDBLOCK || ecode == WSAETIMEDOUT;
+#else /* !_WIN32 */
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif /* _WIN32 */
+}
+
+void ssq_socket_set_error(SSQ_ERROR *error) {
+#ifdef _WIN32
+    ssq_error_set_from_wsa(error);
+#else /* !_WIN32 */
+    ssq_error_set_from_errno(error);
+#endif /* _WIN32 */
+}
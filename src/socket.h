@@ -0,0 +1,49 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#else /* !_WIN32 */
+# include <netdb.h>
+# include <sys/socket.h>
+# include <sys/types.h>
+# include <sys/uio.h>
+# include <unistd.h>
+# define INVALID_SOCKET (-1)
+# define SOCKET_ERROR   (-1)
+# define closesocket    close
+typedef int SOCKET;
+#endif /* _WIN32 */
+
+#include "error.h"
+
+/* Maximum number of buffers a single datagram can be scattered into. */
+#define SSQ_SOCKET_SCATTER_MAX 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+SOCKET ssq_socket_open(const struct addrinfo *addr_list, SSQ_ERROR *error);
+bool   ssq_socket_set_nonblocking(SOCKET sockfd);
+
+bool   ssq_socket_send(SOCKET sockfd, const uint8_t *payload, size_t payload_len, SSQ_ERROR *error);
+long   ssq_socket_recv(SOCKET sockfd, uint8_t *buf, size_t buf_size, SSQ_ERROR *error);
+long   ssq_socket_recv_scatter(SOCKET sockfd, uint8_t *const bufs[], const size_t buf_sizes[], size_t buf_count, SSQ_ERROR *error);
+
+/* Waits up to `timeout_in_ms' for the socket to be readable; returns 1 if it is, 0 if not and SOCKET_ERROR on failure. */
+int    ssq_socket_poll(SOCKET sockfd, uint64_t timeout_in_ms);
+void   ssq_socket_drain(SOCKET sockfd);
+
+bool   ssq_socket_would_block(void);
+void   ssq_socket_set_error(SSQ_ERROR *error);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SOCKET_H */
@@ -4,11 +4,39 @@
 #include <string.h>
 
 #include "helper.h"
+#include "scan.h"
 
 void ssq_stream_wrap(SSQ_STREAM *stream, const void *data, size_t size) {
     stream->data = data;
     stream->size = size;
     stream->pos = 0;
+    stream->nuls = NULL;
+    stream->nul_count = 0;
+    stream->nul_next = 0;
+}
+
+void ssq_stream_index(SSQ_STREAM *stream, SSQ_STREAM_INDEX *index) {
+    index->nuls = index->local;
+    if (stream->size > UINT32_MAX)
+        return;
+    size_t count = ssq_scan_nuls(stream->data, stream->size, index->nuls, SSQ_STREAM_INDEX_LOCAL);
+    if (count > SSQ_STREAM_INDEX_LOCAL) {
+        index->nuls = malloc(count * sizeof (*index->nuls));
+        if (index->nuls == NULL) {
+            index->nuls = index->local;
+            return;
+        }
+        ssq_scan_nuls(stream->data, stream->size, index->nuls, count);
+    }
+    stream->nuls = index->nuls;
+    stream->nul_count = count;
+    stream->nul_next = 0;
+}
+
+void ssq_stream_index_free(SSQ_STREAM_INDEX *index) {
+    if (index->nuls != index->local)
+        free(index->nuls);
+    index->nuls = index->local;
 }
 
 void ssq_stream_advance(SSQ_STREAM *stream, size_t n) {
@@ -55,20 +83,33 @@ bool ssq_stream_read_bool(SSQ_STREAM *stream) {
 }
 
 /* Compute the number of bytes until the next null byte or end of stream. */
-static size_t ssq_stream_read_string_len(const SSQ_STREAM *stream) {
-    size_t len = 0;
-    while (len < ssq_stream_remaining(stream) && stream->data[stream->pos + len] != '\0')
-        ++len;
-    return len;
+static size_t ssq_stream_read_string_len(SSQ_STREAM *stream) {
+    size_t remaining = ssq_stream_remaining(stream);
+    if (remaining == 0)
+        return 0;
+    if (stream->nuls != NULL) {
+        // Strings are read in order, so the table is only ever walked forward.
+        while (stream->nul_next < stream->nul_count && stream->nuls[stream->nul_next] < stream->pos)
+            ++stream->nul_next;
+        return (stream->nul_next < stream->nul_count) ? stream->nuls[stream->nul_next] - stream->pos : remaining;
+    }
+    const uint8_t *nul = memchr(stream->data + stream->pos, '\0', remaining);
+    return (nul != NULL) ? (size_t)(nul - (stream->data + stream->pos)) : remaining;
 }
 
-char *ssq_stream_read_string(SSQ_STREAM *stream, size_t *len) {
+/* Borrowed strings rely on the data being followed by a terminator (see ssq_reassembly_to_response). */
+char *ssq_stream_read_string(SSQ_STREAM *stream, SSQ_ARENA *arena, size_t *len) {
     *len = ssq_stream_read_string_len(stream);
-    char *dest = calloc(*len + 1, sizeof (*dest));
-    if (dest == NULL)
-        return NULL;
-    const char *src = (const char *)(stream->data + stream->pos);
-    ssq_helper_strncpy(dest, src, *len);
+    if (arena->borrow) {
+        char *src = (char *)(stream->data + ssq_helper_minz(stream->pos, stream->size));
+        ssq_stream_advance(stream, *len + 1);
+        return src;
+    }
+    char *dest = ssq_arena_alloc(arena, *len + 1);
+    if (dest != NULL) {
+        memcpy(dest, stream->data + stream->pos, *len);
+        dest[*len] = '\0';
+    }
     ssq_stream_advance(stream, *len + 1);
     return dest;
 }
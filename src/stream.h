@@ -5,18 +5,40 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/* Number of string terminators an index holds without allocating. */
+#define SSQ_STREAM_INDEX_LOCAL 512
+
 typedef struct ssq_stream {
-    const uint8_t *data;
-    size_t         size;
-    size_t         pos;
+    const uint8_t  *data;
+    size_t          size;
+    size_t          pos;
+    const uint32_t *nuls;      /* Offsets of every NUL byte of `data', if indexed. */
+    size_t          nul_count; /* Number of entries in `nuls'.                     */
+    size_t          nul_next;  /* First entry of `nuls' that may lie past `pos'.   */
 } SSQ_STREAM;
 
+/* Offsets of the string terminators of a stream, found in a single sweep over its data. */
+typedef struct ssq_stream_index {
+    uint32_t *nuls;                          /* Either `local' or a heap block.  */
+    uint32_t  local[SSQ_STREAM_INDEX_LOCAL]; /* Storage for the common case.     */
+} SSQ_STREAM_INDEX;
+
 void     ssq_stream_wrap(SSQ_STREAM *stream, const void *data, size_t size);
 
+/*
+ * Lets the strings of the stream (and of its copies) be read off a precomputed offset table. The
+ * index must outlive them and be released with `ssq_stream_index_free'. If the table cannot be
+ * allocated, strings are simply scanned for as they are read.
+ */
+void     ssq_stream_index(SSQ_STREAM *stream, SSQ_STREAM_INDEX *index);
+void     ssq_stream_index_free(SSQ_STREAM_INDEX *index);
+
 void     ssq_stream_advance(SSQ_STREAM *stream, size_t n);
 size_t   ssq_stream_remaining(const SSQ_STREAM *stream);
 bool     ssq_stream_end(const SSQ_STREAM *stream);
@@ -33,7 +55,7 @@ uint64_t ssq_stream_read_uint64_t(SSQ_STREAM *stream);
 float    ssq_stream_read_float(SSQ_STREAM *stream);
 double   ssq_stream_read_double(SSQ_STREAM *stream);
 bool     ssq_stream_read_bool(SSQ_STREAM *stream);
-char    *ssq_stream_read_string(SSQ_STREAM *stream, size_t *len);
+char    *ssq_stream_read_string(SSQ_STREAM *stream, SSQ_ARENA *arena, size_t *len);
 
 #ifdef __cplusplus
 }
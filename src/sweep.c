@@ -0,0 +1,217 @@
+#include "ssq/sweep.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "error.h"
+#include "thread.h"
+
+/*
+ * The deque of a thread is a range of target indices packed in a single word, so that the owner
+ * taking the front target and thieves taking the back half race on one compare-and-swap. Indices
+ * only ever leave a deque, hence no ABA.
+ */
+#define SSQ_SWEEP_RANGE(front, end) (((uint64_t)(end) << 32) | (uint32_t)(front))
+#define SSQ_SWEEP_FRONT(range)      ((uint32_t)(range))
+#define SSQ_SWEEP_END(range)        ((uint32_t)((range) >> 32))
+
+typedef struct ssq_sweep_worker {
+    volatile uint64_t range;  /* Targets left to the thread (see SSQ_SWEEP_RANGE). */
+    SSQ_SWEEP        *sweep;  /* The sweep the thread belongs to.                  */
+    SSQ_THREAD        thread; /* The thread itself.                                */
+} SSQ_SWEEP_WORKER;
+
+struct ssq_sweep {
+    SSQ_SWEEP_WORKER       *workers;      /* One per thread started.                      */
+    size_t                  worker_count; /* Number of entries in `workers'.              */
+    SSQ_ERROR               error;        /* The last error of a sweep operation.         */
+
+    SSQ_MUTEX               mutex;        /* Protects every member below.                 */
+    SSQ_COND                work_cond;    /* Signaled when a run starts or on shutdown.   */
+    SSQ_COND                done_cond;    /* Signaled when the last thread of a run ends. */
+    uint64_t                generation;   /* Number of runs started.                      */
+    size_t                  busy;         /* Number of threads still on the current run.  */
+    bool                    stopping;     /* Whether the threads must exit.               */
+    const SSQ_SWEEP_TARGET *targets;      /* Targets of the current run.                  */
+    SSQ_SWEEP_CALLBACK      callback;     /* Callback of the current run, or NULL.        */
+    void                   *data;         /* User data passed to `callback'.              */
+    SSQ_SWEEP_OUTPUT       *outputs;      /* Outputs of the current run if no callback.   */
+};
+
+/* Work (on the sweeping threads) */
+
+static bool ssq_sweep_pop(SSQ_SWEEP_WORKER *worker, uint32_t *index) {
+    for (;;) {
+        uint64_t range = ssq_atomic_load(&worker->range);
+        uint32_t front = SSQ_SWEEP_FRONT(range);
+        uint32_t end   = SSQ_SWEEP_END(range);
+        if (front == end)
+            return false;
+        if (ssq_atomic_cas(&worker->range, range, SSQ_SWEEP_RANGE(front + 1, end))) {
+            *index = front;
+            return true;
+        }
+    }
+}
+
+/* Moves the back half of the victim's targets to the (empty) deque of the thief. */
+static bool ssq_sweep_steal(SSQ_SWEEP_WORKER *thief, SSQ_SWEEP_WORKER *victim) {
+    for (;;) {
+        uint64_t range = ssq_atomic_load(&victim->range);
+        uint32_t front = SSQ_SWEEP_FRONT(range);
+        uint32_t end   = SSQ_SWEEP_END(range);
+        if (front == end)
+            return false;
+        // The victim is busy with a target of its own: a single one left is taken too.
+        uint32_t mid = front + (end - front) / 2;
+        if (ssq_atomic_cas(&victim->range, range, SSQ_SWEEP_RANGE(front, mid))) {
+            ssq_atomic_store(&thief->range, SSQ_SWEEP_RANGE(mid, end));
+            return true;
+        }
+    }
+}
+
+static void ssq_sweep_query(const SSQ_SWEEP *sweep, size_t index) {
+    const SSQ_SWEEP_TARGET *target = &sweep->targets[index];
+    if (sweep->callback == NULL) {
+        SSQ_SWEEP_OUTPUT *output = &sweep->outputs[index];
+        output->result = ssq_call_result(target->server, target->kind, &output->call);
+    } else {
+        SSQ_CALL call;
+        SSQ_RESULT *result = ssq_call_result(target->server, target->kind, &call);
+        sweep->callback(target, index, result, &call, sweep->data);
+    }
+}
+
+static void ssq_sweep_work(SSQ_SWEEP_WORKER *worker) {
+    const SSQ_SWEEP *sweep = worker->sweep;
+    size_t self = (size_t)(worker - sweep->workers);
+    for (;;) {
+        uint32_t index;
+        while (ssq_sweep_pop(worker, &index))
+            ssq_sweep_query(sweep, index);
+        // No target is ever added during a run: once every deque is empty, the run is over for this thread.
+        size_t i = 1;
+        while (i < sweep->worker_count && !ssq_sweep_steal(worker, &sweep->workers[(self + i) % sweep->worker_count]))
+            ++i;
+        if (i == sweep->worker_count)
+            return;
+    }
+}
+
+static void ssq_sweep_thread(void *arg) {
+    SSQ_SWEEP_WORKER *worker = arg;
+    SSQ_SWEEP *sweep = worker->sweep;
+    uint64_t generation = 0;
+    ssq_mutex_lock(&sweep->mutex);
+    for (;;) {
+        while (sweep->generation == generation && !sweep->stopping)
+            ssq_cond_wait(&sweep->work_cond, &sweep->mutex);
+        if (sweep->stopping)
+            break;
+        generation = sweep->generation;
+        ssq_mutex_unlock(&sweep->mutex);
+        ssq_sweep_work(worker);
+        ssq_mutex_lock(&sweep->mutex);
+        if (--sweep->busy == 0)
+            ssq_cond_signal(&sweep->done_cond);
+    }
+    ssq_mutex_unlock(&sweep->mutex);
+}
+
+/* Lifecycle */
+
+SSQ_SWEEP *ssq_sweep_new(size_t thread_count) {
+    SSQ_SWEEP *sweep = calloc(1, sizeof (*sweep));
+    if (sweep == NULL)
+        return NULL;
+    if (thread_count == 0)
+        thread_count = SSQ_SWEEP_THREADS_DEFAULT;
+    sweep->workers = calloc(thread_count, sizeof (*sweep->workers));
+    if (sweep->workers == NULL) {
+        free(sweep);
+        return NULL;
+    }
+    ssq_mutex_init(&sweep->mutex);
+    ssq_cond_init(&sweep->work_cond);
+    ssq_cond_init(&sweep->done_cond);
+    // Threads only look at the other workers during a run, once every thread has started.
+    while (sweep->worker_count < thread_count) {
+        SSQ_SWEEP_WORKER *worker = &sweep->workers[sweep->worker_count];
+        worker->sweep = sweep;
+        if (!ssq_thread_start(&worker->thread, ssq_sweep_thread, worker))
+            break;
+        ++sweep->worker_count;
+    }
+    if (sweep->worker_count == 0) {
+        ssq_sweep_free(sweep);
+        return NULL;
+    }
+    ssq_sweep_eclr(sweep);
+    return sweep;
+}
+
+void ssq_sweep_free(SSQ_SWEEP *sweep) {
+    if (sweep == NULL)
+        return;
+    ssq_mutex_lock(&sweep->mutex);
+    sweep->stopping = true;
+    ssq_cond_broadcast(&sweep->work_cond);
+    ssq_mutex_unlock(&sweep->mutex);
+    for (size_t i = 0; i < sweep->worker_count; ++i)
+        ssq_thread_join(sweep->workers[i].thread);
+    ssq_cond_destroy(&sweep->done_cond);
+    ssq_cond_destroy(&sweep->work_cond);
+    ssq_mutex_destroy(&sweep->mutex);
+    free(sweep->workers);
+    free(sweep);
+}
+
+/* Runs (on the calling thread) */
+
+static bool ssq_sweep_start(SSQ_SWEEP *sweep, const SSQ_SWEEP_TARGET targets[], size_t target_count, SSQ_SWEEP_CALLBACK callback, void *data, SSQ_SWEEP_OUTPUT outputs[]) {
+    if (target_count > UINT32_MAX) {
+        ssq_error_set(&sweep->error, SSQE_INVALID_ARGUMENT, "Too many targets");
+        return false;
+    }
+    if (target_count == 0)
+        return true;
+    ssq_mutex_lock(&sweep->mutex);
+    sweep->targets  = targets;
+    sweep->callback = callback;
+    sweep->data     = data;
+    sweep->outputs  = outputs;
+    for (size_t i = 0; i < sweep->worker_count; ++i) {
+        uint64_t front = (uint64_t)target_count * i / sweep->worker_count;
+        uint64_t end   = (uint64_t)target_count * (i + 1) / sweep->worker_count;
+        ssq_atomic_store(&sweep->workers[i].range, SSQ_SWEEP_RANGE(front, end));
+    }
+    sweep->busy = sweep->worker_count;
+    ++sweep->generation;
+    ssq_cond_broadcast(&sweep->work_cond);
+    while (sweep->busy != 0)
+        ssq_cond_wait(&sweep->done_cond, &sweep->mutex);
+    ssq_mutex_unlock(&sweep->mutex);
+    return true;
+}
+
+bool ssq_sweep_run(SSQ_SWEEP *sweep, const SSQ_SWEEP_TARGET targets[], size_t target_count, SSQ_SWEEP_CALLBACK callback, void *data) {
+    if (callback == NULL) {
+        ssq_error_set(&sweep->error, SSQE_INVALID_ARGUMENT, "No callback to deliver the results to");
+        return false;
+    }
+    return ssq_sweep_start(sweep, targets, target_count, callback, data, NULL);
+}
+
+bool ssq_sweep_into(SSQ_SWEEP *sweep, const SSQ_SWEEP_TARGET targets[], size_t target_count, SSQ_SWEEP_OUTPUT outputs[]) {
+    return ssq_sweep_start(sweep, targets, target_count, NULL, NULL, outputs);
+}
+
+bool           ssq_sweep_eok(const SSQ_SWEEP *sweep)   { return ssq_sweep_ecode(sweep) == SSQE_OK; }
+SSQ_ERROR_CODE ssq_sweep_ecode(const SSQ_SWEEP *sweep) { return sweep->error.code; }
+const char    *ssq_sweep_emsg(const SSQ_SWEEP *sweep)  { return sweep->error.message; }
+
+void ssq_sweep_eclr(SSQ_SWEEP *sweep) {
+    sweep->error.code = SSQE_OK;
+    sweep->error.message[0] = '\0';
+}
@@ -0,0 +1,76 @@
+#include "thread.h"
+
+#include <stdlib.h>
+#ifdef _WIN32
+# include <process.h>
+#endif /* _WIN32 */
+
+typedef struct ssq_thread_start_ctx {
+    SSQ_THREAD_ROUTINE routine;
+    void              *arg;
+} SSQ_THREAD_START_CTX;
+
+#ifdef _WIN32
+static unsigned __stdcall ssq_thread_trampoline(void *arg) {
+#else /* !_WIN32 */
+static void *ssq_thread_trampoline(void *arg) {
+#endif /* _WIN32 */
+    SSQ_THREAD_START_CTX ctx = *(SSQ_THREAD_START_CTX *)arg;
+    free(arg);
+    ctx.routine(ctx.arg);
+#ifdef _WIN32
+    return 0;
+#else /* !_WIN32 */
+    return NULL;
+#endif /* _WIN32 */
+}
+
+bool ssq_thread_start(SSQ_THREAD *thread, SSQ_THREAD_ROUTINE routine, void *arg) {
+    SSQ_THREAD_START_CTX *ctx = malloc(sizeof (*ctx));
+    if (ctx == NULL)
+        return false;
+    ctx->routine = routine;
+    ctx->arg     = arg;
+#ifdef _WIN32
+    *thread = (HANDLE)_beginthreadex(NULL, 0, ssq_thread_trampoline, ctx, 0, NULL);
+    bool started = (*thread != NULL);
+#else /* !_WIN32 */
+    bool started = (pthread_create(thread, NULL, ssq_thread_trampoline, ctx) == 0);
+#endif /* _WIN32 */
+    if (!started)
+        free(ctx);
+    return started;
+}
+
+#ifdef _WIN32
+void ssq_thread_join(SSQ_THREAD thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void ssq_mutex_init(SSQ_MUTEX *mutex)    { InitializeCriticalSection(mutex); }
+void ssq_mutex_destroy(SSQ_MUTEX *mutex) { DeleteCriticalSection(mutex);     }
+void ssq_mutex_lock(SSQ_MUTEX *mutex)    { EnterCriticalSection(mutex);      }
+void ssq_mutex_unlock(SSQ_MUTEX *mutex)  { LeaveCriticalSection(mutex);      }
+
+void ssq_cond_init(SSQ_COND *cond)                   { InitializeConditionVariable(cond);              }
+void ssq_cond_destroy(SSQ_COND *cond)                { (void)cond;                                     }
+void ssq_cond_wait(SSQ_COND *cond, SSQ_MUTEX *mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+void ssq_cond_signal(SSQ_COND *cond)                 { WakeConditionVariable(cond);                    }
+void ssq_cond_broadcast(SSQ_COND *cond)              { WakeAllConditionVariable(cond);                 }
+#else /* !_WIN32 */
+void ssq_thread_join(SSQ_THREAD thread) {
+    pthread_join(thread, NULL);
+}
+
+void ssq_mutex_init(SSQ_MUTEX *mutex)    { pthread_mutex_init(mutex, NULL); }
+void ssq_mutex_destroy(SSQ_MUTEX *mutex) { pthread_mutex_destroy(mutex);    }
+void ssq_mutex_lock(SSQ_MUTEX *mutex)    { pthread_mutex_lock(mutex);       }
+void ssq_mutex_unlock(SSQ_MUTEX *mutex)  { pthread_mutex_unlock(mutex);     }
+
+void ssq_cond_init(SSQ_COND *cond)                   { pthread_cond_init(cond, NULL);   }
+void ssq_cond_destroy(SSQ_COND *cond)                { pthread_cond_destroy(cond);      }
+void ssq_cond_wait(SSQ_COND *cond, SSQ_MUTEX *mutex) { pthread_cond_wait(cond, mutex);  }
+void ssq_cond_signal(SSQ_COND *cond)                 { pthread_cond_signal(cond);       }
+void ssq_cond_broadcast(SSQ_COND *cond)              { pthread_cond_broadcast(cond);    }
+#endif /* _WIN32 */
@@ -0,0 +1,81 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#ifdef _WIN32
+# include <windows.h>
+#else /* !_WIN32 */
+# include <pthread.h>
+#endif /* _WIN32 */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#ifdef _WIN32
+typedef HANDLE             SSQ_THREAD;
+typedef CRITICAL_SECTION   SSQ_MUTEX;
+typedef CONDITION_VARIABLE SSQ_COND;
+#else /* !_WIN32 */
+typedef pthread_t          SSQ_THREAD;
+typedef pthread_mutex_t    SSQ_MUTEX;
+typedef pthread_cond_t     SSQ_COND;
+#endif /* _WIN32 */
+
+typedef void (*SSQ_THREAD_ROUTINE)(void *arg);
+
+bool ssq_thread_start(SSQ_THREAD *thread, SSQ_THREAD_ROUTINE routine, void *arg);
+void ssq_thread_join(SSQ_THREAD thread);
+
+void ssq_mutex_init(SSQ_MUTEX *mutex);
+void ssq_mutex_destroy(SSQ_MUTEX *mutex);
+void ssq_mutex_lock(SSQ_MUTEX *mutex);
+void ssq_mutex_unlock(SSQ_MUTEX *mutex);
+
+void ssq_cond_init(SSQ_COND *cond);
+void ssq_cond_destroy(SSQ_COND *cond);
+void ssq_cond_wait(SSQ_COND *cond, SSQ_MUTEX *mutex);
+void ssq_cond_signal(SSQ_COND *cond);
+void ssq_cond_broadcast(SSQ_COND *cond);
+
+/* Sequentially consistent accesses to a 64-bit word shared between threads. */
+static inline uint64_t ssq_atomic_load(const volatile uint64_t *word) {
+#ifdef _MSC_VER
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)word, 0, 0);
+#else /* !_MSC_VER */
+    return __atomic_load_n(word, __ATOMIC_SEQ_CST);
+#endif /* _MSC_VER */
+}
+
+static inline void ssq_atomic_store(volatile uint64_t *word, uint64_t value) {
+#ifdef _MSC_VER
+    InterlockedExchange64((volatile LONG64 *)word, (LONG64)value);
+#else /* !_MSC_VER */
+    __atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+#endif /* _MSC_VER */
+}
+
+/* Adds `delta' to the word, wrapping around; returns the new value. */
+static inline uint64_t ssq_atomic_add(volatile uint64_t *word, uint64_t delta) {
+#ifdef _MSC_VER
+    return (uint64_t)InterlockedAdd64((volatile LONG64 *)word, (LONG64)delta);
+#else /* !_MSC_VER */
+    return __atomic_add_fetch(word, delta, __ATOMIC_SEQ_CST);
+#endif /* _MSC_VER */
+}
+
+/* Replaces the word with `desired' if it still holds `expected'; returns whether it did. */
+static inline bool ssq_atomic_cas(volatile uint64_t *word, uint64_t expected, uint64_t desired) {
+#ifdef _MSC_VER
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)word, (LONG64)desired, (LONG64)expected) == expected;
+#else /* !_MSC_VER */
+    return __atomic_compare_exchange_n(word, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif /* _MSC_VER */
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !THREAD_H */
@@ -0,0 +1,29 @@
+#include "ssq/trace.h"
+
+#include "helper.h"
+#include "trace.h"
+
+void ssq_trace_emit(const SSQ_SERVER *server, SSQ_TRACE_PHASE phase, size_t size) {
+    SSQ_TRACE_EVENT event;
+    event.phase      = phase;
+    event.time_in_ns = ssq_helper_clock_nanos();
+    event.size       = size;
+    server->trace(&event, server->trace_data);
+}
+
+bool ssq_server_trace(SSQ_SERVER *server, SSQ_TRACE_CALLBACK callback, void *data) {
+#ifdef SSQ_HAVE_TRACE
+    server->trace      = callback;
+    server->trace_data = data;
+    return true;
+#else /* !SSQ_HAVE_TRACE */
+    (void)server;
+    (void)callback;
+    (void)data;
+    return false;
+#endif /* SSQ_HAVE_TRACE */
+}
+
+uint64_t ssq_trace_now(void) {
+    return ssq_helper_clock_nanos();
+}
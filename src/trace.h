@@ -0,0 +1,28 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+
+#include "ssq/trace.h"
+
+#include "server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Calls the tracing callback of the server; the hooks of the queries go through SSQ_TRACE. */
+void ssq_trace_emit(const SSQ_SERVER *server, SSQ_TRACE_PHASE phase, size_t size);
+
+#ifdef SSQ_HAVE_TRACE
+# define SSQ_TRACE(server, phase, size) \
+    do { if ((server)->trace != NULL) ssq_trace_emit((server), (phase), (size)); } while (0)
+#else /* !SSQ_HAVE_TRACE */
+# define SSQ_TRACE(server, phase, size) ((void)(server))
+#endif /* SSQ_HAVE_TRACE */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !TRACE_H */